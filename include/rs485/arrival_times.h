@@ -0,0 +1,65 @@
+#pragma once
+
+#include <inttypes.h>
+#include <stddef.h>
+
+#include "rs485/util.h"
+
+// A run of bytes that all arrived together, usually in one fetch
+struct ArrivalChunk {
+  TimeMicroseconds_t time;
+  size_t length;
+};
+
+/**
+ * When each byte on the bus arrived, kept as a ring of chunks instead of a time per byte. Every fetch adds at most one chunk,
+ * so a burst of bytes costs the same as a single one. Give one of these to RS485BusBase::setArrivalTimes and the bus keeps
+ * it lined up with its own buffer, and anything holding the bus (protocols, filters, packet handlers) can ask it when a
+ * byte showed up.
+ *
+ * The chunks are owned by whoever constructs this, the same as RejectionBitmap. If every chunk is in use, the two oldest are
+ * merged and keep the older time, so recent bytes stay exact and old ones just look like they arrived a little early.
+ */
+class ArrivalTimes {
+public:
+  ArrivalTimes(ArrivalChunk* chunks, size_t chunkCount);
+
+  void clear();
+
+  // length new bytes arrived at time, after everything already recorded
+  void record(size_t length, TimeMicroseconds_t time);
+  // The oldest byteCount bytes are gone
+  void discard(size_t byteCount);
+
+  // When the byte at index, counting from the oldest recorded byte, arrived. Returns false if it was never recorded.
+  bool getTime(size_t index, TimeMicroseconds_t& time) const;
+
+  // How many bytes and chunks are being kept track of
+  size_t size() const;
+  size_t chunks() const;
+
+private:
+  ArrivalChunk& chunkAt(size_t chunk) const;
+
+  ArrivalChunk* storage;
+  size_t capacity;
+  size_t head = 0;
+  size_t count = 0;
+  size_t bytes = 0;
+};
+
+/**
+ * ArrivalTimes with its own storage for Chunks chunks. Something around how many fetches it takes to fill the bus is plenty.
+ *
+ * RS485Bus<256> bus(busIO, readEnablePin, writeEnablePin);
+ * SizedArrivalTimes<16> arrivalTimes;
+ * bus.setArrivalTimes(arrivalTimes);
+ */
+template<size_t Chunks>
+class SizedArrivalTimes: public ArrivalTimes {
+public:
+  SizedArrivalTimes(): ArrivalTimes(chunkStorage, Chunks) {}
+
+private:
+  ArrivalChunk chunkStorage[Chunks];
+};
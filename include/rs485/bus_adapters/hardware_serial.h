@@ -13,6 +13,8 @@ public:
   virtual size_t available();
   virtual int16_t read();
   virtual void write(uint8_t value);
+  virtual size_t readBytes(uint8_t* buffer, size_t length);
+  virtual void writeBytes(const uint8_t* buffer, size_t length);
 protected:
   HardwareSerial* serial;
 };
\ No newline at end of file
@@ -0,0 +1,53 @@
+#pragma once
+
+#if defined(__linux__)
+
+#include "../bus_io.h"
+#include <termios.h>
+
+/**
+ * BusIO for Linux serial devices. Anything that shows up as a tty works here, whether it's a USB adapter or an on board
+ * UART. The file descriptor is put in non-blocking mode, so available/read never wait and readBytes pulls in as many bytes
+ * as the kernel has buffered in one call. waitForBytes sleeps in poll, so a Packetizer waiting on this bus uses no CPU
+ * until bytes show up. If you're servicing several buses from one thread, fileDescriptor can be added to your own
+ * epoll or poll set instead.
+ *
+ * If your driver supports it, enableKernelDirectionControl lets the kernel toggle RTS as the transceiver's driver enable
+ * line. The bus will then skip its own write enable pin and settle time delays entirely. The receiver is left enabled
+ * while sending, since the bus verifies every byte it writes by reading it back.
+ *
+ * This class does not open or close the file descriptor. That's left to the caller.
+ */
+class PosixSerialBusIO : public BusIO {
+public:
+  explicit PosixSerialBusIO(int fd);
+
+  // Put the terminal in raw 8N1 mode at the given baud rate (B9600, B115200, etc). Returns false if fd isn't a terminal.
+  bool configure(speed_t baudRate);
+  // Have the kernel drive RTS while sending. Returns false if the driver doesn't support TIOCSRS485.
+  bool enableKernelDirectionControl(bool rtsHighWhileSending = true);
+
+  /*
+  How long writeBytes waits for room in the kernel's transmit buffer before giving up on the rest of the bytes. Defaults to
+  1 second. The bytes that didn't go out will fail read back like any other failed write.
+  */
+  void setWriteTimeout(TimeMicroseconds_t timeout);
+
+  int fileDescriptor() const { return fd; }
+
+  // From BusIO
+  virtual size_t available();
+  virtual int16_t read();
+  virtual void write(uint8_t value);
+  virtual size_t readBytes(uint8_t* buffer, size_t length);
+  virtual void writeBytes(const uint8_t* buffer, size_t length);
+  virtual bool handlesWriteEnable();
+  virtual bool waitForBytes(TimeMicroseconds_t timeout);
+
+protected:
+  int fd;
+  bool kernelDirectionControl = false;
+  int writeTimeoutMilliseconds = 1000;
+};
+
+#endif
\ No newline at end of file
@@ -2,9 +2,15 @@
 
 #include <stddef.h>
 #include <inttypes.h>
+#include "util.h"
 
 /**
  * This is a wrapper around serial-like classes. The RS485Bus class takes a BusIO instance in its constructor.
+ *
+ * Only available, read, and write need to be implemented. The bulk readBytes and writeBytes methods fall back to calling
+ * read and write one byte at a time, but adapters that can move several bytes in one call should override them. The
+ * RS485Bus fetches bytes in chunks using readBytes, so that's usually where the biggest gain is. Likewise, adapters that
+ * can block until bytes arrive should override waitForBytes so the Packetizer doesn't have to spin while it waits.
  */
 class BusIO {
 public:
@@ -12,4 +18,32 @@ public:
   virtual size_t available() = 0;  // How many bytes are available to be read in. If N bytes are available, read should be able to be called N times.
   virtual int16_t read() = 0;  // Read one byte from the buffer and return it. Returns -1 if no bytes are available.
   virtual void write(uint8_t value) = 0;  // Write one byte to the bus. Adjusting write enable pins are not the responsibility of this class.
-};
\ No newline at end of file
+
+  // Read up to length bytes into buffer without blocking and return how many were read.
+  virtual size_t readBytes(uint8_t* buffer, size_t length) {
+    size_t bytesRead = 0;
+    while(bytesRead < length) {
+      int16_t value = read();
+      if(value < 0) {
+        break;
+      }
+      buffer[bytesRead++] = value;
+    }
+    return bytesRead;
+  }
+
+  // Write length bytes from buffer to the bus. Same rules as write apply.
+  virtual void writeBytes(const uint8_t* buffer, size_t length) {
+    for(size_t i = 0; i < length; i++) {
+      write(buffer[i]);
+    }
+  }
+
+  // Return true if something below this class (usually the serial driver) toggles the transceiver's driver enable line.
+  // The bus will then skip toggling the write enable pin and waiting for it to settle.
+  virtual bool handlesWriteEnable() { return false; }
+
+  // Sleep until bytes are available to be read or the timeout passes, whichever comes first. Returns false if nothing arrived.
+  // Adapters that can't wait just return true right away, which tells the caller to go check for itself.
+  virtual bool waitForBytes(TimeMicroseconds_t /*timeout*/) { return true; }
+};
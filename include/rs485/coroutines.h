@@ -0,0 +1,276 @@
+#pragma once
+
+/**
+ * An optional C++20 coroutine layer on top of the Packetizer. It's only available when the compiler supports coroutines
+ * (-std=gnu++20 or later), so including this header in an older build just gives you nothing.
+ *
+ * A PacketScheduler owns the packetizer's packet handler and runs everything on one thread. Write each conversation with a
+ * device as a coroutine that returns PacketTask and takes the scheduler as its first parameter:
+ *
+ * PacketTask askFeeder(PacketScheduler& scheduler, uint8_t address) {
+ *   uint8_t request[] = {...};
+ *   RequestResult result = co_await scheduler.request(request, sizeof(request), &responseFilter, 5000);
+ *   if(result.packet.firstLength > 0) {
+ *     // result.packet is the response
+ *   }
+ * }
+ *
+ * askFeeder(scheduler, 3);
+ * while(true) {
+ *   scheduler.poll();
+ * }
+ *
+ * Packets come back as BufferSegments pointing straight into the bus' buffer. They're only valid until the coroutine's next
+ * co_await, so copy out anything you need to keep. Awaiting never allocates. The coroutine frame itself is allocated once
+ * per task, from the scheduler's FrameAllocator if it has one or from the heap otherwise.
+ *
+ * An exception that escapes a conversation coroutine calls std::terminate. There's nobody left to hand it to.
+ */
+
+#if defined(__cpp_impl_coroutine)
+
+#include <coroutine>
+#include <exception>
+#include <new>
+
+#include "rs485/packetizer.h"
+
+class PacketScheduler;
+
+/**
+ * Where coroutine frames come from. Return nullptr from allocate if there's no room, and the task will never start (see
+ * PacketTask::isValid). See FramePool for a fixed size implementation.
+ */
+class FrameAllocator {
+public:
+  virtual ~FrameAllocator() {}
+
+  virtual void* allocate(size_t size) = 0;
+  virtual void deallocate(void* frame) = 0;
+};
+
+/**
+ * A FrameAllocator with Blocks blocks of BlockSize bytes each, all kept inside of the pool itself. A frame bigger than
+ * BlockSize can't be allocated from here.
+ */
+template<size_t BlockSize, size_t Blocks>
+class FramePool: public FrameAllocator {
+public:
+  FramePool() {
+    for(size_t i = 0; i < Blocks; i++) {
+      inUse[i] = false;
+    }
+  }
+
+  virtual void* allocate(size_t size) {
+    if(size > BlockSize) {
+      return nullptr;
+    }
+
+    for(size_t i = 0; i < Blocks; i++) {
+      if(! inUse[i]) {
+        inUse[i] = true;
+        return storage[i];
+      }
+    }
+
+    return nullptr;
+  }
+
+  virtual void deallocate(void* frame) {
+    for(size_t i = 0; i < Blocks; i++) {
+      if(frame == storage[i]) {
+        inUse[i] = false;
+        return;
+      }
+    }
+  }
+
+private:
+  alignas(alignof(max_align_t)) uint8_t storage[Blocks][BlockSize];
+  bool inUse[Blocks];
+};
+
+/**
+ * The return type of a conversation coroutine. It starts running right away and cleans up after itself once it finishes, so
+ * there's nothing to hold on to. The only thing you can ask it is whether it could be started at all.
+ */
+class PacketTask {
+public:
+  struct promise_type {
+    PacketTask get_return_object() { return PacketTask(true); }
+    static PacketTask get_return_object_on_allocation_failure() { return PacketTask(false); }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() { std::terminate(); }
+
+    // The scheduler has to be the first parameter so we know where the frame comes from. Member coroutines aren't supported.
+    template<typename... Args>
+    static void* operator new(size_t size, PacketScheduler& scheduler, Args&&...) noexcept;
+    static void operator delete(void* frame, size_t size) noexcept;
+  };
+
+  bool isValid() const { return valid; }
+
+private:
+  explicit PacketTask(bool valid): valid(valid) {}
+
+  bool valid;
+};
+
+struct RequestResult {
+  PacketWriteResult writeResult;
+  BufferSegments packet;  // Both lengths are 0 if the write failed or no response came back in time
+};
+
+// What every awaitable has in common. The scheduler keeps these in intrusive lists, so waiting never allocates.
+class ScheduledAwaiter {
+public:
+  bool await_ready() const { return false; }
+
+protected:
+  friend class PacketScheduler;
+
+  ScheduledAwaiter(PacketScheduler& scheduler): scheduler(scheduler) {}
+
+  PacketScheduler& scheduler;
+  ScheduledAwaiter* next = nullptr;
+  std::coroutine_handle<> handle;
+
+  const uint8_t* buffer = nullptr;  // What to write, if anything
+  size_t bufferSize = 0;
+  PacketWriteResult writeResult = PacketWriteResult::OK;
+
+  bool waitForPacket = false;
+  const Filter* filter = nullptr;
+  TimeMicroseconds_t waitStartTime = 0;
+  TimeMicroseconds_t timeout = -1;
+  BufferSegments packet = {nullptr, 0, nullptr, 0};
+};
+
+class NextPacketAwaiter: public ScheduledAwaiter {
+public:
+  void await_suspend(std::coroutine_handle<> handle);
+  BufferSegments await_resume() const { return packet; }
+
+private:
+  friend class PacketScheduler;
+  NextPacketAwaiter(PacketScheduler& scheduler, const Filter* filter, TimeMicroseconds_t timeout);
+};
+
+class WritePacketAwaiter: public ScheduledAwaiter {
+public:
+  void await_suspend(std::coroutine_handle<> handle);
+  PacketWriteResult await_resume() const { return writeResult; }
+
+private:
+  friend class PacketScheduler;
+  WritePacketAwaiter(PacketScheduler& scheduler, const uint8_t* buffer, size_t bufferSize);
+};
+
+class RequestAwaiter: public ScheduledAwaiter {
+public:
+  void await_suspend(std::coroutine_handle<> handle);
+  RequestResult await_resume() const { return {writeResult, packet}; }
+
+private:
+  friend class PacketScheduler;
+  RequestAwaiter(PacketScheduler& scheduler, const uint8_t* buffer, size_t bufferSize, const Filter* filter,
+    TimeMicroseconds_t timeout);
+};
+
+/**
+ * Drives every waiting coroutine from one poll loop. Packets are offered to waiting coroutines in the order they started
+ * waiting, and the first one whose filter's postFilter accepts it gets it. A waiter without a filter takes any packet. A
+ * packet nobody is waiting for is dropped.
+ *
+ * Writes are queued on the packetizer with enqueuePacket, in the order they were awaited, so poll never blocks on the bus.
+ * Each one takes a few polls to go out and be verified. Any writes queued past the packetizer's RS485_WRITE_QUEUE_SIZE wait
+ * here until there's room. Don't destroy the scheduler while any of its writes are still queued on the packetizer.
+ *
+ * A coroutine resumed with a packet is running inside of the packetizer's poll, since that's the only time the packet is on
+ * the bus. Until its next co_await it has to follow the same rules as a PacketHandler, so don't use the packetizer directly
+ * from there. Awaiting anything from the scheduler is always fine, because the scheduler only hands writes to the
+ * packetizer from its own poll. Coroutines resumed after a write or a timeout are resumed once the packetizer's poll is done.
+ */
+class PacketScheduler: public PacketHandler, public WriteHandler {
+public:
+  explicit PacketScheduler(Packetizer& packetizer, FrameAllocator* frameAllocator = nullptr);
+  virtual ~PacketScheduler();
+
+  // Queue awaited writes, poll the packetizer once, then resume finished writes and time out anyone who's waited too long.
+  void poll(size_t workBudget = -1);
+
+  // Wait for the next packet the filter accepts. Resumes with empty segments if the timeout passes first.
+  NextPacketAwaiter nextPacket(const Filter* filter = nullptr, TimeMicroseconds_t timeout = -1);
+  // Write a packet. The buffer has to stay around until this resumes.
+  WritePacketAwaiter writePacket(const uint8_t* buffer, size_t bufferSize);
+  // Write a packet and then wait for a response the filter accepts. The timeout starts once the write is done.
+  RequestAwaiter request(const uint8_t* buffer, size_t bufferSize, const Filter* filter, TimeMicroseconds_t timeout);
+
+  FrameAllocator* getFrameAllocator() const { return frameAllocator; }
+
+  // From PacketHandler
+  virtual void handlePacket(const RS485BusBase& bus, const BufferSegments& packet);
+  // From WriteHandler
+  virtual void writeComplete(const uint8_t* buffer, size_t bufferSize, PacketWriteResult result);
+
+private:
+  friend class NextPacketAwaiter;
+  friend class WritePacketAwaiter;
+  friend class RequestAwaiter;
+
+  // A singly linked list of awaiters that keeps track of its tail so adding to it doesn't depend on how long it is
+  struct AwaiterList {
+    ScheduledAwaiter* head = nullptr;
+    ScheduledAwaiter* tail = nullptr;
+
+    void append(ScheduledAwaiter* awaiter);
+    // Remove awaiter, which comes right after previous (nullptr if it's the head)
+    void remove(ScheduledAwaiter* previous, ScheduledAwaiter* awaiter);
+  };
+
+  void startWaiting(ScheduledAwaiter* awaiter);
+  void enqueueWrites();
+  void resumeWritten();
+  void expireWaiting();
+
+  Packetizer& packetizer;
+  FrameAllocator* frameAllocator;
+
+  AwaiterList writeQueue;  // Awaited, but not on the packetizer's queue yet
+  AwaiterList writing;     // On the packetizer's queue, in the same order
+  AwaiterList written;     // Done, and waiting for poll to resume them
+  AwaiterList packetWaiters;
+};
+
+// Every frame starts with a pointer to the allocator it came from, or nullptr for the heap, so delete knows where it goes.
+static const size_t PACKET_TASK_FRAME_HEADER = alignof(max_align_t);
+
+template<typename... Args>
+void* PacketTask::promise_type::operator new(size_t size, PacketScheduler& scheduler, Args&&...) noexcept {
+  FrameAllocator* allocator = scheduler.getFrameAllocator();
+  size_t totalSize = size + PACKET_TASK_FRAME_HEADER;
+
+  void* block = (allocator != nullptr) ? allocator->allocate(totalSize) : ::operator new(totalSize, std::nothrow);
+  if(block == nullptr) {
+    return nullptr;
+  }
+
+  *static_cast<FrameAllocator**>(block) = allocator;
+  return static_cast<uint8_t*>(block) + PACKET_TASK_FRAME_HEADER;
+}
+
+inline void PacketTask::promise_type::operator delete(void* frame, size_t /*size*/) noexcept {
+  void* block = static_cast<uint8_t*>(frame) - PACKET_TASK_FRAME_HEADER;
+  FrameAllocator* allocator = *static_cast<FrameAllocator**>(block);
+
+  if(allocator != nullptr) {
+    allocator->deallocate(block);
+  } else {
+    ::operator delete(block);
+  }
+}
+
+#endif
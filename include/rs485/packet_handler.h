@@ -0,0 +1,35 @@
+#pragma once
+
+#include "rs485bus_base.h"
+
+/**
+ * Packet handlers can be given to the Packetizer so that Packetizer::poll hands packets to them as it finds them, instead of
+ * the caller having to check hasPacket/getPacket/clearPacket itself.
+ *
+ * The packet is given as segments pointing straight into the bus' buffer, so nothing is copied. The packetizer clears the
+ * packet as soon as handlePacket returns, so copy out anything you need to keep. Don't fetch from the bus, or read, clear or
+ * write packets with the packetizer while handling a packet. Queuing a packet with enqueuePacket is the one exception, since
+ * it only adds to the write queue and poll doesn't start on it until it's done handing out packets.
+ *
+ * The same handler can be given to several packetizers. The bus tells you which one the packet came from.
+ */
+class PacketHandler {
+public:
+  virtual ~PacketHandler() {}
+
+  virtual void handlePacket(const RS485BusBase& bus, const BufferSegments& packet) = 0;
+};
+
+enum class PacketWriteResult;
+
+/**
+ * Write handlers are told when a packet queued with Packetizer::enqueuePacket is done being written, one way or another.
+ * The buffer is the same one given to enqueuePacket, so it can be reused or freed from here. It's fine to queue another
+ * packet from inside of writeComplete.
+ */
+class WriteHandler {
+public:
+  virtual ~WriteHandler() {}
+
+  virtual void writeComplete(const uint8_t* buffer, size_t bufferSize, PacketWriteResult result) = 0;
+};
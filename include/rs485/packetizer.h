@@ -4,6 +4,8 @@
 #include "rs485/rs485bus_base.h"
 #include "rs485/protocol.h"
 #include "rs485/filter.h"
+#include "rs485/packet_handler.h"
+#include "rs485/rejection_bitmap.h"
 
 enum class PacketWriteResult {
   OK,                   // Writing all bytes succeeded
@@ -17,6 +19,73 @@ struct Packet {
   size_t endIndex;
 };
 
+/**
+ * Every packet found in one scan of the bus, in order. The Packets themselves live in storage the caller handed to
+ * findPackets. This works with a range based for loop.
+ */
+struct PacketBatch {
+  const Packet* packets;
+  size_t count;
+
+  const Packet* begin() const { return packets; }
+  const Packet* end() const { return packets + count; }
+  size_t size() const { return count; }
+  bool empty() const { return count == 0; }
+  const Packet& operator[](size_t index) const { return packets[index]; }
+};
+
+// How many "not enough bytes" candidates the packetizer can keep track of at once. Each one costs a PendingCandidate of RAM.
+#ifndef RS485_PENDING_CANDIDATES
+#define RS485_PENDING_CANDIDATES 8
+#endif
+
+// How many packets can be waiting to be written by poll at once, including the one being written. Each one costs a QueuedWrite of RAM.
+#ifndef RS485_WRITE_QUEUE_SIZE
+#define RS485_WRITE_QUEUE_SIZE 4
+#endif
+
+struct QueuedWrite {
+  const uint8_t* buffer;
+  size_t bufferSize;
+  WriteHandler* handler;  // Optional
+};
+
+// How many frame starts past the first the packetizer can remember when framing by idle gaps. Each one costs a size_t of RAM.
+#ifndef RS485_FRAME_BOUNDARIES
+#define RS485_FRAME_BOUNDARIES 8
+#endif
+
+// Backoff ranges stop doubling after this many failed attempts
+#ifndef RS485_MAX_BACKOFF_EXPONENT
+#define RS485_MAX_BACKOFF_EXPONENT 8
+#endif
+
+// Where poll is with the packet at the front of the write queue
+enum class WritePhase: uint8_t {
+  IDLE,        // Nothing being written
+  QUIET_WAIT,  // Waiting for the bus to go quiet before sending the first byte
+  VERIFY,      // Sending bytes and checking them as they're read back
+  BACKOFF      // The last attempt failed, so we're waiting a bit before trying again
+};
+
+// Running totals of how writes have gone, across both writePacket and enqueuePacket
+struct WriteStatistics {
+  uint32_t packets;                // Packets that are done being written, whether they made it or not
+  uint32_t attempts;               // Attempts across all of those packets
+  uint32_t interrupted;            // Attempts that ended with FAILED_INTERRUPTED
+  uint32_t timedOut;               // Attempts that ended with FAILED_TIMEOUT
+  uint32_t gaveUp;                 // Packets that still failed on their last attempt
+  TimeMicroseconds_t backoffTime;  // Total time spent backing off between attempts
+};
+
+// A candidate packet that needs more bytes, along with whatever we know about it so far
+struct PendingCandidate {
+  bool inUse;
+  size_t startIndex;
+  size_t readyAt;  // Don't ask the protocol about this candidate again until the bus has at least this many bytes
+  StreamingState state;  // Only used with a StreamingProtocol
+};
+
 /**
  * The Packetizer class wraps the RS485 Bus, allowing you to read and write packets more effeciently. While you don't have to
  * write anything using this class and can still use reading/writing on the bus directly, you must specify a Protocol
@@ -28,25 +97,86 @@ struct Packet {
  *   if(packetizer.hasPacket()) {
  *     Packet packet = packetizer.getPacket();
  *     // bus[packet.startIndex] to bus[packet.endIndex] is your packet. Do with it what you need to.
+ *     // bus.getSegments(packet.startIndex, packet.endIndex) gives you the same bytes without copying them.
  *     // Clear the packet out so the next one can be read when hasPacket is next called.
  *     packetizer.clearPacket();
  *   }
  * }
  *
+ * When several packets show up at once, findPackets collects all of them in one go and clearPackets discards them together:
+ * Packet storage[8];
+ * PacketBatch batch = packetizer.findPackets(storage, 8);
+ * for(const Packet& packet : batch) {
+ *   // Same as getPacket above
+ * }
+ * packetizer.clearPackets(batch);
+ *
+ * If you'd rather not block, give the packetizer a PacketHandler and call poll instead. Each call only does as much work as
+ * you let it, so one loop can look after several buses:
+ * packetizer.setPacketHandler(handler);
+ * while(true) {
+ *   packetizer.poll();
+ *   otherPacketizer.poll();
+ * }
+ *
+ * Writes can go through poll too. enqueuePacket returns right away, and each poll moves the packet at the front of the queue
+ * along without ever waiting on the bus. The WriteHandler given with the packet is told how it went:
+ * packetizer.enqueuePacket(buffer, bufferSize, &writeHandler);
+ *
  * Writing a packet will attempt to write one byte at a time, verifying that that byte gets written to the bus. The
  * packet you write does not have to be a valid byte according to the protocol. The write method will block until
- * the max write timeout is reached if it sees bytes on the buffer during the quiet time. It will only attempt to
- * write the packet once though, so it is up to the consumer to handle any issues/retries.
+ * the max write timeout is reached if it sees bytes on the buffer during the quiet time. By default it only attempts to
+ * write the packet once, so it is up to the consumer to handle any issues/retries unless max write attempts is raised.
+ *
+ * Collisions are a fact of life on a bus with more than one master. Setting the max write attempts above 1 makes both write
+ * paths try again after FAILED_INTERRUPTED or FAILED_TIMEOUT. Before each retry they back off a random number of slots,
+ * doubling the range each time like Ethernet does, so two nodes that collided are unlikely to collide again.
+ *
+ * By default, each byte is read back before the next one is written. That's one full round trip per byte. Setting a
+ * write window larger than 1 keeps that many bytes in flight instead, which lets large packets get close to line rate.
+ * Every byte is still verified either way.
+ *
+ * Offsets that the Protocol says can never start a packet are remembered so isPacket isn't called on them again. A plain
+ * Packetizer only remembers the first 64 bytes of the bus, so buses bigger than that should use SizedPacketizer<BufferSize>
+ * (or pass their own storage to the constructor) to have them remembered across the whole buffer. Building a plain Packetizer
+ * on an RS485Bus bigger than 64 bytes gives a deprecation warning. Pass the bus as an RS485BusBase& if only remembering the
+ * first 64 bytes is really what you want. A MirroredRS485Bus's size isn't known until it's running, so nothing can warn there.
+ *
+ * If the Protocol is also a StreamingProtocol, the packetizer keeps the protocol's state for the first few candidates that
+ * need more bytes, so each byte of those is only looked at once. Any candidates past that go through isPacket as usual. If
+ * the Protocol says how many bytes a candidate needs, the packetizer won't ask about that candidate again until it has them.
+ *
+ * Protocols like Modbus RTU mark the end of a packet with silence instead of anything in the bytes. Setting a frame gap
+ * switches the packetizer over to framing by that silence: bytes that arrive after the bus has been quiet for longer than the
+ * frame gap start a new frame, and isPacket is called once per frame, at its start, once the frame is over. Nothing inside of
+ * a frame is ever tried as the start of a packet, and a frame that isn't a packet is thrown out whole.
  */
+template<size_t BufferSize>
+class RS485Bus;
+
 class Packetizer {
 public:
   explicit Packetizer(RS485BusBase& bus, const Protocol& protocol);
+  // Same as above, but warns if the bus is too big for a plain Packetizer to remember rejections across all of it
+  template<size_t BufferSize>
+  explicit Packetizer(RS485Bus<BufferSize>& bus, const Protocol& protocol);
+  // Remember rejected offsets across rejectionBits bytes of the bus using the caller's storage. See SizedPacketizer for a simpler way.
+  explicit Packetizer(RS485BusBase& bus, const Protocol& protocol, uint32_t* rejectionStorage, size_t rejectionBits);
   virtual ~Packetizer() {}
+  // rejectedBitmap points into our own storage, so a copy would share it, then dangle
+  Packetizer(const Packetizer&) = delete;
+  Packetizer& operator=(const Packetizer&) = delete;
 
   // Fetch bytes from the bus and see if a packet is available based on the Protocol.
   bool hasPacket();
 
-  // Check if the bytes on the bus currently form a packet based on the Protocol.
+  /*
+  Check if the bytes on the bus currently form a packet based on the Protocol. A rescan after new bytes doesn't start from
+  scratch. Offsets that returned NO are skipped, a packet already found past the start of the bus isn't checked again, and
+  candidates that returned NOT_ENOUGH_BYTES are left alone until they have the bytesNeeded the protocol asked for. A
+  StreamingProtocol is then only fed each candidate's new bytes. A plain Protocol that leaves bytesNeeded at 0 still gets
+  asked about each pending candidate from its start on every new byte, since it has no way to say how far it got.
+  */
   virtual bool hasPacketNow();
 
   // Get the packet start/end index. 0 for both if no packet is available.
@@ -55,10 +185,45 @@ public:
   // Clear the packet after the user has used the data.
   void clearPacket();
 
+  /**
+   * Find up to maxPackets packets on the bus as it is right now. The first one is the same packet hasPacketNow/getPacket would
+   * give you. After that, packets that follow it are collected as long as only rejected bytes sit between them. It stops at
+   * the first candidate that still needs more bytes, since anything past that could be inside of it.
+   */
+  PacketBatch findPackets(Packet* packets, size_t maxPackets);
+
+  // Clear every packet in the batch, along with everything before them, in one step.
+  void clearPackets(const PacketBatch& batch);
+
+  /**
+   * Fetch whatever bytes are available, scan them, and hand every packet found to the packet handler. This never waits. At
+   * most workBudget offsets are given to the filter or protocol, and the scan picks up where it left off on the next call.
+   * A packet that isn't at the start of the bus is only handed over once the bus has been quiet for the false packet
+   * verification timeout. Without a packet handler, this only fetches and scans, and getPacket works as usual afterwards.
+   * Any packet queued with enqueuePacket is moved along afterwards. Returns how many packets were handled.
+   */
+  size_t poll(size_t workBudget = -1);
+
+  /**
+   * Queue a packet to be written by poll instead of writing it right now. Returns false if the queue is already full. The
+   * buffer has to stay around until the handler's writeComplete is called. poll waits for the bus to be quiet, sends the
+   * packet a write window at a time, and checks the bytes as they're read back, the same as writePacket. It just doesn't
+   * wait while it does it. Don't call writePacket while anything is queued.
+   */
+  bool enqueuePacket(const uint8_t* buffer, size_t bufferSize, WriteHandler* handler = nullptr);
+  // How many packets are waiting to be written, including the one being written now
+  size_t queuedPackets() const;
+
+  // Set the handler that poll gives packets to. See the PacketHandler class for more details
+  void setPacketHandler(PacketHandler& handler);
+  // Remove the packet handler from this packetizer
+  void removePacketHandler();
+
   /**
    * How long to keep trying to read a packet. If no new data is available, this value is irrelevent. This value is
    * from the beginning of the call to hasPacket, so at some point it will give up even if it continues to read new
-   * bytes.
+   * bytes. While there's nothing new to look at, hasPacket waits on the BusIO's waitForBytes instead of spinning if the
+   * BusIO supports it.
    */
   void setMaxReadTimeout(TimeMicroseconds_t maxReadTimeout);
 
@@ -70,20 +235,62 @@ public:
   void setFalsePacketVerificationTimeout(TimeMicroseconds_t falsePacketVerificationTimeout);
 
   PacketWriteResult writePacket(const uint8_t* buffer, size_t bufferSize);
+  // Offset of the first byte the last writePacket couldn't verify. This is the packet size if it was written successfully.
+  size_t getWriteFailureOffset() const;
+  // How many bytes can be written before their echo must be read back. 1 (the default) verifies each byte before the next.
+  void setWriteWindow(size_t writeWindow);
   
+  /**
+   * How many times to try writing each packet. 1 (the default) never retries. Only FAILED_INTERRUPTED and FAILED_TIMEOUT are
+   * retried, since retrying can't help a full buffer.
+   */
+  void setMaxWriteAttempts(size_t maxWriteAttempts);
+  /**
+   * One backoff slot, usually the time it takes to send a byte at your baud rate. After the Nth failed attempt, we wait between
+   * 0 and 2^N - 1 slots (capped at 2^RS485_MAX_BACKOFF_EXPONENT - 1) before waiting for the bus to go quiet again.
+   */
+  void setBackoffSlotTime(TimeMicroseconds_t backoffSlotTime);
+  // Seed the random backoff. Give each node on the bus something different, like its address, so they don't back off in step.
+  void setBackoffSeed(uint32_t seed);
+  // How many attempts the last packet took, including the one that worked if it did
+  size_t getLastWriteAttempts() const;
+  const WriteStatistics& getWriteStatistics() const;
+  void resetWriteStatistics();
+
   // Before attempting to write a packet, how long should the bus not receive any new bytes
   void setBusQuietTime(TimeMicroseconds_t busQuietTime);
   // The maximum amount of time we are willing to wait for the bus to go quiet
   void setMaxWriteTimeout(TimeMicroseconds_t maxWriteTimeout);
 
+  /**
+   * Frame packets by idle gaps instead of searching every offset. 0 (the default) turns this off. For Modbus RTU this is 3.5
+   * character times, so about 4010us at 9600 baud with 11 bit characters, and the spec says to use 1750us above 19200 baud.
+   * Gaps are measured between fetches, so bytes have to be fetched (hasPacket, poll, ...) more often than the gap. If more than
+   * RS485_FRAME_BOUNDARIES frames are waiting, the newest ones run together and get thrown out.
+   */
+  void setFrameGap(TimeMicroseconds_t frameGap);
+
   // Add a filter to this packetizer. See the Filter class for more details
   void setFilter(const Filter& filter);
   // Remove a filter from this packetizer
   void removeFilter();
 protected:
   virtual size_t fetchFromBus();
-  inline void eatOneByte();
+  bool scanForPacket(size_t& workBudget);
+  bool scanForFrame(size_t& workBudget);
+  bool isFramePacket(size_t frameStart, size_t frameEnd, size_t& packetEnd);
+  bool findFrameEnd(size_t frame, size_t& frameEnd) const;
+  PacketWriteResult writePacketOnce(const uint8_t* buffer, size_t bufferSize);
+  void advanceWrite(bool newBytesFetched);
+  void finishWrite(PacketWriteResult result);
+  bool recordWriteAttempt(PacketWriteResult result);
+  TimeMicroseconds_t nextBackoffTime();
+  inline void eatBytes(size_t count);
+  inline void eatRejectedPrefix();
   inline void rejectByte(size_t location);
+  IsPacketResult isPacket(size_t location);
+  PendingCandidate* findPendingCandidate(size_t location);
+  PendingCandidate* newPendingCandidate(size_t location);
 
   RS485BusBase* bus;
   const Protocol* protocol;
@@ -93,14 +300,62 @@ protected:
   const Filter* filter = nullptr;
   size_t filterLookAhead = 0;
 
+  PacketHandler* packetHandler = nullptr;
+
   bool shouldRecheck = true;
   size_t lastBusAvailable = 0;
-  uint64_t recheckBitmap = 0;
+  size_t scanResumeIndex = 0;  // Where the next scan starts if the last one ran out of work budget
+  uint32_t defaultRejectionStorage[RejectionBitmap::wordsFor(64)];  // Only used if the caller doesn't supply anything bigger
+  RejectionBitmap rejectedBitmap;
+
+  template<bool TooBig>
+  struct BusSize {};
+  static void checkBusSize(BusSize<false>) {}
+  __attribute__((deprecated("A plain Packetizer only remembers rejected offsets in the first 64 bytes. Use SizedPacketizer.")))
+  static void checkBusSize(BusSize<true>) {}
+
+  // A packet we already found past the start of the bus. New bytes can't change that it's a packet, only that an earlier one
+  // might finish first, so rescans use this instead of calling isPacket and postFilter on it again. End of 0 means none.
+  // On a noisy bus of short packets, that's about a quarter of the isPacket calls it takes without it (see bench_rs485).
+  // This is all it caches. Picking pending candidates back up where they left off is up to pendingCandidates.
+  size_t knownPacketStartIndex = 0;
+  size_t knownPacketEndIndex = 0;
+
+  static const size_t PENDING_CANDIDATES = RS485_PENDING_CANDIDATES;
+  PendingCandidate pendingCandidates[PENDING_CANDIDATES];
 
   TimeMicroseconds_t maxReadTimeout = -1;
   TimeMicroseconds_t maxWriteTimeout = -1;
   TimeMicroseconds_t busQuietTime = 0;  // How long the bus needs to go without fetching a byte before we can write a new byte
+  size_t writeWindow = 1;
+  size_t writeFailureOffset = 0;
+
+  static const size_t WRITE_QUEUE_SIZE = RS485_WRITE_QUEUE_SIZE;
+  QueuedWrite writeQueue[WRITE_QUEUE_SIZE];
+  size_t writeQueueHead = 0;
+  size_t writeQueueCount = 0;
+  WritePhase writePhase = WritePhase::IDLE;
+  TimeMicroseconds_t writePhaseStartTime = 0;  // When we started waiting for quiet, or when the last byte was verified
+  size_t writeBytesSent = 0;
+  TimeMicroseconds_t writeBackoffTime = 0;  // How long the current backoff lasts
+
+  size_t maxWriteAttempts = 1;
+  size_t lastWriteAttempts = 0;
+  TimeMicroseconds_t backoffSlotTime = 0;
+  uint32_t backoffRandom = 0;  // xorshift state. 0 until it's seeded, either by setBackoffSeed or from micros the first time
+  WriteStatistics writeStatistics = {0, 0, 0, 0, 0, 0};
 
   TimeMicroseconds_t lastByteReadTimestamp = 0;  // Last time any bytes were known to be fetched
+
+  TimeMicroseconds_t frameGap = 0;
+  // Where each frame after the first one starts, in order. The first frame always starts at the start of the bus.
+  static const size_t FRAME_BOUNDARIES = RS485_FRAME_BOUNDARIES;
+  size_t frameStarts[FRAME_BOUNDARIES];
+  size_t frameStartCount = 0;
   TimeMicroseconds_t falsePacketVerificationTimeout = 0;
-};
\ No newline at end of file
+};
+
+template<size_t BufferSize>
+Packetizer::Packetizer(RS485Bus<BufferSize>& bus, const Protocol& protocol): Packetizer(static_cast<RS485BusBase&>(bus), protocol) {
+  checkBusSize(BusSize<(BufferSize > 64)>());
+}
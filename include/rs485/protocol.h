@@ -11,8 +11,11 @@ enum class PacketStatus: uint8_t {
 struct IsPacketResult {
   PacketStatus status;
   size_t packetLength;
+  size_t bytesNeeded;  // Only for NOT_ENOUGH_BYTES, and optional. Bytes needed from startIndex before asking again. See isPacket.
 };
 
+class StreamingProtocol;
+
 class Protocol {
 public:
   virtual ~Protocol() {}
@@ -25,18 +28,78 @@ public:
    *     with a new endIndex. Return NO if you can be sure the number of bytes needed is larger than the bus buffer size.
    * 
    * Only a status of YES should have a non-zero packet length.
+   *
+   * If you return NOT_ENOUGH_BYTES and already know how long the packet has to be (from a length field, for instance), set
+   * bytesNeeded to that length. The packetizer won't call isPacket on this startIndex again until that many bytes are on the
+   * bus starting from it. Leaving it at 0 means you'll be asked again on every new byte.
    * 
    * As far as the packetizer is concerned, it will only test packets that return NO, once (This only applies to the first 64
-   * bytes). If there is a NO at the beginning of the buffer, then that byte is discarded from the buffer. If NOT_ENOUGH_BYTES
-   * is returned, then it will test it again when more bytes are available. If NOT_ENOUGH_BYTES is returned and the buffer is
-   * full up, then NOT_ENOUGH_BYTES will be treated as a NO. It is helpful for Protocol implementations to check for overall
-   * buffer length. If a length field is available and the length field is larger than the buffer size, it's more effecient to
-   * just return NO.
+   * bytes, or the whole buffer with a SizedPacketizer). If there is a NO at the beginning of the buffer, then that byte is
+   * discarded from the buffer. If NOT_ENOUGH_BYTES is returned, then it will test it again when more bytes are available. If
+   * NOT_ENOUGH_BYTES is returned and the buffer is full up, then NOT_ENOUGH_BYTES will be treated as a NO. It is helpful for
+   * Protocol implementations to check for overall buffer length. If a length field is available and the length field is
+   * larger than the buffer size, it's more effecient to just return NO.
    * 
    * Finally, if at any point a YES is returned, all bytes previous to that are discarded.
+   *
+   * bus[index] bounds checks every byte. If you need to look at more than a few bytes, bus.getSegments hands you pointers
+   * straight into the bus' buffer instead.
    * 
    * In an ideal world, the next byte after the updated endIndex, when Protocol returns YES, would be the start of a new packet.
    * Unfortunately, given collisions and other issues, that may not be the case. Do not make any assumptions or try to "read ahead".
    */
   virtual IsPacketResult isPacket(const RS485BusBase& bus, size_t startIndex, size_t endIndex) const = 0;
+
+  /**
+   * If this protocol can also be fed a packet a few bytes at a time, return it here. The packetizer will then only hand it
+   * the bytes it hasn't seen yet for each candidate instead of calling isPacket from the start of it again. isPacket is still
+   * used when the packetizer runs out of room to keep track of more candidates.
+   */
+  virtual const StreamingProtocol* streaming() const { return nullptr; }
+
+  /**
+   * The first index from startIndex up to and including endIndex where a packet could possibly start, or endIndex + 1 if
+   * there isn't one. Protocols whose packets always begin with a marker byte can find it with one quick search here, and
+   * the packetizer will treat everything they skip over as a NO without calling isPacket on it. Returning startIndex, the
+   * default, means isPacket gets asked about every offset.
+   */
+  virtual size_t nextPacketStart(const RS485BusBase& /*bus*/, size_t startIndex, size_t /*endIndex*/) const {
+    return startIndex;
+  }
+};
+
+/**
+ * What a StreamingProtocol knows about a single candidate packet between calls. The packetizer owns one of these for each
+ * candidate it's tracking and never looks inside of it except for consumed.
+ */
+struct StreamingState {
+  size_t consumed;        // How many bytes of the candidate have been fed in so far
+  uint32_t checksum;      // Running checksum, in whatever form the protocol wants to keep it
+  size_t expectedLength;  // Total packet length once the protocol knows it, 0 until then
+  uint32_t extra;         // Anything else the protocol needs to carry between calls
+};
+
+struct StreamingResult {
+  PacketStatus status;
+  size_t packetLength;  // Same as IsPacketResult, only non-zero for YES
+  size_t bytesNeeded;   // For NOT_ENOUGH_BYTES, how many more bytes are needed at least before another answer. 0 if unknown.
+};
+
+/**
+ * The push style version of Protocol::isPacket. begin is called once for a new candidate, then feed is called with the next
+ * bytes of that candidate as they show up. The first call to feed starts with the candidate's first byte, and every call
+ * after starts right where the previous one left off.
+ *
+ * - Return YES once the packet is complete. Don't look at any bytes past the end of it.
+ * - Return NO as soon as you know it can't be a packet, same as isPacket.
+ * - Otherwise, take every byte you're given, add it to state.consumed, and return NOT_ENOUGH_BYTES.
+ *
+ * maxLength is the largest packet the bus can hold. Anything that will need more than that should be a NO.
+ */
+class StreamingProtocol {
+public:
+  virtual ~StreamingProtocol() {}
+
+  virtual void begin(StreamingState& state) const = 0;
+  virtual StreamingResult feed(StreamingState& state, const uint8_t* data, size_t length, size_t maxLength) const = 0;
 };
\ No newline at end of file
@@ -1,13 +1,35 @@
 #pragma once
 
-#include <inttypes.h>
-
-// Polynomial: X^8 + X^2 + X + 1
-class CRC8_107 {
-public:
-  void add(uint8_t data);
-  operator uint8_t() { return getChecksum(); }
-  uint8_t getChecksum();
-private:
-  uint32_t crc = 0x0;
-};
\ No newline at end of file
+#include "rs485/protocols/checksums/crc.hpp"
+
+/**
+ * How CRC8_107 does its work:
+ * 0 - One bit at a time. No tables at all, for when flash is tight.
+ * 1 - One byte at a time from a 256 byte table.
+ * 4 - Same as 1 for single bytes, but add(data, length) takes 4 bytes per step using another 768 bytes of tables.
+ * 8 - Same as 4, but 8 bytes per step using another 1792 bytes of tables.
+ *
+ * Every option gives exactly the same checksums.
+ */
+#ifndef RS485_CRC8_107_SLICES
+#ifdef __AVR__
+#define RS485_CRC8_107_SLICES 0
+#else
+#define RS485_CRC8_107_SLICES 8
+#endif
+#endif
+
+#if RS485_CRC8_107_SLICES == 0
+#define RS485_CRC8_107_STRATEGY CrcStrategy::BITWISE
+#elif RS485_CRC8_107_SLICES == 1
+#define RS485_CRC8_107_STRATEGY CrcStrategy::BYTE_TABLE
+#elif RS485_CRC8_107_SLICES == 4
+#define RS485_CRC8_107_STRATEGY CrcStrategy::SLICE_BY_4
+#elif RS485_CRC8_107_SLICES == 8
+#define RS485_CRC8_107_STRATEGY CrcStrategy::SLICE_BY_8
+#else
+#error "RS485_CRC8_107_SLICES has to be 0, 1, 4, or 8"
+#endif
+
+// Polynomial: X^8 + X^2 + X + 1. Also known as CRC-8/SMBUS.
+typedef Crc<8, 0x07, 0x00, false, false, 0x00, RS485_CRC8_107_STRATEGY> CRC8_107;
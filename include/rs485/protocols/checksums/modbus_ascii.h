@@ -0,0 +1,16 @@
+#pragma once
+
+#include <inttypes.h>
+
+// Longitudinal redundancy check: the two's complement of the sum of every byte, with the carries thrown away
+class ModbusASCIIChecksum {
+public:
+  // Start from a checksum you already have, to pick back up where an earlier one left off
+  explicit ModbusASCIIChecksum(uint8_t checksum = 0): sum(-checksum) {}
+
+  void add(uint8_t data);
+  operator uint8_t() { return getChecksum(); }
+  uint8_t getChecksum() { return -sum; }
+private:
+  uint8_t sum;
+};
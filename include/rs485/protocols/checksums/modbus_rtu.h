@@ -1,13 +1,32 @@
 #pragma once
 
-#include <inttypes.h>
+#include "rs485/protocols/checksums/crc.hpp"
+
+// Set to 0 to never use PCLMULQDQ in ModbusRTUChecksum::add(data, length), even on x86-64 processors that have it
+#ifndef RS485_MODBUS_RTU_PCLMUL
+#if defined(__x86_64__) && defined(__GNUC__)
+#define RS485_MODBUS_RTU_PCLMUL 1
+#else
+#define RS485_MODBUS_RTU_PCLMUL 0
+#endif
+#endif
+
+// CRC-16/MODBUS, with carry-less multiplication for longer runs of bytes if the processor can do it
+class ModbusRTUChecksum: public Crc<16, 0x8005, 0xFFFF, true, true, 0x0000> {
+  typedef Crc<16, 0x8005, 0xFFFF, true, true, 0x0000> Base;
 
-class ModbusRTUChecksum {
 public:
-  void add(uint8_t data);
-  operator uint16_t() { return getChecksum(); }
-  uint16_t getChecksum() { return checksum; }
-private:
-  uint16_t checksum = 0xffff;
-  static const uint16_t crcTable[256];
-};
\ No newline at end of file
+  // Start from a checksum you already have, to pick back up where an earlier one left off
+  explicit ModbusRTUChecksum(uint16_t checksum = 0xffff): Base(checksum) {}
+
+  using Base::add;
+  // Same as adding each byte on its own
+  void add(const uint8_t* data, size_t length);
+
+  // Each way of running the checksum on its own. Mostly for tests and benchmarks.
+  static uint16_t addTable(uint16_t checksum, const uint8_t* data, size_t length);
+#if RS485_MODBUS_RTU_PCLMUL
+  static bool hasPCLMUL();
+  static uint16_t addPCLMUL(uint16_t checksum, const uint8_t* data, size_t length);  // Only if hasPCLMUL() is true
+#endif
+};
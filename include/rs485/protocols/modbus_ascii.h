@@ -0,0 +1,34 @@
+#pragma once
+
+#include "rs485/protocol.h"
+
+/**
+ * Modbus ASCII framing.
+ *
+ * Packet format: ':' <address:2> <function:2> <data:2N> <lrc:2> '\r' '\n'
+ *
+ * Everything between the colon and the CR LF is hex, two characters to a byte. The LRC makes the sum of every decoded byte,
+ * itself included, come out to 0. Reserved addresses, anything that isn't hex, a stray colon, or running past 513
+ * characters are all a NO.
+ *
+ * Every frame starts with a colon and the colon can't show up anywhere else, so nextPacketStart searches straight for the
+ * next one. Getting back in sync after noise only costs looking at the noise once.
+ *
+ * It can be used as a StreamingProtocol too, so each character only ever has to be decoded once. Hex is decoded a whole pair
+ * at a time through a lookup table, falling back to one character at a time around the CR LF or a byte split between calls.
+ */
+class ModbusASCIIProtocol : public Protocol, public StreamingProtocol {
+public:
+  static const size_t MIN_PACKET_LENGTH = 9;    // Colon, address, function, LRC, and CR LF
+  static const size_t MAX_PACKET_LENGTH = 513;  // From the Modbus serial line spec
+  static const uint8_t MAX_ADDRESS = 247;       // 248 to 255 are reserved
+  static const uint8_t START = ':';
+
+  virtual IsPacketResult isPacket(const RS485BusBase& bus, size_t startIndex, size_t endIndex) const;
+  virtual const StreamingProtocol* streaming() const { return this; }
+  virtual size_t nextPacketStart(const RS485BusBase& bus, size_t startIndex, size_t endIndex) const;
+
+  // From StreamingProtocol
+  virtual void begin(StreamingState& state) const;
+  virtual StreamingResult feed(StreamingState& state, const uint8_t* data, size_t length, size_t maxLength) const;
+};
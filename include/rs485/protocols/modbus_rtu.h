@@ -0,0 +1,51 @@
+#pragma once
+
+#include "rs485/protocol.h"
+
+// Which kinds of frames a ModbusRTUProtocol should expect to see
+enum class ModbusFrames: uint8_t {
+  REQUESTS,   // Only what a master sends, like a slave that never hears other slaves
+  RESPONSES,  // Only what slaves send back, including exceptions
+  BOTH        // Anything, like anyone listening to the whole bus
+};
+
+/**
+ * Modbus RTU framing.
+ *
+ * Packet format: <address:1> <function:1> <data:N> <crc:2>
+ *
+ * The CRC is sent low byte first, which means running the checksum over a whole packet including its CRC always leaves 0
+ * behind.
+ *
+ * The function code says how long the packet is, either outright or with a byte count a few bytes in, and requests and
+ * responses each have their own rule. Exceptions (the function code with the high bit set) are always 5 bytes. Once a
+ * candidate gets to a length it could be, the CRC has to match right there or it's not that kind of packet. Reserved
+ * addresses, function codes Modbus doesn't define, and lengths that can't fit are a NO as soon as they're seen, and
+ * bytesNeeded is always the shortest length the candidate could still be.
+ *
+ * Function codes without a fixed layout (8, whose Return Query Data echoes any length, 43 and the user defined ranges)
+ * fall back to taking the first point the CRC comes out to 0, the same as every packet used to.
+ *
+ * Real Modbus RTU marks the end of a frame with 3.5 characters of silence. Packetizer::setFrameGap can do that framing, and
+ * this protocol still checks each frame.
+ *
+ * It can be used as a StreamingProtocol too, so the checksum only ever has to be run over each byte once.
+ */
+class ModbusRTUProtocol : public Protocol, public StreamingProtocol {
+public:
+  static const size_t MIN_PACKET_LENGTH = 4;    // Address, function, and CRC
+  static const size_t MAX_PACKET_LENGTH = 256;  // From the Modbus serial line spec
+  static const uint8_t MAX_ADDRESS = 247;       // 248 to 255 are reserved
+
+  explicit ModbusRTUProtocol(ModbusFrames frames = ModbusFrames::BOTH);
+
+  virtual IsPacketResult isPacket(const RS485BusBase& bus, size_t startIndex, size_t endIndex) const;
+  virtual const StreamingProtocol* streaming() const { return this; }
+
+  // From StreamingProtocol
+  virtual void begin(StreamingState& state) const;
+  virtual StreamingResult feed(StreamingState& state, const uint8_t* data, size_t length, size_t maxLength) const;
+
+private:
+  ModbusFrames frames;
+};
@@ -8,8 +8,15 @@
  * Lumen PNP GitHub: https://github.com/opulo-inc/lumenpnp
  * 
  * Packet format: <address:1> <length:1> <data:N> <checksum:2>
+ *
+ * It can be used as a StreamingProtocol too, so the checksum only ever has to be run over each byte once.
  */
-class PhotonProtocol : public Protocol {
+class PhotonProtocol : public Protocol, public StreamingProtocol {
 public:
   virtual IsPacketResult isPacket(const RS485BusBase& bus, size_t startIndex, size_t endIndex) const;
+  virtual const StreamingProtocol* streaming() const { return this; }
+
+  // From StreamingProtocol
+  virtual void begin(StreamingState& state) const;
+  virtual StreamingResult feed(StreamingState& state, const uint8_t* data, size_t length, size_t maxLength) const;
 };
\ No newline at end of file
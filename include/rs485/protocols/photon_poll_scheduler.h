@@ -0,0 +1,112 @@
+#pragma once
+
+#include "rs485/protocols/photon_transactions.h"
+
+// How many devices one scheduler can poll
+#ifndef RS485_POLLED_DEVICES
+#define RS485_POLLED_DEVICES 128
+#endif
+
+// The largest payload a poll can have
+#ifndef RS485_POLL_PAYLOAD_SIZE
+#define RS485_POLL_PAYLOAD_SIZE 16
+#endif
+
+class PollHandler {
+public:
+  virtual ~PollHandler() {}
+
+  // Fill in the payload of the next poll to address, and return how long it is. There's room for RS485_POLL_PAYLOAD_SIZE bytes.
+  virtual uint8_t buildPoll(uint8_t address, uint8_t* payload) = 0;
+
+  // The response is only valid during the call, and is empty unless the result is RESPONDED.
+  virtual void pollComplete(uint8_t address, TransactionResult result, const BufferSegments& response) = 0;
+};
+
+struct PolledDevice {
+  uint8_t address;
+  uint8_t priority;                     // Higher goes first when several devices are due
+  TimeMicroseconds_t period;            // How often this device wants to be polled
+  TimeMicroseconds_t lastPollTime;      // When its last poll was sent
+  TimeMicroseconds_t responseTime;      // Smoothed time from the end of our write to its response
+  TimeMicroseconds_t responseVariance;  // Smoothed mean deviation of that
+  bool responded;                       // Whether responseTime means anything yet
+  bool polledThisCycle;
+};
+
+struct PollStatistics {
+  uint32_t polls;
+  uint32_t responses;
+  uint32_t timeouts;
+  uint32_t writeFailures;
+  TimeMicroseconds_t busyTime;       // Time from sending each poll until it completed
+  TimeMicroseconds_t elapsedTime;    // Time since the statistics were reset
+  TimeMicroseconds_t lastCycleTime;  // How long it took to poll every device once, last time around
+};
+
+/**
+ * Polls a set of Photon devices from the bus master, each at its own period, keeping the bus as busy as it can be.
+ *
+ * Only one poll is ever in flight: the packetizer's write queue never holds more than one of ours, and the next poll isn't
+ * built until the last one has been answered, timed out, or failed to write. It's queued right then, from inside of that
+ * completion, so the only gap between polls is the packetizer's bus quiet time. Devices that are due go in priority order,
+ * with the most overdue first among equals.
+ *
+ * Each device's timeout follows how quickly it's actually been responding: the smoothed response time plus 4 times its mean
+ * deviation, kept between the minimum and maximum timeouts. Until a device has responded once, it gets the maximum. That way a
+ * missing feeder costs a little more than a fast feeder's response time instead of the worst case every time.
+ *
+ * Call poll here instead of on the transactions or packetizer.
+ */
+class PhotonPollScheduler: public PhotonTransactionHandler {
+public:
+  PhotonPollScheduler(PhotonTransactions& transactions, PollHandler& handler);
+
+  // Returns false if the device is already added or there's no room for it.
+  bool addDevice(uint8_t address, TimeMicroseconds_t period, uint8_t priority = 0);
+  bool removeDevice(uint8_t address);
+  size_t deviceCount() const;
+  const PolledDevice* getDevice(uint8_t address) const;
+
+  void setMinimumTimeout(TimeMicroseconds_t timeout);
+  void setMaximumTimeout(TimeMicroseconds_t timeout);
+  TimeMicroseconds_t getTimeout(uint8_t address) const;
+
+  void poll(size_t workBudget = -1);
+
+  PollStatistics getStatistics() const;
+  // Percent of the elapsed time that the bus was busy with one of our polls
+  uint8_t getUtilization() const;
+  void resetStatistics();
+
+  // From PhotonTransactionHandler
+  virtual void transactionComplete(const PhotonTransaction& transaction, TransactionResult result,
+    PacketWriteResult writeResult, const BufferSegments& response);
+
+private:
+  static const size_t DEVICES = RS485_POLLED_DEVICES;
+
+  PolledDevice* findDevice(uint8_t address);
+  TimeMicroseconds_t timeoutFor(const PolledDevice& device) const;
+  void sendNextPoll();
+  void finishCycleIfDone();
+
+  PhotonTransactions& transactions;
+  PollHandler& handler;
+
+  PolledDevice devices[DEVICES];
+  size_t devicesUsed = 0;
+  size_t devicesPolledThisCycle = 0;
+  TimeMicroseconds_t cycleStartTime = 0;
+
+  TimeMicroseconds_t minimumTimeout = 1000;
+  TimeMicroseconds_t maximumTimeout = 50000;
+
+  bool pollInFlight = false;
+  TimeMicroseconds_t pollSentTime = 0;
+  uint8_t pollBuffer[5 + RS485_POLL_PAYLOAD_SIZE];
+
+  PollStatistics statistics;
+  bool statisticsStarted = false;  // Starts on the first poll
+  TimeMicroseconds_t statisticsStartTime = 0;
+};
@@ -0,0 +1,102 @@
+#pragma once
+
+#include "rs485/packetizer.h"
+
+// How many Photon requests can be waiting on a response at once. This has to be a power of 2 no bigger than 256.
+#ifndef RS485_PHOTON_TRANSACTIONS
+#define RS485_PHOTON_TRANSACTIONS 8
+#endif
+
+enum class TransactionResult: uint8_t {
+  RESPONDED,     // The response is in the packet handed to transactionComplete
+  WRITE_FAILED,  // The request never made it out. writeResult says why.
+  TIMED_OUT      // The request went out, but nothing came back in time
+};
+
+enum class TransactionState: uint8_t {
+  FREE,
+  WRITING,  // Queued on the packetizer
+  WAITING   // Written, waiting on the response
+};
+
+class PhotonTransactionHandler;
+
+struct PhotonTransaction {
+  uint8_t toAddress;
+  uint8_t packetId;
+  const uint8_t* packet;  // The whole request, header and all
+  size_t packetLength;
+  PhotonTransactionHandler* handler;
+  TimeMicroseconds_t timeout;
+  TimeMicroseconds_t sentTime;  // When the write finished and the timeout started
+  TransactionState state;
+};
+
+class PhotonTransactionHandler {
+public:
+  virtual ~PhotonTransactionHandler() {}
+
+  /**
+   * Called once per request. The response is only valid during the call, and both of its lengths are 0 unless the result is
+   * RESPONDED. The request's buffer can be reused from here.
+   */
+  virtual void transactionComplete(const PhotonTransaction& transaction, TransactionResult result,
+    PacketWriteResult writeResult, const BufferSegments& response) = 0;
+};
+
+/**
+ * Matches Photon responses up with the requests that caused them, so several requests to different feeders can be out on the
+ * bus at the same time instead of one after the other.
+ *
+ * Every request gets a packet ID that isn't being used by any other outstanding request. A packet is a response if it's sent to
+ * our address, from the address the request went to, with the same packet ID. Packet IDs are handed out so that the ID modulo
+ * RS485_PHOTON_TRANSACTIONS is where the request is kept, so finding the request for a response doesn't depend on how many
+ * are outstanding.
+ *
+ * This takes over the packetizer's packet handler and writes through enqueuePacket, so call poll here instead of on the
+ * packetizer. Packets that don't answer any request go to the unmatched packet handler if there is one.
+ */
+class PhotonTransactions: public PacketHandler, public WriteHandler {
+public:
+  PhotonTransactions(Packetizer& packetizer, uint8_t address);
+  virtual ~PhotonTransactions();
+
+  /**
+   * Send a request to toAddress and call handler once it's answered, fails, or times out. packet must have room for the 5 byte
+   * header followed by payloadLength bytes of payload. The header is filled in here. The buffer has to stay around until the
+   * handler is called. The timeout starts once the request is written. Returns false, without touching packet, if there's no
+   * room for another request here or in the packetizer's write queue.
+   */
+  bool request(uint8_t toAddress, uint8_t* packet, uint8_t payloadLength, TimeMicroseconds_t timeout,
+    PhotonTransactionHandler& handler);
+
+  // Poll the packetizer, then time out anything that's waited too long.
+  void poll(size_t workBudget = -1);
+
+  // How many requests haven't completed yet, overall or to one address.
+  size_t outstanding() const;
+  size_t outstandingTo(uint8_t toAddress) const;
+
+  void setUnmatchedPacketHandler(PacketHandler& handler);
+  void removeUnmatchedPacketHandler();
+
+  // From PacketHandler
+  virtual void handlePacket(const RS485BusBase& bus, const BufferSegments& packet);
+  // From WriteHandler
+  virtual void writeComplete(const uint8_t* buffer, size_t bufferSize, PacketWriteResult result);
+
+private:
+  static const size_t TRANSACTIONS = RS485_PHOTON_TRANSACTIONS;
+  static_assert((TRANSACTIONS & (TRANSACTIONS - 1)) == 0 && TRANSACTIONS <= 256,
+    "RS485_PHOTON_TRANSACTIONS has to be a power of 2 no bigger than 256");
+
+  void complete(PhotonTransaction& transaction, TransactionResult result, PacketWriteResult writeResult,
+    const BufferSegments& response);
+
+  Packetizer& packetizer;
+  uint8_t address;
+  PacketHandler* unmatchedPacketHandler = nullptr;
+
+  PhotonTransaction transactions[TRANSACTIONS];
+  uint8_t nextPacketIds[TRANSACTIONS];  // The next ID each slot will hand out
+};
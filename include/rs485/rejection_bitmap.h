@@ -0,0 +1,34 @@
+#pragma once
+
+#include <inttypes.h>
+#include <stddef.h>
+
+/**
+ * One bit per offset on the bus, set once the packetizer knows that offset can never start a packet. The words are owned by
+ * whoever constructs this, so the same class can sit on top of a fixed size member array or on top of caller supplied
+ * storage. Bits past the end of the storage always read as not set and setting them does nothing.
+ */
+class RejectionBitmap {
+public:
+  static constexpr size_t BITS_PER_WORD = 32;
+
+  // How many words are needed to hold this many bits.
+  static constexpr size_t wordsFor(size_t bitCount) {
+    return (bitCount + BITS_PER_WORD - 1) / BITS_PER_WORD;
+  }
+
+  RejectionBitmap(uint32_t* words, size_t bitCount);
+
+  size_t size() const;
+  bool isSet(size_t bit) const;
+  void set(size_t bit);
+  void clear();
+
+  // Drop the first count bits, moving everything after them down. This is what happens to the bus when count bytes are discarded.
+  void shiftDown(size_t count);
+
+private:
+  uint32_t* words;
+  size_t bitCount;
+  size_t wordCount;
+};
\ No newline at end of file
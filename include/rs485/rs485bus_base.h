@@ -3,6 +3,7 @@
 #include "Arduino.h"
 #include "util.h"
 #include "bus_io.h"
+#include "arrival_times.h"
 
 
 /*
@@ -26,6 +27,21 @@ enum class WriteResult {
   NO_WRITE_BUFFER_FULL      // Exactly the same as READ_BUFFER_FULL, but we could tell the buffer was full before we decided to write a byte.
 };
 
+/**
+ * A read only view of a range of bytes inside the bus' internal buffer. The buffer is a ring, so a range that wraps around
+ * its end comes back as two segments: first, and then second picking up at the start of the buffer. If the range doesn't
+ * wrap, second is nullptr and secondLength is 0. If the range isn't available at all, both lengths are 0. Buses backed by
+ * mirrored memory (see MirroredRS485Bus) never need to wrap, so their ranges are always a single segment.
+ *
+ * The pointers are only valid until the next call that changes the bus' buffer, such as fetch or read.
+ */
+struct BufferSegments {
+  const uint8_t* first;
+  size_t firstLength;
+  const uint8_t* second;
+  size_t secondLength;
+};
+
 /**
  * Direct access to the RS485 Bus. More than likely, consumers will create an instance of the RS485Bus instead of using this
  * partial class. Most consumers will also generallyl just use that to instatiate the Packetizer instead of using the bus
@@ -39,12 +55,36 @@ enum class WriteResult {
  */
 class RS485BusBase {
 public:
-  explicit RS485BusBase(BusIO& buffer, uint8_t readEnablePin, uint8_t writeEnablePin);
+  /*
+  buffer is the ring buffer itself, bufferSize bytes long, and has to outlive the bus. It's normally owned by the implementing
+  class. Set mirrored only if buffer[bufferSize + i] is the same memory as buffer[i] (see MirroredRS485Bus).
+  */
+  RS485BusBase(BusIO& busIO, uint8_t readEnablePin, uint8_t writeEnablePin, uint8_t* buffer, size_t bufferSize, bool mirrored = false);
+  virtual ~RS485BusBase() {}
 
   virtual size_t bufferSize() const = 0;
 
   // Try to write a byte to the RS485 bus, verifying if it was written correctly
   VIRTUAL_FOR_UNIT_TEST WriteResult write(uint8_t value);
+  /*
+  Write several bytes, keeping up to windowSize of them in flight before reading back their echo. Every byte is still
+  verified, but we don't wait for a round trip on each one. bytesVerified is set to how many bytes from the start of the
+  buffer were read back correctly, which is also the offset of the first byte that wasn't. See the notes on WriteResult.
+  UNEXPECTED_EXTRA_BYTES only applies to bytes that show up before our first byte. After that, any byte that doesn't match
+  is a FAILED_READ_BACK.
+  */
+  VIRTUAL_FOR_UNIT_TEST WriteResult writeBytes(const uint8_t* buffer, size_t length, size_t windowSize, size_t& bytesVerified);
+
+  /*
+  The non-blocking halves of writeBytes, for callers that want to do something else while they wait for the echo. Enabling
+  write and making sure nothing new is coming in before the first byte is sent are up to the caller.
+  sendBytes queues bytes on the bus IO without waiting for anything.
+  readBack checks whatever has come back so far for the first bytesSent bytes of buffer and moves bytesVerified up to match.
+  It returns OK while everything matches, even if some bytes haven't come back yet. UNEXPECTED_EXTRA_BYTES means some
+  bytes that weren't ours came in before our first one, which is fine. Anything else means the write failed.
+  */
+  VIRTUAL_FOR_UNIT_TEST void sendBytes(const uint8_t* buffer, size_t length);
+  VIRTUAL_FOR_UNIT_TEST WriteResult readBack(const uint8_t* buffer, size_t bytesSent, size_t& bytesVerified);
 
   // How many bytes are available in our internal buffer. Note that this is not the same as how many bytes are available through the bus IO
   VIRTUAL_FOR_UNIT_TEST size_t available() const;
@@ -53,33 +93,55 @@ public:
   VIRTUAL_FOR_UNIT_TEST size_t fetch();
   // Reads one byte from our internal buffer and returns it. Returns -1 if no byte is available.
   int16_t read();
+  // Throw away up to count bytes from the front of our internal buffer in one step. Returns how many were discarded.
+  VIRTUAL_FOR_UNIT_TEST size_t discard(size_t count);
+  // Wait up to timeout for the bus IO to have bytes we can fetch. Returns false if we know none arrived, or right away if our buffer is full. See BusIO.
+  VIRTUAL_FOR_UNIT_TEST bool waitForBytes(TimeMicroseconds_t timeout);
+
+  /*
+  Keep track of when bytes arrive from here on, one chunk per fetch. Bytes already in the buffer don't get a time. See
+  ArrivalTimes. Without this (the default), the bus never calls micros.
+  */
+  void setArrivalTimes(ArrivalTimes& arrivalTimes);
+  void removeArrivalTimes();
+  // When the byte at index arrived. Returns false if we don't know, either because it's not there or it wasn't timed.
+  bool getArrivalTime(size_t index, TimeMicroseconds_t& time) const;
 
   // For filters and protocols, this is how to view data inside our internal buffer.
   VIRTUAL_FOR_UNIT_TEST int16_t operator[](size_t index) const;
+  // View startIndex to endIndex (inclusive) directly in our internal buffer without copying. See BufferSegments.
+  VIRTUAL_FOR_UNIT_TEST BufferSegments getSegments(size_t startIndex, size_t endIndex) const;
 
   // How long to wait between read attempts to read back our written byte.
   void setReadBackDelay(TimeMicroseconds_t delayTime);
   // How many times will we try to read back our byte before giving up.
   void setReadBackRetries(size_t retryCount);
+  // How long write waits to read back a byte in total. This is the read back delay times the number of retries.
+  TimeMicroseconds_t getReadBackTimeout() const;
   // If we see new bytes right before we attempt to write a byte, how long do we wait before checking again.
   void setPreFetchDelay(TimeMicroseconds_t delayTime);
   // How many times do we recheck for new bytes before giving up and not writing our byte.
   void setPreFetchRetries(size_t retryCount);
   /*
   How long to wait after enabling the write pin, after writing, and after disabling the write pin.
-  The same value is used for all 3. Setting this value too low prevents writes from being read back.
+  The same value is used for all 3. Setting this value too low prevents writes from being read back. This isn't used at
+  all if the BusIO handles write enable itself.
   */
   void setSettleTime(TimeMicroseconds_t settleTime);
 
   VIRTUAL_FOR_UNIT_TEST void enableWrite(bool writeEnabled);
 
 protected:
-  virtual void setByte(size_t bufferIndex, uint8_t value) = 0;
-  virtual uint8_t getByte(size_t bufferIndex) const = 0;
-  size_t readBufferSize;
+  uint8_t* const readBuffer;
+  const size_t readBufferSize;
+  const bool mirrored;
 
 private:
   void putByteInBuffer(uint8_t value);
+  void discardArrivalTimes(size_t count);
+  WriteResult fetchBeforeWrite();
+  bool waitForReadBack();
+  WriteResult readBackChunk(const uint8_t* buffer, size_t bytesSent, size_t& bytesVerified, size_t& bytesRead);
 
   BusIO& busIO;
   uint8_t readEnablePin;
@@ -89,6 +151,8 @@ private:
   size_t tail = 0;
   bool full = false;
 
+  ArrivalTimes* arrivalTimes = nullptr;
+
   TimeMicroseconds_t readBackRetryTime = 10;
   size_t readBackRetryCount = 100;
   TimeMicroseconds_t preFetchDelayTime = 0;
@@ -0,0 +1,42 @@
+#pragma once
+
+#if defined(__linux__)
+
+#include "rs485/rs485bus_base.h"
+
+/**
+ * An RS485 bus whose buffer is mapped into memory twice, back to back. Byte N past the end of the buffer is the same memory
+ * as byte N at the start of it, so any range of bytes in the buffer is one contiguous block of memory. getSegments always
+ * returns a single segment here, which means a packet can be handed to a checksum or a consumer as one pointer without
+ * any wrap handling or copying.
+ *
+ * The mapping works in whole pages, so the buffer size is rounded up to a multiple of the page size (usually 4096 bytes).
+ * Check bufferSize for the actual size. If the mapping can't be made for whatever reason, this falls back to a regular
+ * heap buffer of that same rounded up size and isMirrored returns false. Everything still works, ranges just might wrap again.
+ *
+ * This is Linux only. For microcontrollers, stick with the fixed size RS485Bus.
+ */
+class MirroredRS485Bus: public RS485BusBase {
+public:
+  MirroredRS485Bus(BusIO& busIO, uint8_t readEnablePin, uint8_t writeEnablePin, size_t minimumBufferSize);
+  virtual ~MirroredRS485Bus();
+  MirroredRS485Bus(const MirroredRS485Bus&) = delete;
+  MirroredRS485Bus& operator=(const MirroredRS485Bus&) = delete;
+
+  size_t bufferSize() const;
+  bool isMirrored() const;
+
+private:
+  struct Mapping {
+    uint8_t* buffer;
+    size_t size;
+    bool mirrored;
+  };
+
+  MirroredRS485Bus(BusIO& busIO, uint8_t readEnablePin, uint8_t writeEnablePin, Mapping mapping);
+
+  static Mapping mapBuffer(size_t minimumBufferSize);
+  static bool mapMirroredBuffer(size_t size, Mapping& mapping);
+};
+
+#endif
\ No newline at end of file
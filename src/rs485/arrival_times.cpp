@@ -0,0 +1,89 @@
+#include "rs485/arrival_times.h"
+
+ArrivalTimes::ArrivalTimes(ArrivalChunk* chunks, size_t chunkCount):
+storage(chunks), capacity(chunkCount) {}
+
+ArrivalChunk& ArrivalTimes::chunkAt(size_t chunk) const {
+  return storage[(head + chunk) % capacity];
+}
+
+void ArrivalTimes::clear() {
+  head = 0;
+  count = 0;
+  bytes = 0;
+}
+
+void ArrivalTimes::record(size_t length, TimeMicroseconds_t time) {
+  if(length == 0 || capacity == 0) {
+    return;
+  }
+
+  bytes += length;
+
+  if(count > 0 && chunkAt(count - 1).time == time) {
+    chunkAt(count - 1).length += length;  // Same fetch as far as anyone can tell
+    return;
+  }
+
+  if(count == capacity) {
+    if(capacity == 1) {
+      storage[head].length += length;  // Nothing to merge with, so these just look as old as everything else
+      return;
+    }
+
+    // Fold the oldest chunk in to the one after it
+    size_t oldestLength = chunkAt(0).length;
+    TimeMicroseconds_t oldestTime = chunkAt(0).time;
+    head = (head + 1) % capacity;
+    count--;
+    chunkAt(0).length += oldestLength;
+    chunkAt(0).time = oldestTime;
+  }
+
+  chunkAt(count++) = {time, length};
+}
+
+void ArrivalTimes::discard(size_t byteCount) {
+  if(byteCount >= bytes) {
+    clear();
+    return;
+  }
+
+  bytes -= byteCount;
+  while(byteCount > 0) {
+    ArrivalChunk& oldest = chunkAt(0);
+    if(byteCount < oldest.length) {
+      oldest.length -= byteCount;
+      return;
+    }
+
+    byteCount -= oldest.length;
+    head = (head + 1) % capacity;
+    count--;
+  }
+}
+
+bool ArrivalTimes::getTime(size_t index, TimeMicroseconds_t& time) const {
+  if(index >= bytes) {
+    return false;
+  }
+
+  for(size_t i = 0; i < count; i++) {
+    const ArrivalChunk& chunk = chunkAt(i);
+    if(index < chunk.length) {
+      time = chunk.time;
+      return true;
+    }
+    index -= chunk.length;
+  }
+
+  return false;
+}
+
+size_t ArrivalTimes::size() const {
+  return bytes;
+}
+
+size_t ArrivalTimes::chunks() const {
+  return count;
+}
@@ -10,4 +10,20 @@ int16_t HardwareSerialBusIO::read() {
 
 void HardwareSerialBusIO::write(uint8_t value) {
   serial->write(value);
+}
+
+size_t HardwareSerialBusIO::readBytes(uint8_t* buffer, size_t length) {
+  // Stream::readBytes waits for the serial timeout if it runs out of bytes, so never ask for more than are available.
+  size_t serialAvailable = serial->available();
+  if(length > serialAvailable) {
+    length = serialAvailable;
+  }
+  if(length == 0) {
+    return 0;
+  }
+  return serial->readBytes(buffer, length);
+}
+
+void HardwareSerialBusIO::writeBytes(const uint8_t* buffer, size_t length) {
+  serial->write(buffer, length);
 }
\ No newline at end of file
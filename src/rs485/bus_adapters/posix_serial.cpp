@@ -0,0 +1,165 @@
+#include "rs485/bus_adapters/posix_serial.h"
+
+#if defined(__linux__)
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/serial.h>
+
+PosixSerialBusIO::PosixSerialBusIO(int fd): fd(fd) {
+  int flags = fcntl(fd, F_GETFL);
+  if(flags >= 0) {
+    fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+  }
+}
+
+bool PosixSerialBusIO::configure(speed_t baudRate) {
+  struct termios options;
+  if(tcgetattr(fd, &options) != 0) {
+    return false;
+  }
+
+  cfmakeraw(&options);
+  options.c_cflag |= (CLOCAL | CREAD);
+  options.c_cflag &= ~(CSTOPB | CRTSCTS);
+  options.c_cc[VMIN] = 0;
+  options.c_cc[VTIME] = 0;
+
+  if(cfsetispeed(&options, baudRate) != 0 || cfsetospeed(&options, baudRate) != 0) {
+    return false;
+  }
+
+  return tcsetattr(fd, TCSANOW, &options) == 0;
+}
+
+bool PosixSerialBusIO::enableKernelDirectionControl(bool rtsHighWhileSending) {
+#ifdef TIOCSRS485
+  // Start from whatever the driver has now, so its RTS delays and any other flags are left alone
+  struct serial_rs485 rs485;
+  memset(&rs485, 0, sizeof(rs485));
+  if(ioctl(fd, TIOCGRS485, &rs485) != 0) {
+    kernelDirectionControl = false;
+    return false;
+  }
+
+  rs485.flags |= SER_RS485_ENABLED | SER_RS485_RX_DURING_TX;  // We still need to read back what we write
+  rs485.flags &= ~(SER_RS485_RTS_ON_SEND | SER_RS485_RTS_AFTER_SEND);
+  if(rtsHighWhileSending) {
+    rs485.flags |= SER_RS485_RTS_ON_SEND;
+  } else {
+    rs485.flags |= SER_RS485_RTS_AFTER_SEND;
+  }
+
+  kernelDirectionControl = ioctl(fd, TIOCSRS485, &rs485) == 0;
+#else
+  kernelDirectionControl = false;
+#endif
+  return kernelDirectionControl;
+}
+
+size_t PosixSerialBusIO::available() {
+  int bytesAvailable = 0;
+  if(ioctl(fd, FIONREAD, &bytesAvailable) != 0 || bytesAvailable < 0) {
+    return 0;
+  }
+  return bytesAvailable;
+}
+
+int16_t PosixSerialBusIO::read() {
+  uint8_t value;
+  if(readBytes(&value, 1) != 1) {
+    return -1;
+  }
+  return value;
+}
+
+void PosixSerialBusIO::write(uint8_t value) {
+  writeBytes(&value, 1);
+}
+
+size_t PosixSerialBusIO::readBytes(uint8_t* buffer, size_t length) {
+  while(true) {
+    ssize_t result = ::read(fd, buffer, length);
+    if(result >= 0) {
+      return result;
+    }
+    if(errno != EINTR) {
+      return 0;  // EAGAIN just means nothing was there. Anything else we can't do anything about.
+    }
+  }
+}
+
+void PosixSerialBusIO::writeBytes(const uint8_t* buffer, size_t length) {
+  size_t written = 0;
+  while(written < length) {
+    ssize_t result = ::write(fd, &buffer[written], length - written);
+    if(result > 0) {
+      written += result;
+      continue;
+    }
+
+    if(result < 0 && errno == EINTR) {
+      continue;
+    } else if(result < 0 && errno == EAGAIN) {
+      // The kernel's transmit buffer is full. Wait for room instead of dropping bytes, but not forever on a wedged tty.
+      struct pollfd pollFd = {fd, POLLOUT, 0};
+      int pollResult = poll(&pollFd, 1, writeTimeoutMilliseconds);
+      if(pollResult > 0 || (pollResult < 0 && errno == EINTR)) {
+        continue;
+      }
+      return;  // Timed out. Same as below, read back will catch it.
+    }
+
+    return;  // The device went away or something similar. BusIO has no way to report it, but read back will fail.
+  }
+}
+
+void PosixSerialBusIO::setWriteTimeout(TimeMicroseconds_t timeout) {
+  // poll only goes down to milliseconds. Round up so a short timeout doesn't become no wait at all.
+  TimeMicroseconds_t milliseconds = (timeout + 999) / 1000;
+  writeTimeoutMilliseconds = (milliseconds > INT_MAX) ? INT_MAX : (int) milliseconds;
+}
+
+bool PosixSerialBusIO::handlesWriteEnable() {
+  return kernelDirectionControl;
+}
+
+bool PosixSerialBusIO::waitForBytes(TimeMicroseconds_t timeout) {
+  struct pollfd pollFd = {fd, POLLIN, 0};
+  struct timespec timeoutSpec;
+  struct timespec* timeoutPointer = nullptr;  // Wait forever
+  struct timespec start;
+
+  if(timeout != (TimeMicroseconds_t) -1) {
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    timeoutPointer = &timeoutSpec;
+  }
+
+  int result;
+  while(true) {
+    if(timeoutPointer != nullptr) {
+      // A signal can cut the wait short, so only wait out what's left of the timeout rather than starting it over
+      struct timespec now;
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      uint64_t elapsed = (uint64_t) (now.tv_sec - start.tv_sec) * 1000000 + (now.tv_nsec - start.tv_nsec) / 1000;
+      uint64_t remaining = elapsed < timeout ? timeout - elapsed : 0;
+      timeoutSpec.tv_sec = remaining / 1000000;
+      timeoutSpec.tv_nsec = (remaining % 1000000) * 1000;
+    }
+
+    result = ppoll(&pollFd, 1, timeoutPointer, nullptr);
+    if(result >= 0 || errno != EINTR) {
+      break;
+    }
+  }
+
+  return result > 0;
+}
+
+#endif
\ No newline at end of file
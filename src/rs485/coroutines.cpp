@@ -0,0 +1,190 @@
+#include "rs485/coroutines.h"
+
+#if defined(__cpp_impl_coroutine)
+
+NextPacketAwaiter::NextPacketAwaiter(PacketScheduler& scheduler, const Filter* filter, TimeMicroseconds_t timeout):
+ScheduledAwaiter(scheduler) {
+  this->waitForPacket = true;
+  this->filter = filter;
+  this->timeout = timeout;
+}
+
+void NextPacketAwaiter::await_suspend(std::coroutine_handle<> handle) {
+  this->handle = handle;
+  scheduler.startWaiting(this);
+}
+
+WritePacketAwaiter::WritePacketAwaiter(PacketScheduler& scheduler, const uint8_t* buffer, size_t bufferSize):
+ScheduledAwaiter(scheduler) {
+  this->buffer = buffer;
+  this->bufferSize = bufferSize;
+}
+
+void WritePacketAwaiter::await_suspend(std::coroutine_handle<> handle) {
+  this->handle = handle;
+  scheduler.writeQueue.append(this);
+}
+
+RequestAwaiter::RequestAwaiter(PacketScheduler& scheduler, const uint8_t* buffer, size_t bufferSize, const Filter* filter,
+  TimeMicroseconds_t timeout): ScheduledAwaiter(scheduler) {
+  this->buffer = buffer;
+  this->bufferSize = bufferSize;
+  this->waitForPacket = true;
+  this->filter = filter;
+  this->timeout = timeout;
+}
+
+void RequestAwaiter::await_suspend(std::coroutine_handle<> handle) {
+  this->handle = handle;
+  scheduler.writeQueue.append(this);
+}
+
+PacketScheduler::PacketScheduler(Packetizer& packetizer, FrameAllocator* frameAllocator):
+packetizer(packetizer), frameAllocator(frameAllocator) {
+  packetizer.setPacketHandler(*this);
+}
+
+PacketScheduler::~PacketScheduler() {
+  packetizer.removePacketHandler();
+}
+
+NextPacketAwaiter PacketScheduler::nextPacket(const Filter* filter, TimeMicroseconds_t timeout) {
+  return NextPacketAwaiter(*this, filter, timeout);
+}
+
+WritePacketAwaiter PacketScheduler::writePacket(const uint8_t* buffer, size_t bufferSize) {
+  return WritePacketAwaiter(*this, buffer, bufferSize);
+}
+
+RequestAwaiter PacketScheduler::request(const uint8_t* buffer, size_t bufferSize, const Filter* filter,
+  TimeMicroseconds_t timeout) {
+  return RequestAwaiter(*this, buffer, bufferSize, filter, timeout);
+}
+
+void PacketScheduler::AwaiterList::append(ScheduledAwaiter* awaiter) {
+  awaiter->next = nullptr;
+
+  if(tail == nullptr) {
+    head = awaiter;
+  } else {
+    tail->next = awaiter;
+  }
+  tail = awaiter;
+}
+
+void PacketScheduler::AwaiterList::remove(ScheduledAwaiter* previous, ScheduledAwaiter* awaiter) {
+  if(previous == nullptr) {
+    head = awaiter->next;
+  } else {
+    previous->next = awaiter->next;
+  }
+
+  if(tail == awaiter) {
+    tail = previous;
+  }
+}
+
+void PacketScheduler::startWaiting(ScheduledAwaiter* awaiter) {
+  awaiter->waitStartTime = micros();
+  packetWaiters.append(awaiter);
+}
+
+void PacketScheduler::poll(size_t workBudget) {
+  enqueueWrites();
+  packetizer.poll(workBudget);
+  resumeWritten();
+  expireWaiting();
+}
+
+void PacketScheduler::handlePacket(const RS485BusBase& bus, const BufferSegments& packet) {
+  Packet location = packetizer.getPacket();
+
+  ScheduledAwaiter* previous = nullptr;
+  for(ScheduledAwaiter* awaiter = packetWaiters.head; awaiter != nullptr; awaiter = awaiter->next) {
+    if(awaiter->filter != nullptr && ! awaiter->filter->postFilter(bus, location.startIndex, location.endIndex)) {
+      previous = awaiter;
+      continue;
+    }
+
+    packetWaiters.remove(previous, awaiter);  // It's not waiting anymore, even if it starts waiting again when we resume it
+    awaiter->packet = packet;
+    awaiter->handle.resume();
+    return;  // Only one coroutine gets each packet
+  }
+}
+
+void PacketScheduler::enqueueWrites() {
+  while(writeQueue.head != nullptr) {
+    ScheduledAwaiter* awaiter = writeQueue.head;
+    if(! packetizer.enqueuePacket(awaiter->buffer, awaiter->bufferSize, this)) {
+      return;  // The packetizer's queue is full. The rest stay in order for the next poll.
+    }
+
+    writeQueue.remove(nullptr, awaiter);
+    writing.append(awaiter);
+  }
+}
+
+void PacketScheduler::writeComplete(const uint8_t* buffer, size_t bufferSize, PacketWriteResult result) {
+  // The packetizer finishes writes in the order they were queued, so this is normally the head
+  ScheduledAwaiter* previous = nullptr;
+  ScheduledAwaiter* awaiter = writing.head;
+  while(awaiter != nullptr && (awaiter->buffer != buffer || awaiter->bufferSize != bufferSize)) {
+    previous = awaiter;
+    awaiter = awaiter->next;
+  }
+
+  if(awaiter == nullptr) {
+    return;  // Not one of ours
+  }
+
+  writing.remove(previous, awaiter);
+  awaiter->writeResult = result;
+
+  if(awaiter->waitForPacket && result == PacketWriteResult::OK) {
+    startWaiting(awaiter);  // Now we wait for the response
+  } else {
+    written.append(awaiter);  // We're still inside the packetizer's poll, so it gets resumed after
+  }
+}
+
+void PacketScheduler::resumeWritten() {
+  // Anything these coroutines write next waits for the next poll, so one busy coroutine can't starve the rest
+  ScheduledAwaiter* queue = written.head;
+  written = AwaiterList();
+
+  while(queue != nullptr) {
+    ScheduledAwaiter* awaiter = queue;
+    queue = queue->next;
+    awaiter->handle.resume();
+  }
+}
+
+void PacketScheduler::expireWaiting() {
+  TimeMicroseconds_t currentTime = micros();
+
+  // Pull everyone who's out of time off the list before resuming them, since they might start waiting again
+  AwaiterList expired;
+  ScheduledAwaiter* previous = nullptr;
+  ScheduledAwaiter* awaiter = packetWaiters.head;
+  while(awaiter != nullptr) {
+    ScheduledAwaiter* next = awaiter->next;
+    if(currentTime - awaiter->waitStartTime > awaiter->timeout) {
+      packetWaiters.remove(previous, awaiter);
+      expired.append(awaiter);
+    } else {
+      previous = awaiter;
+    }
+    awaiter = next;
+  }
+
+  while(expired.head != nullptr) {
+    awaiter = expired.head;
+    expired.head = awaiter->next;
+
+    awaiter->packet = {nullptr, 0, nullptr, 0};
+    awaiter->handle.resume();
+  }
+}
+
+#endif
@@ -1,39 +1,169 @@
 #include "rs485/packetizer.h"
 
+#include <string.h>
+
 Packetizer::Packetizer(RS485BusBase& bus, const Protocol& protocol):
-bus(&bus),  protocol(&protocol) {}
+bus(&bus),  protocol(&protocol), rejectedBitmap(defaultRejectionStorage, 64) {
+  rejectedBitmap.clear();
+  memset(pendingCandidates, 0, sizeof(pendingCandidates));
+}
+
+Packetizer::Packetizer(RS485BusBase& bus, const Protocol& protocol, uint32_t* rejectionStorage, size_t rejectionBits):
+bus(&bus),  protocol(&protocol), rejectedBitmap(rejectionStorage, rejectionBits) {
+  rejectedBitmap.clear();
+  memset(pendingCandidates, 0, sizeof(pendingCandidates));
+}
 
 void Packetizer::setFilter(const Filter& filter) {
   this->filter = &filter;
   this->filterLookAhead = filter.lookAheadBytes();
   this->lastBusAvailable = 0;
+  this->knownPacketEndIndex = 0;  // The new filter may not like it
 }
 
 void Packetizer::removeFilter() {
   this->filter = nullptr;
   this->filterLookAhead = 0;
   this->lastBusAvailable = 0;
+  this->knownPacketEndIndex = 0;  // Keep the same behavior as setFilter
 }
 
-void Packetizer::eatOneByte() {
-  bus->read();
-  lastBusAvailable--;  // read removes one byte from the bus
-  startIndex--;  // Reset us so we'll be reading the first byte again next time
-  if(endIndex > 0) {
-    endIndex--;  // Check for > 0 to handle both with and without packet cases.
+void Packetizer::eatBytes(size_t count) {
+  bus->discard(count);
+  lastBusAvailable -= count;  // discard removes count bytes from the bus
+  startIndex -= count;  // Shift us back so we'll be reading the same byte again next time
+  scanResumeIndex = (scanResumeIndex > count) ? (scanResumeIndex - count) : 0;
+  endIndex = (endIndex > count) ? (endIndex - count) : 0;  // Handles both with and without packet cases
+  rejectedBitmap.shiftDown(count);
+
+  size_t framesKept = 0;
+  for(size_t i = 0; i < frameStartCount; i++) {
+    if(frameStarts[i] > count) {  // A frame starting right at count is now the first one, which is implied
+      frameStarts[framesKept++] = frameStarts[i] - count;
+    }
+  }
+  frameStartCount = framesKept;
+
+  if(knownPacketEndIndex > 0) {
+    if(count <= knownPacketStartIndex) {
+      knownPacketStartIndex -= count;
+      knownPacketEndIndex -= count;
+    } else {
+      knownPacketEndIndex = 0;  // Some or all of the packet is gone
+    }
+  }
+
+  for(size_t i = 0; i < PENDING_CANDIDATES; i++) {
+    PendingCandidate& candidate = pendingCandidates[i];
+    if(! candidate.inUse) {
+      continue;
+    }
+
+    if(candidate.startIndex < count) {
+      candidate.inUse = false;  // Its first byte is gone
+    } else {
+      candidate.startIndex -= count;
+      candidate.readyAt -= count;
+    }
   }
-  recheckBitmap >>= 1;
+}
+
+void Packetizer::eatRejectedPrefix() {
+  // The first byte is going away. Any bytes right after it that we already know are rejected can go with it.
+  size_t count = 1;
+  while(count < lastBusAvailable && rejectedBitmap.isSet(count)) {
+    count++;
+  }
+
+  eatBytes(count);
+  startIndex = -1;  // The loop increments after this, so we start back at what's now the first byte
 }
 
 void Packetizer::rejectByte(size_t location) {
   // Remove any "no" byte at the start
   if(startIndex == 0) {
-    eatOneByte();
+    eatRejectedPrefix();
   } else {
-    if(location < (sizeof(recheckBitmap) * 8)) {
-      recheckBitmap |= (1L << location);
+    rejectedBitmap.set(location);
+  }
+}
+
+PendingCandidate* Packetizer::findPendingCandidate(size_t location) {
+  for(size_t i = 0; i < PENDING_CANDIDATES; i++) {
+    PendingCandidate& candidate = pendingCandidates[i];
+    if(candidate.inUse && candidate.startIndex == location) {
+      return &candidate;
+    }
+  }
+
+  return nullptr;
+}
+
+PendingCandidate* Packetizer::newPendingCandidate(size_t location) {
+  for(size_t i = 0; i < PENDING_CANDIDATES; i++) {
+    PendingCandidate& candidate = pendingCandidates[i];
+    if(! candidate.inUse) {
+      candidate.inUse = true;
+      candidate.startIndex = location;
+      candidate.readyAt = 0;
+      return &candidate;
+    }
+  }
+
+  return nullptr;  // We're already keeping track of as many as we can
+}
+
+IsPacketResult Packetizer::isPacket(size_t location) {
+  PendingCandidate* candidate = findPendingCandidate(location);
+
+  if(candidate != nullptr && lastBusAvailable < candidate->readyAt) {
+    return {PacketStatus::NOT_ENOUGH_BYTES, 0, 0};  // The protocol already told us it needs more than this
+  }
+
+  const StreamingProtocol* streaming = protocol->streaming();
+
+  if(streaming != nullptr && candidate == nullptr) {
+    candidate = newPendingCandidate(location);
+    if(candidate != nullptr) {
+      streaming->begin(candidate->state);
     }
   }
+
+  if(streaming != nullptr && candidate != nullptr) {
+    // Only hand over the bytes this candidate hasn't seen yet
+    StreamingResult result = {PacketStatus::NOT_ENOUGH_BYTES, 0, 0};
+    size_t nextIndex = location + candidate->state.consumed;
+    if(nextIndex < lastBusAvailable) {
+      BufferSegments segments = bus->getSegments(nextIndex, lastBusAvailable - 1);
+      result = streaming->feed(candidate->state, segments.first, segments.firstLength, bus->bufferSize());
+      if(result.status == PacketStatus::NOT_ENOUGH_BYTES && segments.secondLength > 0) {
+        result = streaming->feed(candidate->state, segments.second, segments.secondLength, bus->bufferSize());
+      }
+    }
+
+    if(result.status == PacketStatus::NOT_ENOUGH_BYTES) {
+      candidate->readyAt = location + candidate->state.consumed + result.bytesNeeded;
+    } else {
+      candidate->inUse = false;  // We have our answer, so there's nothing left to keep track of
+    }
+
+    return {result.status, result.packetLength, 0};
+  }
+
+  IsPacketResult result = protocol->isPacket(*bus, location, lastBusAvailable - 1);
+
+  if(result.status == PacketStatus::NOT_ENOUGH_BYTES && result.bytesNeeded > 0) {
+    if(candidate == nullptr) {
+      candidate = newPendingCandidate(location);
+    }
+    if(candidate != nullptr) {
+      candidate->readyAt = location + result.bytesNeeded;
+    }
+  } else if(candidate != nullptr) {
+    candidate->inUse = false;
+  }
+
+  return result;
 }
 
 bool Packetizer::hasPacket() {
@@ -58,7 +188,21 @@ bool Packetizer::hasPacket() {
     }
 
     if (lastBusAvailable == currentBusAvailable) {
+      TimeMicroseconds_t waitTime = maxReadTimeout - timeSinceFunctionStart;
+
       if(! hasPacket) {
+        if(frameGap > 0 && lastBusAvailable > 0) {
+          // The last frame is over once the bus stays quiet long enough, new bytes or not
+          TimeMicroseconds_t timeSinceLastByte = currentTime - lastByteReadTimestamp;
+          if(timeSinceLastByte <= frameGap && frameGap - timeSinceLastByte < waitTime) {
+            waitTime = frameGap - timeSinceLastByte + 1;
+          }
+          bus->waitForBytes(waitTime);
+          hasPacket = hasPacketNow();
+          continue;
+        }
+
+        bus->waitForBytes(waitTime);
         continue;  // No new bytes, so continue the loop to try and fetch new bytes
       }
 
@@ -71,6 +215,11 @@ bool Packetizer::hasPacket() {
       if(timeSinceLastPacket > falsePacketVerificationTimeout) {
         return true;
       } else {
+        TimeMicroseconds_t verificationTimeLeft = falsePacketVerificationTimeout - timeSinceLastPacket;
+        if(verificationTimeLeft < waitTime) {
+          waitTime = verificationTimeLeft;
+        }
+        bus->waitForBytes(waitTime);
         continue;  // No new bytes to check but we don't want time out just yet
       }
     }
@@ -87,6 +236,11 @@ bool Packetizer::hasPacket() {
 }
 
 bool Packetizer::hasPacketNow() {
+  size_t workBudget = -1;
+  return scanForPacket(workBudget);
+}
+
+bool Packetizer::scanForPacket(size_t& workBudget) {
   size_t currentBusAvailable = bus->available();
 
   if(lastBusAvailable == currentBusAvailable && !shouldRecheck) {
@@ -96,20 +250,53 @@ bool Packetizer::hasPacketNow() {
     return false;  // Don't bother rechecking our bus, we have the same number of bytes to work with and aren't forcing a recheck
   }
 
+  if(currentBusAvailable != lastBusAvailable) {
+    scanResumeIndex = 0;  // An offset we already passed may be a packet now, so everything gets another look
+  }
   lastBusAvailable = currentBusAvailable;
 
   shouldRecheck = false;  // We assume we don't need to force recheck next time, even if we did this time.
   endIndex = 0;  // If we had a packet, we can find it again
 
-  for(startIndex = 0; startIndex < lastBusAvailable; startIndex++) {
-    bool shouldCallIsPacket = true;
-    
-    if(startIndex < (sizeof(recheckBitmap) * 8)) {
-      if((recheckBitmap & (1L << startIndex)) > 0 ) {
-        shouldCallIsPacket = false;
+  if(frameGap > 0) {
+    return scanForFrame(workBudget);
+  }
+
+  size_t firstIndex = scanResumeIndex;
+  scanResumeIndex = 0;  // Unless we run out of budget again, the next scan starts over from the beginning
+
+  for(startIndex = firstIndex; startIndex < lastBusAvailable; startIndex++) {
+    if(knownPacketEndIndex > 0 && startIndex == knownPacketStartIndex) {
+      endIndex = knownPacketEndIndex;  // Nothing before it turned in to a packet, so this is still our packet
+      return true;
+    }
+
+    bool shouldCallIsPacket = ! rejectedBitmap.isSet(startIndex);
+
+    if(shouldCallIsPacket) {
+      if(workBudget == 0) {
+        scanResumeIndex = startIndex;  // Everything before this has been looked at with these bytes already. Only good until more show up.
+        shouldRecheck = true;
+        startIndex = 0;
+        return false;
+      }
+      workBudget--;
+
+      size_t nextStart = protocol->nextPacketStart(*bus, startIndex, lastBusAvailable - 1);
+      if(nextStart > startIndex) {
+        if(startIndex == 0) {
+          eatBytes(nextStart);  // None of it can ever start a packet
+          startIndex = -1;  // The loop increments after this, so we start back at what's now the first byte
+        } else {
+          for(; startIndex < nextStart; startIndex++) {
+            rejectedBitmap.set(startIndex);
+          }
+          startIndex--;  // The loop increments after this, so nextStart is next
+        }
+        continue;
       }
     }
-    
+
     if(shouldCallIsPacket && this->filter != nullptr && this->filter->isEnabled()) {
       if(startIndex + this->filterLookAhead >= lastBusAvailable) {
         return false;  // We don't have enough bytes to call this filter and no further bytes will either
@@ -123,7 +310,7 @@ bool Packetizer::hasPacketNow() {
       continue;
     }
 
-    IsPacketResult result = protocol->isPacket(*bus, startIndex, lastBusAvailable - 1);
+    IsPacketResult result = isPacket(startIndex);
 
     if(result.status == PacketStatus::NO) {
       rejectByte(startIndex);
@@ -147,12 +334,15 @@ bool Packetizer::hasPacketNow() {
         continue;  // We may still have another valid packet, so continue checking.
       }
 
+      knownPacketStartIndex = startIndex;
+      knownPacketEndIndex = endIndex;
+
       return true;
     }
     else if(result.status == PacketStatus::NOT_ENOUGH_BYTES) {
       // Remove any "not enough bytes" byte at the start, only if the buffer is full
       if(startIndex == 0 && bus->isBufferFull()) {
-        eatOneByte();
+        eatRejectedPrefix();
       }
     }
   }
@@ -163,6 +353,65 @@ bool Packetizer::hasPacketNow() {
   return false;
 }
 
+bool Packetizer::scanForFrame(size_t& workBudget) {
+  startIndex = 0;
+
+  // Only the first frame is ever looked at. Whatever it is, it's either our packet or it goes away.
+  while(lastBusAvailable > 0) {
+    size_t frameEnd;
+    if(! findFrameEnd(0, frameEnd) || workBudget == 0) {
+      shouldRecheck = true;  // Time alone can finish a frame, so don't wait on new bytes to look again
+      return false;
+    }
+    workBudget--;
+
+    size_t packetEnd;
+    if(isFramePacket(0, frameEnd, packetEnd)) {
+      endIndex = packetEnd;
+      return true;
+    }
+
+    eatBytes(frameEnd + 1);
+    startIndex = 0;
+  }
+
+  return false;
+}
+
+bool Packetizer::findFrameEnd(size_t frame, size_t& frameEnd) const {
+  if(frame < frameStartCount) {
+    frameEnd = frameStarts[frame] - 1;  // The next frame has already started
+    return true;
+  } else if(frame > frameStartCount) {
+    return false;  // There's no such frame
+  }
+
+  if(micros() - lastByteReadTimestamp <= frameGap) {
+    return false;  // Still coming in
+  }
+
+  frameEnd = lastBusAvailable - 1;
+  return true;
+}
+
+bool Packetizer::isFramePacket(size_t frameStart, size_t frameEnd, size_t& packetEnd) {
+  bool filtered = this->filter != nullptr && this->filter->isEnabled();
+
+  if(filtered && (frameStart + this->filterLookAhead > frameEnd || ! filter->preFilter(*bus, frameStart))) {
+    return false;
+  }
+
+  // The frame is all there is, so the protocol doesn't get to see past it
+  IsPacketResult result = protocol->isPacket(*bus, frameStart, frameEnd);
+  if(result.status != PacketStatus::YES || result.packetLength == 0 || result.packetLength > frameEnd - frameStart + 1) {
+    return false;
+  }
+
+  packetEnd = frameStart + result.packetLength - 1;
+
+  return ! filtered || filter->postFilter(*bus, frameStart, packetEnd);
+}
+
 Packet Packetizer::getPacket() {
   if(endIndex > 0) {
     return {
@@ -182,15 +431,263 @@ void Packetizer::clearPacket() {
     return;
   }
 
-  while(endIndex != 0) {
-    eatOneByte();
-  }
-  eatOneByte();  // endIndex will be 0 with one byte remaining to eat after the previous loop
+  eatBytes(endIndex + 1);  // Everything up to and including the end of our packet
 
   startIndex = 0;  // Force start index to zero since eating the bytes probably wrapped it around to a very large value.
   shouldRecheck = true;
 }
 
+PacketBatch Packetizer::findPackets(Packet* packets, size_t maxPackets) {
+  PacketBatch batch = {packets, 0};
+
+  if(maxPackets == 0 || ! hasPacketNow()) {
+    return batch;
+  }
+
+  packets[batch.count++] = getPacket();
+
+  if(frameGap > 0) {
+    // Every frame after the first that's over. Frames that aren't packets get thrown out along with everything before the last packet.
+    size_t frameEnd;
+    for(size_t frame = 1; batch.count < maxPackets && findFrameEnd(frame, frameEnd); frame++) {
+      size_t frameStart = frameStarts[frame - 1];
+      size_t packetEnd;
+      if(isFramePacket(frameStart, frameEnd, packetEnd)) {
+        packets[batch.count++] = {frameStart, packetEnd};
+      }
+    }
+
+    return batch;
+  }
+
+  size_t location = endIndex + 1;
+  while(batch.count < maxPackets && location < lastBusAvailable) {
+    if(rejectedBitmap.isSet(location)) {
+      location++;
+      continue;
+    }
+
+    size_t nextStart = protocol->nextPacketStart(*bus, location, lastBusAvailable - 1);
+    if(nextStart > location) {
+      for(; location < nextStart; location++) {
+        rejectedBitmap.set(location);
+      }
+      continue;
+    }
+
+    if(this->filter != nullptr && this->filter->isEnabled()) {
+      if(location + this->filterLookAhead >= lastBusAvailable) {
+        break;  // Same as hasPacketNow, we can't tell yet
+      }
+
+      if(! filter->preFilter(*bus, location)) {
+        rejectedBitmap.set(location);
+        location++;
+        continue;
+      }
+    }
+
+    IsPacketResult result = isPacket(location);
+
+    if(result.status == PacketStatus::NOT_ENOUGH_BYTES) {
+      break;  // Anything after this could be part of it
+    }
+
+    if(result.status == PacketStatus::NO) {
+      rejectedBitmap.set(location);
+      location++;
+      continue;
+    }
+
+    size_t packetEndIndex = location + result.packetLength - 1;
+
+    if(
+      this->filter != nullptr &&
+      this->filter->isEnabled() &&
+      ! this->filter->postFilter(*bus, location, packetEndIndex)
+    ) {
+      location = packetEndIndex + 1;  // It was a packet, just not one we want
+      continue;
+    }
+
+    packets[batch.count++] = {location, packetEndIndex};
+    location = packetEndIndex + 1;
+  }
+
+  return batch;
+}
+
+void Packetizer::clearPackets(const PacketBatch& batch) {
+  if(batch.empty()) {
+    return;
+  }
+
+  eatBytes(batch[batch.count - 1].endIndex + 1);  // The last packet and everything before it
+
+  startIndex = 0;  // Same as clearPacket
+  shouldRecheck = true;
+}
+
+size_t Packetizer::poll(size_t workBudget) {
+  size_t bytesFetched = 0;
+  if(writePhase != WritePhase::VERIFY) {  // While we're verifying, what the bus IO has is our own echo for advanceWrite to read
+    bytesFetched = fetchFromBus();
+  }
+
+  size_t packetsHandled = 0;
+  while(packetHandler != nullptr && scanForPacket(workBudget)) {
+    if(startIndex != 0 && falsePacketVerificationTimeout > 0) {
+      TimeMicroseconds_t timeSinceLastByte = micros() - lastByteReadTimestamp;
+      if(timeSinceLastByte <= falsePacketVerificationTimeout) {
+        break;  // An earlier candidate could still turn in to a packet, so we'll check again next time
+      }
+    }
+
+    packetHandler->handlePacket(*bus, bus->getSegments(startIndex, endIndex));
+    clearPacket();
+    packetsHandled++;
+  }
+
+  if(packetHandler == nullptr) {
+    scanForPacket(workBudget);
+  }
+
+  advanceWrite(bytesFetched > 0);
+
+  return packetsHandled;
+}
+
+bool Packetizer::enqueuePacket(const uint8_t* buffer, size_t bufferSize, WriteHandler* handler) {
+  if(writeQueueCount == WRITE_QUEUE_SIZE) {
+    return false;
+  }
+
+  writeQueue[(writeQueueHead + writeQueueCount) % WRITE_QUEUE_SIZE] = {buffer, bufferSize, handler};
+  writeQueueCount++;
+  return true;
+}
+
+size_t Packetizer::queuedPackets() const {
+  return writeQueueCount;
+}
+
+void Packetizer::advanceWrite(bool newBytesFetched) {
+  if(writeQueueCount == 0) {
+    return;
+  }
+
+  const QueuedWrite& current = writeQueue[writeQueueHead];
+  TimeMicroseconds_t currentTime = micros();
+
+  if(writePhase == WritePhase::BACKOFF) {
+    if(currentTime - writePhaseStartTime < writeBackoffTime) {
+      return;
+    }
+
+    writePhase = WritePhase::QUIET_WAIT;  // Same as a new packet, but keep counting attempts
+    writePhaseStartTime = currentTime;
+    writeFailureOffset = 0;
+  }
+
+  if(writePhase == WritePhase::IDLE) {
+    lastWriteAttempts = 0;
+    writePhase = WritePhase::QUIET_WAIT;
+    writePhaseStartTime = currentTime;
+    writeFailureOffset = 0;
+  }
+
+  if(writePhase == WritePhase::QUIET_WAIT) {
+    if(bus->isBufferFull()) {
+      finishWrite(PacketWriteResult::FAILED_BUFFER_FULL);  // Same as writePacket, nowhere to put bytes that aren't ours
+      return;
+    }
+
+    bool busIsQuiet = ! newBytesFetched && (currentTime - lastByteReadTimestamp) >= busQuietTime;
+    if(! busIsQuiet) {
+      if(currentTime - writePhaseStartTime >= maxWriteTimeout) {
+        finishWrite(PacketWriteResult::FAILED_TIMEOUT);
+      }
+      return;  // Check again next poll
+    }
+
+    bus->enableWrite(true);
+    writeBytesSent = 0;
+    writePhase = WritePhase::VERIFY;
+    writePhaseStartTime = currentTime;
+  } else {
+    size_t bytesVerifiedBefore = writeFailureOffset;
+    WriteResult result = bus->readBack(current.buffer, writeBytesSent, writeFailureOffset);
+    switch(result) {
+      case WriteResult::OK:
+      case WriteResult::UNEXPECTED_EXTRA_BYTES:  // Only ever before our first byte
+        break;
+      case WriteResult::READ_BUFFER_FULL:
+      case WriteResult::NO_WRITE_BUFFER_FULL:
+        finishWrite(PacketWriteResult::FAILED_BUFFER_FULL);
+        return;
+      default:
+        finishWrite(PacketWriteResult::FAILED_INTERRUPTED);
+        return;
+    }
+
+    if(writeFailureOffset > bytesVerifiedBefore) {
+      writePhaseStartTime = currentTime;
+    } else if(currentTime - writePhaseStartTime > bus->getReadBackTimeout()) {
+      finishWrite(PacketWriteResult::FAILED_INTERRUPTED);  // Same as a read back timeout in writePacket
+      return;
+    }
+  }
+
+  if(writeFailureOffset == current.bufferSize) {
+    finishWrite(PacketWriteResult::OK);
+    return;
+  }
+
+  // Keep the window full
+  size_t window = (writeWindow > 0) ? writeWindow : 1;
+  size_t bytesInFlight = writeBytesSent - writeFailureOffset;
+  if(writeBytesSent < current.bufferSize && bytesInFlight < window) {
+    size_t bytesToSend = window - bytesInFlight;
+    if(bytesToSend > current.bufferSize - writeBytesSent) {
+      bytesToSend = current.bufferSize - writeBytesSent;
+    }
+
+    bus->sendBytes(&current.buffer[writeBytesSent], bytesToSend);
+    writeBytesSent += bytesToSend;
+  }
+}
+
+void Packetizer::finishWrite(PacketWriteResult result) {
+  if(writePhase == WritePhase::VERIFY) {
+    bus->enableWrite(false);
+  }
+
+  if(recordWriteAttempt(result)) {
+    writeBackoffTime = nextBackoffTime();
+    writePhase = WritePhase::BACKOFF;
+    writePhaseStartTime = micros();
+    return;
+  }
+
+  // Take it off the queue first so the handler can queue up another packet
+  QueuedWrite finished = writeQueue[writeQueueHead];
+  writeQueueHead = (writeQueueHead + 1) % WRITE_QUEUE_SIZE;
+  writeQueueCount--;
+  writePhase = WritePhase::IDLE;
+
+  if(finished.handler != nullptr) {
+    finished.handler->writeComplete(finished.buffer, finished.bufferSize, result);
+  }
+}
+
+void Packetizer::setPacketHandler(PacketHandler& handler) {
+  this->packetHandler = &handler;
+}
+
+void Packetizer::removePacketHandler() {
+  this->packetHandler = nullptr;
+}
+
 void Packetizer::setMaxReadTimeout(TimeMicroseconds_t maxReadTimeout) {
   this->maxReadTimeout = maxReadTimeout;
 }
@@ -200,6 +697,60 @@ void Packetizer::setFalsePacketVerificationTimeout(TimeMicroseconds_t falsePacke
 }
 
 PacketWriteResult Packetizer::writePacket(const uint8_t* buffer, size_t bufferSize) {
+  lastWriteAttempts = 0;
+
+  while(true) {
+    PacketWriteResult result = writePacketOnce(buffer, bufferSize);
+    if(! recordWriteAttempt(result)) {
+      return result;
+    }
+
+    delayMicroseconds(nextBackoffTime());
+  }
+}
+
+bool Packetizer::recordWriteAttempt(PacketWriteResult result) {
+  lastWriteAttempts++;
+  writeStatistics.attempts++;
+
+  if(result == PacketWriteResult::FAILED_INTERRUPTED) {
+    writeStatistics.interrupted++;
+  } else if(result == PacketWriteResult::FAILED_TIMEOUT) {
+    writeStatistics.timedOut++;
+  }
+
+  bool canRetry = (result == PacketWriteResult::FAILED_INTERRUPTED || result == PacketWriteResult::FAILED_TIMEOUT);
+  if(canRetry && lastWriteAttempts < maxWriteAttempts) {
+    return true;
+  }
+
+  writeStatistics.packets++;
+  if(result != PacketWriteResult::OK) {
+    writeStatistics.gaveUp++;
+  }
+
+  return false;
+}
+
+TimeMicroseconds_t Packetizer::nextBackoffTime() {
+  if(backoffRandom == 0) {
+    backoffRandom = micros() | 1;  // Anything but 0 works for xorshift
+  }
+
+  backoffRandom ^= backoffRandom << 13;
+  backoffRandom ^= backoffRandom >> 17;
+  backoffRandom ^= backoffRandom << 5;
+
+  size_t exponent = (lastWriteAttempts < RS485_MAX_BACKOFF_EXPONENT) ? lastWriteAttempts : RS485_MAX_BACKOFF_EXPONENT;
+  uint32_t slots = backoffRandom & ((1UL << exponent) - 1);  // Somewhere from 0 to 2^exponent - 1
+
+  TimeMicroseconds_t backoffTime = slots * backoffSlotTime;
+  writeStatistics.backoffTime += backoffTime;
+  return backoffTime;
+}
+
+PacketWriteResult Packetizer::writePacketOnce(const uint8_t* buffer, size_t bufferSize) {
+  writeFailureOffset = 0;
   TimeMicroseconds_t startTime = micros();
   if((startTime - lastByteReadTimestamp) < busQuietTime) {
     TimeMicroseconds_t delayTime = busQuietTime - (startTime - lastByteReadTimestamp);
@@ -221,7 +772,24 @@ PacketWriteResult Packetizer::writePacket(const uint8_t* buffer, size_t bufferSi
 
   RS485WriteEnable writeEnable(bus);  // RAII to enable/disable bus writing
 
+  if(writeWindow > 1) {
+    WriteResult status = bus->writeBytes(buffer, bufferSize, writeWindow, writeFailureOffset);
+    switch(status) {
+      case WriteResult::OK:
+      case WriteResult::UNEXPECTED_EXTRA_BYTES:  // Only ever before our first byte, same as below
+        return PacketWriteResult::OK;
+      case WriteResult::READ_BUFFER_FULL:
+      case WriteResult::NO_WRITE_BUFFER_FULL:
+        return PacketWriteResult::FAILED_BUFFER_FULL;
+      case WriteResult::NO_READ_TIMEOUT:
+      case WriteResult::FAILED_READ_BACK:
+      case WriteResult::NO_WRITE_NEW_BYTES:
+        return PacketWriteResult::FAILED_INTERRUPTED;
+    }
+  }
+
   for(size_t i = 0; i < bufferSize; i++) {
+    writeFailureOffset = i;
     WriteResult status = bus->write(buffer[i]);
     switch(status) {
       case WriteResult::OK:
@@ -241,21 +809,68 @@ PacketWriteResult Packetizer::writePacket(const uint8_t* buffer, size_t bufferSi
     }
   }
 
+  writeFailureOffset = bufferSize;
   return PacketWriteResult::OK;
 }
 
+size_t Packetizer::getWriteFailureOffset() const {
+  return writeFailureOffset;
+}
+
+void Packetizer::setWriteWindow(size_t writeWindow) {
+  this->writeWindow = writeWindow;
+}
+
+void Packetizer::setMaxWriteAttempts(size_t maxWriteAttempts) {
+  this->maxWriteAttempts = (maxWriteAttempts > 0) ? maxWriteAttempts : 1;
+}
+
+void Packetizer::setBackoffSlotTime(TimeMicroseconds_t backoffSlotTime) {
+  this->backoffSlotTime = backoffSlotTime;
+}
+
+void Packetizer::setBackoffSeed(uint32_t seed) {
+  this->backoffRandom = (seed != 0) ? seed : 1;
+}
+
+size_t Packetizer::getLastWriteAttempts() const {
+  return lastWriteAttempts;
+}
+
+const WriteStatistics& Packetizer::getWriteStatistics() const {
+  return writeStatistics;
+}
+
+void Packetizer::resetWriteStatistics() {
+  writeStatistics = {0, 0, 0, 0, 0, 0};
+}
+
 void Packetizer::setMaxWriteTimeout(TimeMicroseconds_t maxWriteTimeout) {
   this->maxWriteTimeout = maxWriteTimeout;
 }
 
+void Packetizer::setFrameGap(TimeMicroseconds_t frameGap) {
+  this->frameGap = frameGap;
+  this->frameStartCount = 0;  // Whatever we had was split with the old gap
+  this->shouldRecheck = true;
+}
+
 void Packetizer::setBusQuietTime(TimeMicroseconds_t busQuietTime) {
   this->busQuietTime = busQuietTime;
 }
 
 size_t Packetizer::fetchFromBus() {
-  int16_t result = bus->fetch();
+  size_t busAvailableBefore = bus->available();
+  size_t result = bus->fetch();
   if(result > 0) {
-    lastByteReadTimestamp = micros();
+    TimeMicroseconds_t currentTime = micros();
+
+    bool afterGap = frameGap > 0 && busAvailableBefore > 0 && currentTime - lastByteReadTimestamp > frameGap;
+    if(afterGap && frameStartCount < FRAME_BOUNDARIES) {
+      frameStarts[frameStartCount++] = busAvailableBefore;  // These bytes start a new frame
+    }
+
+    lastByteReadTimestamp = currentTime;
   }
   return result;
 }
\ No newline at end of file
@@ -0,0 +1,345 @@
+#pragma once
+
+#include <inttypes.h>
+#include <stddef.h>
+
+// How a Crc does its work. Every strategy gives exactly the same checksums, they only trade memory for speed.
+enum class CrcStrategy: uint8_t {
+  BITWISE,       // One bit at a time. No tables at all, for when flash is tight.
+  NIBBLE_TABLE,  // Four bits at a time from a 16 entry table
+  BYTE_TABLE,    // A byte at a time from a 256 entry table
+  SLICE_BY_4,    // Byte table with 3 more tables after it (1024 entries), so add(data, length) takes 4 bytes per step
+  SLICE_BY_8     // Byte table with 7 more tables after it (2048 entries), so add(data, length) takes 8 bytes per step
+};
+
+namespace crc_detail {
+
+// Just enough of std::index_sequence to build tables at compile time in C++11
+template<size_t... I>
+struct Indices {};
+
+template<typename First, typename Second>
+struct ConcatIndices;
+
+template<size_t... First, size_t... Second>
+struct ConcatIndices<Indices<First...>, Indices<Second...>> {
+  typedef Indices<First..., (sizeof...(First) + Second)...> type;
+};
+
+// Split in half each time so a 2048 entry table doesn't need 2048 levels of templates
+template<size_t N>
+struct MakeIndices {
+  typedef typename ConcatIndices<typename MakeIndices<N / 2>::type, typename MakeIndices<N - N / 2>::type>::type type;
+};
+
+template<>
+struct MakeIndices<0> {
+  typedef Indices<> type;
+};
+
+template<>
+struct MakeIndices<1> {
+  typedef Indices<0> type;
+};
+
+// The smallest unsigned type that holds Bits bits
+template<uint8_t Bits, bool Fits8 = (Bits <= 8), bool Fits16 = (Bits <= 16), bool Fits32 = (Bits <= 32)>
+struct CrcValue { typedef uint64_t type; };
+template<uint8_t Bits, bool Fits16, bool Fits32>
+struct CrcValue<Bits, true, Fits16, Fits32> { typedef uint8_t type; };
+template<uint8_t Bits, bool Fits32>
+struct CrcValue<Bits, false, true, Fits32> { typedef uint16_t type; };
+template<uint8_t Bits>
+struct CrcValue<Bits, false, false, true> { typedef uint32_t type; };
+
+constexpr uint64_t lowBits(uint8_t bits) {
+  return (bits >= 64) ? ~0ULL : ((1ULL << bits) - 1);
+}
+
+constexpr uint64_t reflect(uint64_t value, uint8_t bits) {
+  return (bits == 0) ? 0 : (((value & 1) << (bits - 1)) | reflect(value >> 1, bits - 1));
+}
+
+/**
+ * Everything about a CRC that only depends on its width, polynomial, and input reflection, all constexpr so the tables can
+ * be built by the compiler.
+ *
+ * Reflected CRCs keep the register as is and shift right. Normal ones shift left, and if they're under 8 bits wide, the
+ * register is moved up so it's 8 bits wide and a whole byte can be XORed in to the top of it.
+ */
+template<uint8_t Width, uint64_t Poly, bool RefIn>
+struct CrcMath {
+  typedef typename CrcValue<(Width < 8) ? 8 : Width>::type Register;
+
+  static constexpr bool refIn = RefIn;
+  static constexpr uint8_t registerBits = (Width < 8) ? 8 : Width;
+  static constexpr uint8_t shift = RefIn ? 0 : (registerBits - Width);
+  static constexpr uint64_t mask = lowBits(registerBits);
+  static constexpr uint64_t top = 1ULL << (registerBits - 1);
+  static constexpr uint64_t poly = RefIn ? reflect(Poly & lowBits(Width), Width) : ((Poly & lowBits(Width)) << shift);
+
+  // count bits of input that have already been XORed in to the register
+  static constexpr uint64_t bits(uint64_t crc, uint8_t count) {
+    return (count == 0) ? crc : bits(
+      RefIn ?
+        ((crc & 1) ? ((crc >> 1) ^ poly) : (crc >> 1)) :
+        (((crc & top) ? ((crc << 1) ^ poly) : (crc << 1)) & mask),
+      count - 1
+    );
+  }
+
+  static constexpr uint64_t byte(uint64_t crc, uint8_t data) {
+    return RefIn ? bits(crc ^ data, 8) : bits(crc ^ ((uint64_t) data << (registerBits - 8)), 8);
+  }
+
+  static constexpr uint64_t bytes(uint64_t crc, const char* data, size_t length) {
+    return (length == 0) ? crc : bytes(byte(crc, data[0]), data + 1, length - 1);
+  }
+
+  static constexpr Register byteEntry(size_t index) {
+    return byte(0, index);
+  }
+
+  static constexpr Register nibbleEntry(size_t index) {
+    return RefIn ? bits(index, 4) : bits((uint64_t) index << (registerBits - 4), 4);
+  }
+
+  // sliceEntry(n * 256 + b) is b followed by n zero bytes
+  static constexpr Register sliceEntry(size_t index) {
+    return (index < 256) ? byteEntry(index) : byte(sliceEntry(index - 256), 0);
+  }
+
+  // One byte through a byte table, or the first 256 entries of a slice table
+  static constexpr Register tableByte(Register crc, uint8_t data, const Register* table) {
+    return RefIn ?
+      (((registerBits > 8) ? (crc >> 8) : 0) ^ table[(crc ^ data) & 0xFF]) :
+      (((registerBits > 8) ? ((crc << 8) & mask) : 0) ^ table[((crc >> (registerBits - 8)) ^ data) & 0xFF]);
+  }
+
+  // From the value getChecksum hands out back to the register, and the other way around
+  static constexpr Register toRegister(uint64_t checksum, bool refOut, uint64_t xorOut) {
+    return (refOut == RefIn ? ((checksum ^ xorOut) & lowBits(Width)) : reflect((checksum ^ xorOut) & lowBits(Width), Width)) << shift;
+  }
+
+  static constexpr uint64_t fromRegister(uint64_t crc, bool refOut, uint64_t xorOut) {
+    return ((refOut == RefIn ? (crc >> shift) : reflect(crc >> shift, Width)) ^ xorOut) & lowBits(Width);
+  }
+};
+
+enum class CrcTableKind: uint8_t {
+  NIBBLE,
+  BYTE,
+  SLICE
+};
+
+// Outside of CrcTable because GCC is very slow to expand a long pack that calls a member of the class it's instantiating
+template<typename Math, CrcTableKind Kind>
+constexpr typename Math::Register tableEntry(size_t index) {
+  return (Kind == CrcTableKind::NIBBLE) ? Math::nibbleEntry(index) :
+    (Kind == CrcTableKind::BYTE) ? Math::byteEntry(index) :
+    Math::sliceEntry(index);
+}
+
+template<typename Math, CrcTableKind Kind, typename Entries>
+struct CrcTable;
+
+template<typename Math, CrcTableKind Kind, size_t... I>
+struct CrcTable<Math, Kind, Indices<I...>> {
+  static constexpr typename Math::Register values[sizeof...(I)] = {tableEntry<Math, Kind>(I)...};
+};
+
+template<typename Math, CrcTableKind Kind, size_t... I>
+constexpr typename Math::Register CrcTable<Math, Kind, Indices<I...>>::values[sizeof...(I)];
+
+/**
+ * How each strategy adds bytes to the register. A Crc only ever instantiates the one for its own strategy, so the tables of
+ * the others are never built. addSlices returns how many bytes it took, and add(data) takes whatever's left one at a time.
+ */
+template<typename Math, CrcStrategy Strategy>
+struct CrcEngine;
+
+template<typename Math>
+struct CrcEngine<Math, CrcStrategy::BITWISE> {
+  typedef typename Math::Register Register;
+
+  static Register add(Register crc, uint8_t data) {
+    const uint8_t registerBits = Math::registerBits;
+
+    Register value = Math::refIn ? (crc ^ data) : (crc ^ ((Register) data << (registerBits - 8)));
+    for(size_t bit = 0; bit < 8; bit++) {
+      if(Math::refIn) {
+        value = (value & 1) ? ((value >> 1) ^ Math::poly) : (value >> 1);
+      } else {
+        value = ((value & Math::top) ? ((value << 1) ^ Math::poly) : (value << 1)) & Math::mask;
+      }
+    }
+    return value;
+  }
+
+  static size_t addSlices(Register& /*crc*/, const uint8_t* /*data*/, size_t /*length*/) { return 0; }
+};
+
+template<typename Math>
+struct CrcEngine<Math, CrcStrategy::NIBBLE_TABLE> {
+  typedef typename Math::Register Register;
+  typedef CrcTable<Math, CrcTableKind::NIBBLE, typename MakeIndices<16>::type> NibbleTable;
+
+  static Register add(Register crc, uint8_t data) {
+    const uint8_t registerBits = Math::registerBits;
+    const Register* table = NibbleTable::values;
+
+    if(Math::refIn) {
+      crc = (crc >> 4) ^ table[(crc ^ data) & 0x0F];
+      crc = (crc >> 4) ^ table[(crc ^ (data >> 4)) & 0x0F];
+    } else {
+      crc = ((crc << 4) & Math::mask) ^ table[((crc >> (registerBits - 4)) ^ (data >> 4)) & 0x0F];
+      crc = ((crc << 4) & Math::mask) ^ table[((crc >> (registerBits - 4)) ^ data) & 0x0F];
+    }
+    return crc;
+  }
+
+  static size_t addSlices(Register& /*crc*/, const uint8_t* /*data*/, size_t /*length*/) { return 0; }
+};
+
+template<typename Math>
+struct CrcEngine<Math, CrcStrategy::BYTE_TABLE> {
+  typedef typename Math::Register Register;
+  typedef CrcTable<Math, CrcTableKind::BYTE, typename MakeIndices<256>::type> ByteTable;
+
+  static Register add(Register crc, uint8_t data) {
+    return Math::tableByte(crc, data, ByteTable::values);
+  }
+
+  static size_t addSlices(Register& /*crc*/, const uint8_t* /*data*/, size_t /*length*/) { return 0; }
+};
+
+// The first 256 entries of the slice table are the byte table, so single bytes go through those
+template<typename Math, size_t SliceBytes>
+struct SlicingCrcEngine {
+  typedef typename Math::Register Register;
+  typedef CrcTable<Math, CrcTableKind::SLICE, typename MakeIndices<SliceBytes * 256>::type> SliceTable;
+
+  static Register add(Register crc, uint8_t data) {
+    return Math::tableByte(crc, data, SliceTable::values);
+  }
+
+  static size_t addSlices(Register& crc, const uint8_t* data, size_t length) {
+    Register value = crc;  // Kept local, since as far as the compiler knows, writing crc could change data
+    size_t sliced = length - length % SliceBytes;
+    for(; length >= SliceBytes; data += SliceBytes, length -= SliceBytes) {
+      value = addSlice(value, data);
+    }
+    crc = value;
+    return sliced;
+  }
+
+  static inline Register addSlice(Register crc, const uint8_t* data);
+};
+
+template<typename Math>
+struct CrcEngine<Math, CrcStrategy::SLICE_BY_4>: public SlicingCrcEngine<Math, 4> {};
+
+template<typename Math>
+struct CrcEngine<Math, CrcStrategy::SLICE_BY_8>: public SlicingCrcEngine<Math, 8> {};
+
+/**
+ * The register only ever mixes with the bytes it lines up with, so XOR it in to those, then every byte of the slice is
+ * looked up in the table for how many bytes come after it, and the results are XORed together.
+ */
+template<typename Math, size_t SliceBytes>
+typename Math::Register SlicingCrcEngine<Math, SliceBytes>::addSlice(Register crc, const uint8_t* data) {
+  const uint8_t registerBits = Math::registerBits;
+  const bool refIn = Math::refIn;
+  const Register* table = SliceTable::values;
+
+  uint64_t block = 0;
+  for(size_t i = 0; i < SliceBytes; i++) {
+    // Reflected CRCs take the first byte at the bottom of the register, normal ones at the top
+    block |= (uint64_t) data[i] << (refIn ? (8 * i) : (8 * (SliceBytes - 1 - i)));
+  }
+
+  const uint8_t sliceBits = 8 * SliceBytes;
+  const bool registerFits = registerBits <= sliceBits;
+  const uint8_t extraBits = registerFits ? 0 : (registerBits - sliceBits);  // How much of the register is past the slice
+
+  if(refIn) {
+    block ^= crc;
+  } else if(registerFits) {
+    block ^= (uint64_t) crc << (sliceBits - registerBits);
+  } else {
+    block ^= (uint64_t) crc >> extraBits;
+  }
+
+  // Anything in the register past the slice is just shifted along, the same as it would be by that many zero bytes
+  Register rest = 0;
+  if(! registerFits) {
+    rest = refIn ? ((uint64_t) crc >> (sliceBits - extraBits) >> extraBits) : (((uint64_t) crc << (sliceBits - extraBits) << extraBits) & Math::mask);
+  }
+
+  for(size_t i = 0; i < SliceBytes; i++) {
+    uint8_t value = refIn ? (block >> (8 * i)) : (block >> (8 * (SliceBytes - 1 - i)));
+    rest ^= table[256 * (SliceBytes - 1 - i) + value];
+  }
+  return rest;
+}
+
+}
+
+/**
+ * Any CRC up to 64 bits wide, described the same way the usual catalogs of CRCs describe them: the width in bits, the
+ * polynomial without its top bit, the starting value, whether bytes go in least significant bit first (RefIn), whether the
+ * result is bit reversed before it's handed out (RefOut), and what it's XORed with at the end.
+ *
+ * The tables for whichever strategy is picked are built by the compiler and only exist if that strategy is used. checksumOf
+ * works at compile time too, as long as the string isn't more than a few hundred bytes:
+ *
+ * typedef Crc<16, 0x1021, 0xFFFF, false, false, 0x0000> CRC16_CCITT_FALSE;
+ * static_assert(CRC16_CCITT_FALSE::checksumOf("123456789", 9) == 0x29B1, "Check value");
+ *
+ * CRC16_CCITT_FALSE crc;
+ * crc.add(data, length);
+ * uint16_t checksum = crc.getChecksum();
+ */
+template<uint8_t Width, uint64_t Poly, uint64_t Init, bool RefIn, bool RefOut, uint64_t XorOut, CrcStrategy Strategy = CrcStrategy::BYTE_TABLE>
+class Crc {
+  static_assert(Width >= 1 && Width <= 64, "Crc can only be 1 to 64 bits wide");
+
+  typedef crc_detail::CrcMath<Width, Poly, RefIn> Math;
+  typedef typename Math::Register Register;
+
+public:
+  typedef typename crc_detail::CrcValue<Width>::type Value;
+
+  Crc(): crc(Math::toRegister(Init, false, 0)) {}
+  // Start from a checksum you already have, to pick back up where an earlier one left off
+  explicit Crc(Value checksum): crc(Math::toRegister(checksum, RefOut, XorOut)) {}
+
+  void add(uint8_t data);
+  void add(const uint8_t* data, size_t length);
+  operator Value() const { return getChecksum(); }
+  Value getChecksum() const { return Math::fromRegister(crc, RefOut, XorOut); }
+
+  // The checksum of a whole string, at compile time if you want
+  static constexpr Value checksumOf(const char* data, size_t length) {
+    return Math::fromRegister(Math::bytes(Math::toRegister(Init, false, 0), data, length), RefOut, XorOut);
+  }
+
+private:
+  typedef crc_detail::CrcEngine<Math, Strategy> Engine;
+
+  Register crc;
+};
+
+template<uint8_t Width, uint64_t Poly, uint64_t Init, bool RefIn, bool RefOut, uint64_t XorOut, CrcStrategy Strategy>
+void Crc<Width, Poly, Init, RefIn, RefOut, XorOut, Strategy>::add(uint8_t data) {
+  crc = Engine::add(crc, data);
+}
+
+template<uint8_t Width, uint64_t Poly, uint64_t Init, bool RefIn, bool RefOut, uint64_t XorOut, CrcStrategy Strategy>
+void Crc<Width, Poly, Init, RefIn, RefOut, XorOut, Strategy>::add(const uint8_t* data, size_t length) {
+  Register value = crc;
+  for(size_t i = Engine::addSlices(value, data, length); i < length; i++) {
+    value = Engine::add(value, data[i]);
+  }
+  crc = value;
+}
@@ -0,0 +1,10 @@
+#include "rs485/protocols/checksums/modbus_ascii.h"
+
+/**
+ * Adding the LRC itself to the rest of the bytes always brings the sum back around to 0, so running this over a whole
+ * decoded frame including its LRC leaves a checksum of 0 behind, the same as ModbusRTUChecksum does with its CRC.
+ */
+
+void ModbusASCIIChecksum::add(uint8_t data) {
+  sum += data;
+}
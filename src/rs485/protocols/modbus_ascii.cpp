@@ -0,0 +1,185 @@
+#include "rs485/protocols/modbus_ascii.h"
+#include "rs485/protocols/checksums/modbus_ascii.h"
+
+#include <string.h>
+
+const size_t ModbusASCIIProtocol::MIN_PACKET_LENGTH;
+const size_t ModbusASCIIProtocol::MAX_PACKET_LENGTH;
+const uint8_t ModbusASCIIProtocol::MAX_ADDRESS;
+const uint8_t ModbusASCIIProtocol::START;
+
+namespace {
+
+// What's kept in StreamingState::extra between calls
+const uint32_t HAVE_HIGH_NIBBLE = 0x100;  // The low 4 bits are the high nibble of a byte that's only half decoded
+const uint32_t SAW_CR = 0x200;
+
+// 0 to 15 for a hex digit in either case, 0xFF for anything else
+const uint8_t HEX_VALUES[256] = {
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF
+};
+const uint8_t NOT_HEX = 0xF0;  // Any of these bits set in a HEX_VALUES entry
+
+}
+
+IsPacketResult ModbusASCIIProtocol::isPacket(const RS485BusBase& bus, size_t startIndex, size_t endIndex) const {
+  StreamingState state;
+  begin(state);
+
+  BufferSegments segments = bus.getSegments(startIndex, endIndex);
+  if(segments.firstLength == 0) {
+    return {PacketStatus::NOT_ENOUGH_BYTES, 0, 0};  // endIndex is past what's actually on the bus
+  }
+
+  StreamingResult result = feed(state, segments.first, segments.firstLength, bus.bufferSize());
+  if(result.status == PacketStatus::NOT_ENOUGH_BYTES && segments.secondLength > 0) {
+    result = feed(state, segments.second, segments.secondLength, bus.bufferSize());
+  }
+
+  size_t bytesNeeded = (result.bytesNeeded > 0) ? (state.consumed + result.bytesNeeded) : 0;
+  return {result.status, result.packetLength, bytesNeeded};
+}
+
+size_t ModbusASCIIProtocol::nextPacketStart(const RS485BusBase& bus, size_t startIndex, size_t endIndex) const {
+  BufferSegments segments = bus.getSegments(startIndex, endIndex);
+
+  const uint8_t* start = (const uint8_t*) memchr(segments.first, START, segments.firstLength);
+  if(start != nullptr) {
+    return startIndex + (start - segments.first);
+  }
+
+  if(segments.secondLength > 0) {
+    start = (const uint8_t*) memchr(segments.second, START, segments.secondLength);
+    if(start != nullptr) {
+      return startIndex + segments.firstLength + (start - segments.second);
+    }
+  }
+
+  return startIndex + segments.firstLength + segments.secondLength;
+}
+
+void ModbusASCIIProtocol::begin(StreamingState& state) const {
+  state.consumed = 0;
+  state.checksum = 0;
+  state.expectedLength = 0;
+  state.extra = 0;
+}
+
+StreamingResult ModbusASCIIProtocol::feed(StreamingState& state, const uint8_t* data, size_t length, size_t maxLength) const {
+  size_t maxPacketLength = (maxLength < MAX_PACKET_LENGTH) ? maxLength : MAX_PACKET_LENGTH;
+  ModbusASCIIChecksum checksum(state.checksum);
+  uint32_t extra = state.extra;
+
+  size_t i = 0;
+  while(i < length) {
+    if(extra == 0 && state.consumed > 0 && state.consumed < maxPacketLength) {
+      // Between bytes, so decode whole hex pairs for as long as they keep coming. Stop short of the max length so the check
+      // below gets to see the last character.
+      size_t pairs = (length - i) / 2;
+      size_t pairsLeft = (maxPacketLength - 1 - state.consumed) / 2;
+      if(pairs > pairsLeft) {
+        pairs = pairsLeft;
+      }
+
+      for(; pairs > 0; pairs--) {
+        uint8_t high = HEX_VALUES[data[i]];
+        uint8_t low = HEX_VALUES[data[i + 1]];
+        if((high | low) & NOT_HEX) {
+          break;  // The CR, or garbage. Either way it's sorted out one character at a time below.
+        }
+
+        uint8_t value = (high << 4) | low;
+        if(state.consumed == 1 && value > MAX_ADDRESS) {
+          return {PacketStatus::NO, 0, 0};
+        }
+        checksum.add(value);
+        state.consumed += 2;
+        i += 2;
+      }
+
+      if(i == length) {
+        break;
+      }
+    }
+
+    uint8_t character = data[i++];
+    size_t index = state.consumed++;
+
+    if(index == 0) {
+      if(character != START) {
+        return {PacketStatus::NO, 0, 0};
+      }
+      continue;
+    }
+
+    if(extra & SAW_CR) {
+      // Everything's been decoded, the line feed is all that's left
+      if(character == '\n' && checksum.getChecksum() == 0) {
+        return {PacketStatus::YES, state.consumed, 0};
+      }
+      return {PacketStatus::NO, 0, 0};
+    }
+
+    if(character == '\r') {
+      if((extra & HAVE_HIGH_NIBBLE) || index < MIN_PACKET_LENGTH - 2) {
+        return {PacketStatus::NO, 0, 0};  // Half a byte, or not even an address, function, and LRC
+      }
+      extra |= SAW_CR;
+    } else {
+      uint8_t nibble = HEX_VALUES[character];
+      if(nibble & NOT_HEX) {
+        return {PacketStatus::NO, 0, 0};
+      }
+
+      if(extra & HAVE_HIGH_NIBBLE) {
+        uint8_t value = ((extra & 0x0F) << 4) | nibble;
+        if(index == 2 && value > MAX_ADDRESS) {
+          return {PacketStatus::NO, 0, 0};
+        }
+        checksum.add(value);
+        extra = 0;
+      } else {
+        extra = HAVE_HIGH_NIBBLE | nibble;
+      }
+    }
+
+    if(state.consumed >= maxPacketLength) {
+      return {PacketStatus::NO, 0, 0};  // Whatever comes next, it won't fit
+    }
+  }
+
+  state.checksum = checksum.getChecksum();
+  state.extra = extra;
+
+  if(state.consumed == 0) {
+    return {PacketStatus::NOT_ENOUGH_BYTES, 0, 1};
+  }
+
+  // The shortest this could still be
+  size_t decodedBytes = (state.consumed - 1) / 2;
+  size_t bytesNeeded;
+  if(extra & SAW_CR) {
+    bytesNeeded = 1;
+  } else if(extra & HAVE_HIGH_NIBBLE) {
+    bytesNeeded = (decodedBytes < 2) ? ((3 - decodedBytes) * 2 - 1 + 2) : 3;  // Finish this byte, then CR LF
+  } else {
+    bytesNeeded = (decodedBytes < 3) ? ((3 - decodedBytes) * 2 + 2) : 2;
+  }
+
+  return {PacketStatus::NOT_ENOUGH_BYTES, 0, bytesNeeded};
+}
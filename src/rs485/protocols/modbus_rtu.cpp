@@ -0,0 +1,267 @@
+#include "rs485/protocols/modbus_rtu.h"
+#include "rs485/protocols/checksums/modbus_rtu.h"
+
+const size_t ModbusRTUProtocol::MIN_PACKET_LENGTH;
+const size_t ModbusRTUProtocol::MAX_PACKET_LENGTH;
+const uint8_t ModbusRTUProtocol::MAX_ADDRESS;
+
+namespace {
+
+enum class LengthKind: uint8_t {
+  NONE,     // This function code never comes in this direction
+  FIXED,    // Always base bytes
+  COUNT8,   // base bytes plus the byte at offset
+  COUNT16,  // base bytes plus the big endian 16 bit value at offset
+  UNKNOWN   // No way to tell, so the CRC has to decide
+};
+
+struct LengthRule {
+  LengthKind kind;
+  uint8_t offset;
+  uint8_t base;
+};
+
+// Lengths are kept in the streaming state as one of these, or the length itself once we know it
+const size_t UNRESOLVED = 0;
+const size_t IMPOSSIBLE = 0xFFFF;
+
+const size_t REQUEST = 0;
+const size_t RESPONSE = 1;
+
+// The request and response layouts for each function code, from the Modbus application protocol spec
+void rulesFor(uint8_t function, LengthRule rules[2]) {
+  const LengthRule none = {LengthKind::NONE, 0, 0};
+  const LengthRule unknown = {LengthKind::UNKNOWN, 0, 0};
+  const LengthRule fixed4 = {LengthKind::FIXED, 0, 4};
+  const LengthRule fixed8 = {LengthKind::FIXED, 0, 8};
+  const LengthRule byteCount = {LengthKind::COUNT8, 2, 5};  // <address> <function> <count> <data:count> <crc:2>
+
+  bool exception = (function & 0x80) != 0;
+  switch(function & 0x7F) {
+    case 0x01:  // Read coils
+    case 0x02:  // Read discrete inputs
+    case 0x03:  // Read holding registers
+    case 0x04:  // Read input registers
+      rules[REQUEST] = fixed8;
+      rules[RESPONSE] = byteCount;
+      break;
+    case 0x05:  // Write single coil
+    case 0x06:  // Write single register
+      rules[REQUEST] = fixed8;
+      rules[RESPONSE] = fixed8;
+      break;
+    case 0x07:  // Read exception status
+      rules[REQUEST] = fixed4;
+      rules[RESPONSE] = {LengthKind::FIXED, 0, 5};
+      break;
+    case 0x0B:  // Get comm event counter
+      rules[REQUEST] = fixed4;
+      rules[RESPONSE] = fixed8;
+      break;
+    case 0x0C:  // Get comm event log
+    case 0x11:  // Report server ID
+      rules[REQUEST] = fixed4;
+      rules[RESPONSE] = byteCount;
+      break;
+    case 0x0F:  // Write multiple coils
+    case 0x10:  // Write multiple registers
+      rules[REQUEST] = {LengthKind::COUNT8, 6, 9};
+      rules[RESPONSE] = fixed8;
+      break;
+    case 0x14:  // Read file record
+    case 0x15:  // Write file record
+      rules[REQUEST] = byteCount;
+      rules[RESPONSE] = byteCount;
+      break;
+    case 0x16:  // Mask write register
+      rules[REQUEST] = {LengthKind::FIXED, 0, 10};
+      rules[RESPONSE] = {LengthKind::FIXED, 0, 10};
+      break;
+    case 0x17:  // Read/write multiple registers
+      rules[REQUEST] = {LengthKind::COUNT8, 10, 13};
+      rules[RESPONSE] = byteCount;
+      break;
+    case 0x18:  // Read FIFO queue
+      rules[REQUEST] = {LengthKind::FIXED, 0, 6};
+      rules[RESPONSE] = {LengthKind::COUNT16, 2, 6};
+      break;
+    case 0x08:  // Diagnostics: sub-function 0x0000 echoes data of any length, the rest are 8 bytes
+    case 0x2B:  // Encapsulated interface transport
+    case 0x41: case 0x42: case 0x43: case 0x44: case 0x45: case 0x46: case 0x47: case 0x48:  // User defined
+    case 0x64: case 0x65: case 0x66: case 0x67: case 0x68: case 0x69: case 0x6A: case 0x6B: case 0x6C: case 0x6D: case 0x6E:
+      rules[REQUEST] = unknown;
+      rules[RESPONSE] = unknown;
+      break;
+    default:
+      rules[REQUEST] = none;
+      rules[RESPONSE] = none;
+      return;  // Not a function code, exception or not
+  }
+
+  if(exception) {
+    rules[REQUEST] = none;
+    rules[RESPONSE] = {LengthKind::FIXED, 0, 5};  // <address> <function | 0x80> <exception code> <crc:2>
+  }
+}
+
+}
+
+ModbusRTUProtocol::ModbusRTUProtocol(ModbusFrames frames): frames(frames) {}
+
+IsPacketResult ModbusRTUProtocol::isPacket(const RS485BusBase& bus, size_t startIndex, size_t endIndex) const {
+  StreamingState state;
+  begin(state);
+
+  BufferSegments segments = bus.getSegments(startIndex, endIndex);
+  if(segments.firstLength == 0) {
+    return {PacketStatus::NOT_ENOUGH_BYTES, 0, 0};  // endIndex is past what's actually on the bus
+  }
+
+  StreamingResult result = feed(state, segments.first, segments.firstLength, bus.bufferSize());
+  if(result.status == PacketStatus::NOT_ENOUGH_BYTES && segments.secondLength > 0) {
+    result = feed(state, segments.second, segments.secondLength, bus.bufferSize());
+  }
+
+  size_t bytesNeeded = (result.bytesNeeded > 0) ? (state.consumed + result.bytesNeeded) : 0;
+  return {result.status, result.packetLength, bytesNeeded};
+}
+
+void ModbusRTUProtocol::begin(StreamingState& state) const {
+  state.consumed = 0;
+  state.checksum = 0xFFFF;
+  state.expectedLength = UNRESOLVED;  // The request length
+  state.extra = UNRESOLVED;  // The response length in the low 16 bits, then the function code, then a spare byte for COUNT16
+}
+
+StreamingResult ModbusRTUProtocol::feed(StreamingState& state, const uint8_t* data, size_t length, size_t maxLength) const {
+  size_t maxPacketLength = (maxLength < MAX_PACKET_LENGTH) ? maxLength : MAX_PACKET_LENGTH;
+  ModbusRTUChecksum checksum(state.checksum);
+
+  size_t lengths[2] = {state.expectedLength, state.extra & 0xFFFF};
+  uint8_t function = (state.extra >> 16) & 0xFF;
+  uint8_t highCount = (state.extra >> 24) & 0xFF;
+
+  LengthRule rules[2];
+  bool scanning = false;
+  if(state.consumed >= 2) {
+    rulesFor(function, rules);
+    scanning = rules[REQUEST].kind == LengthKind::UNKNOWN || rules[RESPONSE].kind == LengthKind::UNKNOWN;
+  }
+
+  for(size_t i = 0; i < length; i++) {
+    if(! scanning && state.consumed >= 2 && lengths[REQUEST] != UNRESOLVED && lengths[RESPONSE] != UNRESOLVED) {
+      // Nothing can happen until the byte that finishes the shortest shape, so everything before it goes in all at once
+      size_t nextLength = (lengths[REQUEST] < lengths[RESPONSE]) ? lengths[REQUEST] : lengths[RESPONSE];
+      size_t run = nextLength - state.consumed - 1;
+      if(run > length - i) {
+        run = length - i;
+      }
+
+      checksum.add(&data[i], run);
+      state.consumed += run;
+      i += run;
+      if(i == length) {
+        break;
+      }
+    }
+
+    uint8_t value = data[i];
+    size_t index = state.consumed;
+    checksum.add(value);
+    state.consumed++;
+
+    if(index == 0) {
+      if(value > MAX_ADDRESS) {
+        return {PacketStatus::NO, 0, 0};
+      }
+      continue;
+    }
+
+    if(index == 1) {
+      function = value;
+      rulesFor(function, rules);
+      if(frames == ModbusFrames::REQUESTS) {
+        rules[RESPONSE].kind = LengthKind::NONE;
+      } else if(frames == ModbusFrames::RESPONSES) {
+        rules[REQUEST].kind = LengthKind::NONE;
+      }
+
+      for(size_t shape = 0; shape < 2; shape++) {
+        if(rules[shape].kind == LengthKind::NONE) {
+          lengths[shape] = IMPOSSIBLE;
+        } else if(rules[shape].kind == LengthKind::FIXED) {
+          lengths[shape] = rules[shape].base;
+        }
+      }
+      scanning = rules[REQUEST].kind == LengthKind::UNKNOWN || rules[RESPONSE].kind == LengthKind::UNKNOWN;
+    } else if(! scanning) {
+      for(size_t shape = 0; shape < 2; shape++) {
+        const LengthRule& rule = rules[shape];
+        if(lengths[shape] != UNRESOLVED) {
+          continue;
+        }
+
+        if(rule.kind == LengthKind::COUNT8 && index == rule.offset) {
+          lengths[shape] = rule.base + value;
+        } else if(rule.kind == LengthKind::COUNT16 && index == rule.offset) {
+          highCount = value;
+        } else if(rule.kind == LengthKind::COUNT16 && index == rule.offset + 1u) {
+          lengths[shape] = rule.base + ((highCount << 8) | value);
+        }
+      }
+    }
+
+    if(scanning) {
+      if(state.consumed >= MIN_PACKET_LENGTH && checksum.getChecksum() == 0) {
+        return {PacketStatus::YES, state.consumed, 0};
+      }
+      if(state.consumed >= maxPacketLength) {
+        return {PacketStatus::NO, 0, 0};  // No more room for the CRC to ever line up
+      }
+      continue;
+    }
+
+    for(size_t shape = 0; shape < 2; shape++) {
+      if(lengths[shape] == UNRESOLVED || lengths[shape] == IMPOSSIBLE) {
+        continue;
+      }
+
+      if(lengths[shape] > maxPacketLength) {
+        lengths[shape] = IMPOSSIBLE;  // It would never fit
+      } else if(lengths[shape] == state.consumed) {
+        if(checksum.getChecksum() == 0) {
+          return {PacketStatus::YES, state.consumed, 0};
+        }
+        lengths[shape] = IMPOSSIBLE;  // The CRC had its one chance
+      }
+    }
+
+    if(lengths[REQUEST] == IMPOSSIBLE && lengths[RESPONSE] == IMPOSSIBLE) {
+      return {PacketStatus::NO, 0, 0};
+    }
+  }
+
+  state.checksum = checksum.getChecksum();
+  state.expectedLength = lengths[REQUEST];
+  state.extra = ((uint32_t) highCount << 24) | ((uint32_t) function << 16) | lengths[RESPONSE];
+
+  if(state.consumed < 2 || scanning) {
+    size_t bytesNeeded = (state.consumed < MIN_PACKET_LENGTH) ? (MIN_PACKET_LENGTH - state.consumed) : 1;
+    return {PacketStatus::NOT_ENOUGH_BYTES, 0, bytesNeeded};
+  }
+
+  // The shortest thing this could still turn out to be
+  size_t shortest = IMPOSSIBLE;
+  for(size_t shape = 0; shape < 2; shape++) {
+    size_t needed = lengths[shape];
+    if(needed == UNRESOLVED) {
+      // At least up to the length field
+      needed = rules[shape].offset + (rules[shape].kind == LengthKind::COUNT16 ? 2 : 1);
+    }
+    if(needed != IMPOSSIBLE && needed < shortest) {
+      shortest = needed;
+    }
+  }
+
+  return {PacketStatus::NOT_ENOUGH_BYTES, 0, shortest - state.consumed};
+}
@@ -12,40 +12,114 @@
 IsPacketResult PhotonProtocol::isPacket(const RS485BusBase& bus, size_t startIndex, size_t endIndex) const {
   if(startIndex + 4 > endIndex) {
     // We can't even read the header
-    return {PacketStatus::NOT_ENOUGH_BYTES, 0};
+    return {PacketStatus::NOT_ENOUGH_BYTES, 0, 5};
   }
 
   uint8_t payloadLength = bus[startIndex + 3];
 
   if(5 + payloadLength > bus.bufferSize()) {
-    return {PacketStatus::NO, 0};
+    return {PacketStatus::NO, 0, 0};
   }
 
   // If we don't have a payload, this is just the index of the crc
   size_t payloadEndIndex = startIndex + 4 + payloadLength;
+  size_t packetLength = 5 + payloadLength;  // Header + Payload is our full packet
 
   if(endIndex < payloadEndIndex) {
-    return {PacketStatus::NOT_ENOUGH_BYTES, 0};
+    return {PacketStatus::NOT_ENOUGH_BYTES, 0, packetLength};
   }
 
-  uint8_t seenChecksum = bus[startIndex + 4];
+  BufferSegments segments = bus.getSegments(startIndex, payloadEndIndex);
+  const uint8_t* segmentData[2] = {segments.first, segments.second};
+  size_t segmentLengths[2] = {segments.firstLength, segments.secondLength};
 
+  if(segments.firstLength == 0) {
+    return {PacketStatus::NOT_ENOUGH_BYTES, 0, packetLength};  // endIndex is past what's actually on the bus
+  }
+
+  // The checksum sits between the header and the payload, so it's pulled out while everything else gets added.
   CRC8_107 checksum;
+  uint8_t seenChecksum = 0;
+  size_t packetOffset = 0;
 
-  for(size_t i = 0; i < 4; i++) {
-    checksum.add(bus[startIndex + i]);
-  }
+  for(size_t segment = 0; segment < 2; segment++) {
+    if(segmentLengths[segment] == 0) {
+      continue;  // No second segment, and its pointer is null
+    }
+
+    const uint8_t* data = segmentData[segment];
+    size_t i = 0;
+    for(; i < segmentLengths[segment] && packetOffset < 5; i++, packetOffset++) {
+      if(packetOffset == 4) {
+        seenChecksum = data[i];
+      } else {
+        checksum.add(data[i]);
+      }
+    }
 
-  for(size_t i = 0; i < payloadLength; i++) {
-    checksum.add(bus[startIndex + 5 + i]);
+    // The rest is all payload
+    checksum.add(&data[i], segmentLengths[segment] - i);
+    packetOffset += segmentLengths[segment] - i;
   }
 
   uint8_t actualChecksum = checksum.getChecksum();
 
   if(actualChecksum == seenChecksum) {
-    size_t packetLength = 5 + payloadLength;  // Header + Payload is our full packet
-    return {PacketStatus::YES, packetLength};
+    return {PacketStatus::YES, packetLength, 0};
   } else {
-    return {PacketStatus::NO, 0};
+    return {PacketStatus::NO, 0, 0};
   }
+}
+
+void PhotonProtocol::begin(StreamingState& state) const {
+  state.consumed = 0;
+  state.checksum = 0;
+  state.expectedLength = 0;
+  state.extra = 0;  // The checksum we were sent
+}
+
+StreamingResult PhotonProtocol::feed(StreamingState& state, const uint8_t* data, size_t length, size_t maxLength) const {
+  CRC8_107 checksum(state.checksum);
+
+  size_t i = 0;
+  for(; i < length && state.consumed < 5; i++) {
+    size_t packetOffset = state.consumed++;
+
+    if(packetOffset == 3) {
+      state.expectedLength = 5 + data[i];
+      if(state.expectedLength > maxLength) {
+        return {PacketStatus::NO, 0, 0};
+      }
+    }
+
+    if(packetOffset == 4) {
+      state.extra = data[i];
+    } else {
+      checksum.add(data[i]);
+    }
+  }
+
+  if(state.consumed >= 5) {
+    // The rest is all payload, as much of it as we were given
+    size_t payloadLength = state.expectedLength - state.consumed;
+    if(payloadLength > length - i) {
+      payloadLength = length - i;
+    }
+    checksum.add(&data[i], payloadLength);
+    state.consumed += payloadLength;
+
+    if(state.consumed == state.expectedLength) {
+      if(checksum.getChecksum() == state.extra) {
+        return {PacketStatus::YES, state.expectedLength, 0};
+      } else {
+        return {PacketStatus::NO, 0, 0};
+      }
+    }
+  }
+
+  state.checksum = checksum.getChecksum();
+
+  // Until we have the length, we at least need the rest of the header
+  size_t bytesNeeded = (state.expectedLength > 0 ? state.expectedLength : 5) - state.consumed;
+  return {PacketStatus::NOT_ENOUGH_BYTES, 0, bytesNeeded};
 }
\ No newline at end of file
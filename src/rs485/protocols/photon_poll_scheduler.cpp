@@ -0,0 +1,216 @@
+#include "rs485/protocols/photon_poll_scheduler.h"
+
+#include <string.h>
+
+PhotonPollScheduler::PhotonPollScheduler(PhotonTransactions& transactions, PollHandler& handler):
+transactions(transactions), handler(handler) {
+  memset(devices, 0, sizeof(devices));
+  memset(&statistics, 0, sizeof(statistics));
+}
+
+bool PhotonPollScheduler::addDevice(uint8_t address, TimeMicroseconds_t period, uint8_t priority) {
+  if(devicesUsed == DEVICES || findDevice(address) != nullptr) {
+    return false;
+  }
+
+  PolledDevice& device = devices[devicesUsed++];
+  memset(&device, 0, sizeof(device));
+  device.address = address;
+  device.priority = priority;
+  device.period = period;
+  device.lastPollTime = micros() - period;  // Due right away
+
+  return true;
+}
+
+bool PhotonPollScheduler::removeDevice(uint8_t address) {
+  PolledDevice* device = findDevice(address);
+  if(device == nullptr) {
+    return false;
+  }
+
+  if(device->polledThisCycle) {
+    devicesPolledThisCycle--;
+  }
+
+  *device = devices[--devicesUsed];  // Order doesn't matter, so fill the hole with the last one
+  finishCycleIfDone();
+
+  return true;
+}
+
+size_t PhotonPollScheduler::deviceCount() const {
+  return devicesUsed;
+}
+
+const PolledDevice* PhotonPollScheduler::getDevice(uint8_t address) const {
+  for(size_t i = 0; i < devicesUsed; i++) {
+    if(devices[i].address == address) {
+      return &devices[i];
+    }
+  }
+  return nullptr;
+}
+
+PolledDevice* PhotonPollScheduler::findDevice(uint8_t address) {
+  return const_cast<PolledDevice*>(getDevice(address));
+}
+
+void PhotonPollScheduler::setMinimumTimeout(TimeMicroseconds_t timeout) {
+  this->minimumTimeout = timeout;
+}
+
+void PhotonPollScheduler::setMaximumTimeout(TimeMicroseconds_t timeout) {
+  this->maximumTimeout = timeout;
+}
+
+TimeMicroseconds_t PhotonPollScheduler::getTimeout(uint8_t address) const {
+  const PolledDevice* device = getDevice(address);
+  return device == nullptr ? maximumTimeout : timeoutFor(*device);
+}
+
+TimeMicroseconds_t PhotonPollScheduler::timeoutFor(const PolledDevice& device) const {
+  if(! device.responded) {
+    return maximumTimeout;
+  }
+
+  TimeMicroseconds_t timeout = device.responseTime + 4 * device.responseVariance;
+  if(timeout < minimumTimeout) {
+    return minimumTimeout;
+  } else if(timeout > maximumTimeout) {
+    return maximumTimeout;
+  }
+  return timeout;
+}
+
+void PhotonPollScheduler::poll(size_t workBudget) {
+  if(! statisticsStarted) {
+    statisticsStarted = true;
+    statisticsStartTime = micros();
+    cycleStartTime = statisticsStartTime;
+  }
+
+  if(! pollInFlight) {
+    sendNextPoll();
+  }
+
+  // The next poll gets queued from inside of here as soon as this one completes
+  transactions.poll(workBudget);
+}
+
+void PhotonPollScheduler::sendNextPoll() {
+  TimeMicroseconds_t currentTime = micros();
+
+  PolledDevice* next = nullptr;
+  TimeMicroseconds_t nextOverdue = 0;
+  for(size_t i = 0; i < devicesUsed; i++) {
+    PolledDevice& device = devices[i];
+    TimeMicroseconds_t sinceLastPoll = currentTime - device.lastPollTime;
+    if(sinceLastPoll < device.period) {
+      continue;  // Not due yet
+    }
+
+    TimeMicroseconds_t overdue = sinceLastPoll - device.period;
+    if(next == nullptr || device.priority > next->priority || (device.priority == next->priority && overdue > nextOverdue)) {
+      next = &device;
+      nextOverdue = overdue;
+    }
+  }
+
+  if(next == nullptr) {
+    return;
+  }
+
+  uint8_t payloadLength = handler.buildPoll(next->address, &pollBuffer[5]);
+  if(payloadLength > RS485_POLL_PAYLOAD_SIZE) {
+    payloadLength = RS485_POLL_PAYLOAD_SIZE;
+  }
+
+  if(! transactions.request(next->address, pollBuffer, payloadLength, timeoutFor(*next), *this)) {
+    return;  // Someone else is using up the transactions. We'll try again next poll.
+  }
+
+  pollInFlight = true;
+  pollSentTime = currentTime;
+  next->lastPollTime = currentTime;
+  statistics.polls++;
+}
+
+void PhotonPollScheduler::transactionComplete(const PhotonTransaction& transaction, TransactionResult result,
+  PacketWriteResult /*writeResult*/, const BufferSegments& response) {
+  TimeMicroseconds_t currentTime = micros();
+  pollInFlight = false;
+  statistics.busyTime += currentTime - pollSentTime;
+
+  PolledDevice* device = findDevice(transaction.toAddress);
+
+  if(result == TransactionResult::RESPONDED) {
+    statistics.responses++;
+
+    if(device != nullptr) {
+      // Same smoothing TCP uses for its retransmit timeout: 1/8 of the error goes into the average, 1/4 into the deviation
+      long sample = currentTime - transaction.sentTime;
+      if(! device->responded) {
+        device->responded = true;
+        device->responseTime = sample;
+        device->responseVariance = sample / 2;
+      } else {
+        long error = sample - (long) device->responseTime;
+        long deviation = (error < 0 ? -error : error) - (long) device->responseVariance;
+        device->responseTime += error / 8;
+        device->responseVariance += deviation / 4;
+      }
+    }
+  } else if(result == TransactionResult::TIMED_OUT) {
+    statistics.timeouts++;
+  } else {
+    statistics.writeFailures++;
+  }
+
+  if(device != nullptr && ! device->polledThisCycle) {
+    device->polledThisCycle = true;
+    devicesPolledThisCycle++;
+    finishCycleIfDone();
+  }
+
+  handler.pollComplete(transaction.toAddress, result, response);
+
+  sendNextPoll();
+}
+
+void PhotonPollScheduler::finishCycleIfDone() {
+  if(devicesUsed == 0 || devicesPolledThisCycle < devicesUsed) {
+    return;
+  }
+
+  TimeMicroseconds_t currentTime = micros();
+  statistics.lastCycleTime = currentTime - cycleStartTime;
+  cycleStartTime = currentTime;
+
+  for(size_t i = 0; i < devicesUsed; i++) {
+    devices[i].polledThisCycle = false;
+  }
+  devicesPolledThisCycle = 0;
+}
+
+PollStatistics PhotonPollScheduler::getStatistics() const {
+  PollStatistics current = statistics;
+  current.elapsedTime = statisticsStarted ? micros() - statisticsStartTime : 0;
+  return current;
+}
+
+uint8_t PhotonPollScheduler::getUtilization() const {
+  PollStatistics current = getStatistics();
+  if(current.elapsedTime == 0) {
+    return 0;
+  }
+
+  uint64_t percent = (uint64_t) current.busyTime * 100 / current.elapsedTime;
+  return percent > 100 ? 100 : percent;
+}
+
+void PhotonPollScheduler::resetStatistics() {
+  memset(&statistics, 0, sizeof(statistics));
+  statisticsStartTime = micros();
+  statisticsStarted = true;
+}
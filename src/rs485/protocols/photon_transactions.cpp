@@ -0,0 +1,163 @@
+#include "rs485/protocols/photon_transactions.h"
+#include "rs485/protocols/checksums/crc8_107.h"
+
+#include <string.h>
+
+const size_t PhotonTransactions::TRANSACTIONS;
+
+static const size_t HEADER_LENGTH = 5;
+
+// Header byte at offset in a packet that might be split across both segments
+static uint8_t headerByte(const BufferSegments& packet, size_t offset) {
+  if(offset < packet.firstLength) {
+    return packet.first[offset];
+  }
+  return packet.second[offset - packet.firstLength];
+}
+
+PhotonTransactions::PhotonTransactions(Packetizer& packetizer, uint8_t address):
+packetizer(packetizer), address(address) {
+  memset(transactions, 0, sizeof(transactions));
+  for(size_t i = 0; i < TRANSACTIONS; i++) {
+    transactions[i].state = TransactionState::FREE;
+    nextPacketIds[i] = i;
+  }
+
+  packetizer.setPacketHandler(*this);
+}
+
+PhotonTransactions::~PhotonTransactions() {
+  packetizer.removePacketHandler();
+}
+
+bool PhotonTransactions::request(uint8_t toAddress, uint8_t* packet, uint8_t payloadLength, TimeMicroseconds_t timeout,
+  PhotonTransactionHandler& handler) {
+  PhotonTransaction* transaction = nullptr;
+  size_t slot;
+  for(slot = 0; slot < TRANSACTIONS; slot++) {
+    if(transactions[slot].state == TransactionState::FREE) {
+      transaction = &transactions[slot];
+      break;
+    }
+  }
+
+  if(transaction == nullptr) {
+    return false;
+  }
+
+  size_t packetLength = HEADER_LENGTH + payloadLength;
+  if(! packetizer.enqueuePacket(packet, packetLength, this)) {
+    return false;  // Leave the caller's buffer alone
+  }
+
+  // The packetizer only keeps the pointer and won't touch the bytes until the next poll, so the header can go in now
+  uint8_t packetId = nextPacketIds[slot];
+  packet[0] = toAddress;
+  packet[1] = address;
+  packet[2] = packetId;
+  packet[3] = payloadLength;
+
+  CRC8_107 checksum;
+  for(size_t i = 0; i < packetLength; i++) {
+    if(i != 4) {
+      checksum.add(packet[i]);
+    }
+  }
+  packet[4] = checksum.getChecksum();
+
+  nextPacketIds[slot] = packetId + TRANSACTIONS;  // Wraps back around to slot on its own since TRANSACTIONS divides 256
+  *transaction = {toAddress, packetId, packet, packetLength, &handler, timeout, 0, TransactionState::WRITING};
+
+  return true;
+}
+
+void PhotonTransactions::poll(size_t workBudget) {
+  packetizer.poll(workBudget);
+
+  TimeMicroseconds_t currentTime = micros();
+  BufferSegments noResponse = {nullptr, 0, nullptr, 0};
+
+  for(size_t i = 0; i < TRANSACTIONS; i++) {
+    PhotonTransaction& transaction = transactions[i];
+    if(transaction.state == TransactionState::WAITING && currentTime - transaction.sentTime > transaction.timeout) {
+      complete(transaction, TransactionResult::TIMED_OUT, PacketWriteResult::OK, noResponse);
+    }
+  }
+}
+
+size_t PhotonTransactions::outstanding() const {
+  size_t count = 0;
+  for(size_t i = 0; i < TRANSACTIONS; i++) {
+    if(transactions[i].state != TransactionState::FREE) {
+      count++;
+    }
+  }
+  return count;
+}
+
+size_t PhotonTransactions::outstandingTo(uint8_t toAddress) const {
+  size_t count = 0;
+  for(size_t i = 0; i < TRANSACTIONS; i++) {
+    if(transactions[i].state != TransactionState::FREE && transactions[i].toAddress == toAddress) {
+      count++;
+    }
+  }
+  return count;
+}
+
+void PhotonTransactions::setUnmatchedPacketHandler(PacketHandler& handler) {
+  this->unmatchedPacketHandler = &handler;
+}
+
+void PhotonTransactions::removeUnmatchedPacketHandler() {
+  this->unmatchedPacketHandler = nullptr;
+}
+
+void PhotonTransactions::handlePacket(const RS485BusBase& bus, const BufferSegments& packet) {
+  if(packet.firstLength + packet.secondLength >= HEADER_LENGTH) {
+    uint8_t toAddress = headerByte(packet, 0);
+    uint8_t fromAddress = headerByte(packet, 1);
+    uint8_t packetId = headerByte(packet, 2);
+
+    PhotonTransaction& transaction = transactions[packetId % TRANSACTIONS];
+    // Nothing can be an answer until the whole request is out. Before then, the packetizer still has the caller's buffer.
+    if(
+      transaction.state == TransactionState::WAITING &&
+      transaction.packetId == packetId &&
+      transaction.toAddress == fromAddress &&
+      toAddress == address
+    ) {
+      complete(transaction, TransactionResult::RESPONDED, PacketWriteResult::OK, packet);
+      return;
+    }
+  }
+
+  if(unmatchedPacketHandler != nullptr) {
+    unmatchedPacketHandler->handlePacket(bus, packet);
+  }
+}
+
+void PhotonTransactions::writeComplete(const uint8_t* buffer, size_t /*bufferSize*/, PacketWriteResult result) {
+  PhotonTransaction& transaction = transactions[buffer[2] % TRANSACTIONS];  // Our header is still in there
+  if(transaction.state != TransactionState::WRITING || transaction.packet != buffer) {
+    return;  // Already answered somehow
+  }
+
+  if(result != PacketWriteResult::OK) {
+    BufferSegments noResponse = {nullptr, 0, nullptr, 0};
+    complete(transaction, TransactionResult::WRITE_FAILED, result, noResponse);
+    return;
+  }
+
+  transaction.state = TransactionState::WAITING;
+  transaction.sentTime = micros();
+}
+
+void PhotonTransactions::complete(PhotonTransaction& transaction, TransactionResult result, PacketWriteResult writeResult,
+  const BufferSegments& response) {
+  // Free the slot first so the handler can send its next request from in here
+  PhotonTransaction finished = transaction;
+  transaction.state = TransactionState::FREE;
+
+  finished.handler->transactionComplete(finished, result, writeResult, response);
+}
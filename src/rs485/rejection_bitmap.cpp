@@ -0,0 +1,49 @@
+#include "rs485/rejection_bitmap.h"
+
+RejectionBitmap::RejectionBitmap(uint32_t* words, size_t bitCount):
+words(words), bitCount(bitCount), wordCount(wordsFor(bitCount)) {}
+
+size_t RejectionBitmap::size() const {
+  return bitCount;
+}
+
+bool RejectionBitmap::isSet(size_t bit) const {
+  if(bit >= bitCount) {
+    return false;
+  }
+
+  return (words[bit / BITS_PER_WORD] & ((uint32_t) 1 << (bit % BITS_PER_WORD))) > 0;
+}
+
+void RejectionBitmap::set(size_t bit) {
+  if(bit >= bitCount) {
+    return;
+  }
+
+  words[bit / BITS_PER_WORD] |= ((uint32_t) 1 << (bit % BITS_PER_WORD));
+}
+
+void RejectionBitmap::clear() {
+  for(size_t i = 0; i < wordCount; i++) {
+    words[i] = 0;
+  }
+}
+
+void RejectionBitmap::shiftDown(size_t count) {
+  size_t wordShift = count / BITS_PER_WORD;
+  size_t bitShift = count % BITS_PER_WORD;
+
+  for(size_t i = 0; i < wordCount; i++) {
+    size_t source = i + wordShift;
+    if(source >= wordCount) {
+      words[i] = 0;
+      continue;
+    }
+
+    uint32_t word = words[source] >> bitShift;
+    if(bitShift > 0 && source + 1 < wordCount) {
+      word |= words[source + 1] << (BITS_PER_WORD - bitShift);
+    }
+    words[i] = word;
+  }
+}
\ No newline at end of file
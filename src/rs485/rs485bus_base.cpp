@@ -1,6 +1,9 @@
 #include "rs485/rs485bus_base.h"
 
-RS485BusBase::RS485BusBase(BusIO& busIO, uint8_t readEnablePin, uint8_t writeEnablePin) :
+RS485BusBase::RS485BusBase(BusIO& busIO, uint8_t readEnablePin, uint8_t writeEnablePin, uint8_t* buffer, size_t bufferSize, bool mirrored) :
+  readBuffer(buffer),
+  readBufferSize(bufferSize),
+  mirrored(mirrored),
   busIO(busIO),
   readEnablePin(readEnablePin),
   writeEnablePin(writeEnablePin) {
@@ -10,7 +13,7 @@ RS485BusBase::RS485BusBase(BusIO& busIO, uint8_t readEnablePin, uint8_t writeEna
     digitalWrite(writeEnablePin, LOW);
 }
 
-WriteResult RS485BusBase::write(uint8_t writeValue) {
+WriteResult RS485BusBase::fetchBeforeWrite() {
   bool anyBytesFetched = fetch() > 0;
   bool newBytesFetched = anyBytesFetched;
   while(newBytesFetched) {
@@ -30,6 +33,31 @@ WriteResult RS485BusBase::write(uint8_t writeValue) {
     return WriteResult::NO_WRITE_NEW_BYTES;
   }
 
+  return WriteResult::OK;
+}
+
+bool RS485BusBase::waitForReadBack() {
+  bool bytesAvailable = (busIO.available() > 0);
+  if(! bytesAvailable) {
+    for(size_t i=0; i < readBackRetryCount; i++) {
+      delayMicroseconds(readBackRetryTime);
+
+      bytesAvailable |= (busIO.available() > 0);
+      if(bytesAvailable) {
+        break;
+      }
+    }
+  }
+
+  return bytesAvailable;
+}
+
+WriteResult RS485BusBase::write(uint8_t writeValue) {
+  WriteResult fetchResult = fetchBeforeWrite();
+  if(fetchResult != WriteResult::OK) {
+    return fetchResult;
+  }
+
   bool alreadySetToWrite = writeCurrentlyEnabled;
 
   if(! alreadySetToWrite) {
@@ -45,19 +73,7 @@ WriteResult RS485BusBase::write(uint8_t writeValue) {
   bool readUnexpectedBytes = false;
 
   while(true) {
-    bool bytesAvailable = (busIO.available() > 0);
-    if(! bytesAvailable) {
-      for(size_t i=0; i < readBackRetryCount; i++) {
-        delayMicroseconds(readBackRetryTime);
-
-        bytesAvailable |= (busIO.available() > 0);
-        if(bytesAvailable) {
-          break;
-        }
-      }
-    }
-
-    if(! bytesAvailable) {
+    if(! waitForReadBack()) {
       if(readUnexpectedBytes) {
         return WriteResult::FAILED_READ_BACK;
       } else {
@@ -83,6 +99,139 @@ WriteResult RS485BusBase::write(uint8_t writeValue) {
   }
 }
 
+WriteResult RS485BusBase::writeBytes(const uint8_t* buffer, size_t length, size_t windowSize, size_t& bytesVerified) {
+  bytesVerified = 0;
+  if(windowSize == 0) {
+    windowSize = 1;
+  }
+
+  WriteResult result = fetchBeforeWrite();
+  if(result != WriteResult::OK) {
+    return result;
+  }
+
+  bool alreadySetToWrite = writeCurrentlyEnabled;
+
+  if(! alreadySetToWrite) {
+    enableWrite(true);
+  }
+
+  size_t bytesSent = 0;
+  bool readUnexpectedBytes = false;
+
+  while(bytesVerified < length && result == WriteResult::OK) {
+    // Keep our window full. The bus IO can queue these up while we check what's already come back.
+    size_t bytesInFlight = bytesSent - bytesVerified;
+    if(bytesSent < length && bytesInFlight < windowSize) {
+      size_t bytesToSend = windowSize - bytesInFlight;
+      if(bytesToSend > length - bytesSent) {
+        bytesToSend = length - bytesSent;
+      }
+
+      busIO.writeBytes(&buffer[bytesSent], bytesToSend);
+      bytesSent += bytesToSend;
+      bytesInFlight += bytesToSend;
+    }
+
+    if(! waitForReadBack()) {
+      result = readUnexpectedBytes ? WriteResult::FAILED_READ_BACK : WriteResult::NO_READ_TIMEOUT;
+      break;
+    }
+
+    size_t bytesRead;
+    WriteResult readResult = readBackChunk(buffer, bytesSent, bytesVerified, bytesRead);
+    if(readResult == WriteResult::UNEXPECTED_EXTRA_BYTES) {
+      readUnexpectedBytes = true;
+    } else {
+      result = readResult;
+    }
+  }
+
+  if(! alreadySetToWrite) {
+    enableWrite(false);
+  }
+
+  if(result == WriteResult::OK && readUnexpectedBytes) {
+    return WriteResult::UNEXPECTED_EXTRA_BYTES;
+  }
+
+  return result;
+}
+
+WriteResult RS485BusBase::readBackChunk(const uint8_t* buffer, size_t bytesSent, size_t& bytesVerified, size_t& bytesRead) {
+  WriteResult result = WriteResult::OK;
+  bool readUnexpectedBytes = false;
+  uint8_t readBack[16];
+
+  // Never read more than we have in flight. Anything past that isn't ours and belongs on the bus' buffer.
+  size_t bytesInFlight = bytesSent - bytesVerified;
+  size_t bytesToRead = (bytesInFlight < sizeof(readBack)) ? bytesInFlight : sizeof(readBack);
+  bytesRead = busIO.readBytes(readBack, bytesToRead);
+
+  for(size_t i = 0; i < bytesRead; i++) {
+    if(result != WriteResult::OK) {
+      // We've already failed, but whatever else we read still needs to go somewhere
+      if(! full) {
+        putByteInBuffer(readBack[i]);
+      }
+      continue;
+    }
+
+    if(readBack[i] == buffer[bytesVerified]) {
+      bytesVerified++;
+      continue;
+    }
+
+    if(full) {
+      result = WriteResult::READ_BUFFER_FULL;  // Same as write, we can't hold on to a byte that isn't ours
+      continue;
+    }
+
+    putByteInBuffer(readBack[i]);
+
+    if(bytesVerified > 0) {
+      result = WriteResult::FAILED_READ_BACK;  // Our packet was interrupted partway through
+    } else {
+      readUnexpectedBytes = true;  // Someone else's byte got there before our first one. Keep looking for ours.
+    }
+  }
+
+  if(result == WriteResult::OK && readUnexpectedBytes) {
+    return WriteResult::UNEXPECTED_EXTRA_BYTES;
+  }
+
+  return result;
+}
+
+void RS485BusBase::sendBytes(const uint8_t* buffer, size_t length) {
+  busIO.writeBytes(buffer, length);
+}
+
+WriteResult RS485BusBase::readBack(const uint8_t* buffer, size_t bytesSent, size_t& bytesVerified) {
+  bool readUnexpectedBytes = false;
+
+  while(bytesVerified < bytesSent && busIO.available() > 0) {
+    size_t bytesRead;
+    WriteResult result = readBackChunk(buffer, bytesSent, bytesVerified, bytesRead);
+
+    if(result == WriteResult::UNEXPECTED_EXTRA_BYTES) {
+      readUnexpectedBytes = true;
+    } else if(result != WriteResult::OK) {
+      return result;
+    }
+
+    if(bytesRead == 0) {
+      break;  // The bus IO claimed to have bytes, but didn't give us any
+    }
+  }
+
+  return readUnexpectedBytes ? WriteResult::UNEXPECTED_EXTRA_BYTES : WriteResult::OK;
+}
+
+TimeMicroseconds_t RS485BusBase::getReadBackTimeout() const {
+  return readBackRetryTime * readBackRetryCount;
+}
+
 size_t RS485BusBase::available() const {
   if(full) {
     return readBufferSize;
@@ -96,11 +245,36 @@ bool RS485BusBase::isBufferFull() const {
 
 size_t RS485BusBase::fetch() {
   size_t bytesRead = 0;
-  while(!full && busIO.available() > 0) {
-    bytesRead++;
+  while(!full) {
+    size_t busAvailable = busIO.available();
+    if(busAvailable == 0) {
+      break;
+    }
+
+    // We can only read up to the end of our buffer or up to the head, whichever comes first. Any more gets picked up on the next loop.
+    // A mirrored buffer continues past its end, so we can read right up to the head.
+    size_t contiguousFree;
+    if(mirrored) {
+      contiguousFree = readBufferSize - available();
+    } else {
+      contiguousFree = (tail >= head) ? (readBufferSize - tail) : (head - tail);
+    }
+    size_t chunkSize = (busAvailable < contiguousFree) ? busAvailable : contiguousFree;
+
+    size_t chunkRead = busIO.readBytes(&readBuffer[tail], chunkSize);
+    if(chunkRead == 0) {
+      break;  // The bus IO claimed to have bytes, but didn't give us any
+    }
 
-    putByteInBuffer(busIO.read());
-    // EXPECT_TRUE(false) << "Putting byte in buffer " << bytesRead;
+    bytesRead += chunkRead;
+    tail = (tail + chunkRead) % readBufferSize;
+    if(tail == head) {
+      full = true;
+    }
+  }
+
+  if(arrivalTimes != nullptr && bytesRead > 0) {
+    arrivalTimes->record(bytesRead, micros());
   }
 
   return bytesRead;
@@ -111,28 +285,107 @@ int16_t RS485BusBase::read() {
     return -1;
   }
 
-  uint8_t value = getByte(head);
+  uint8_t value = readBuffer[head];
+  discardArrivalTimes(1);
   head = (head + 1) % readBufferSize;
   full = false;
 
   return value;
 }
 
+size_t RS485BusBase::discard(size_t count) {
+  size_t bytesAvailable = available();
+  if(count > bytesAvailable) {
+    count = bytesAvailable;
+  }
+
+  if(count > 0) {
+    discardArrivalTimes(count);
+    head = (head + count) % readBufferSize;
+    full = false;
+  }
+
+  return count;
+}
+
+bool RS485BusBase::waitForBytes(TimeMicroseconds_t timeout) {
+  if(isBufferFull()) {
+    return false;  // Nothing more can be fetched, and the bus IO would just say the bytes we can't take are still there
+  }
+
+  return busIO.waitForBytes(timeout);
+}
+
 void RS485BusBase::putByteInBuffer(uint8_t value) {
-  setByte(tail, value);
+  readBuffer[tail] = value;
   tail = (tail + 1) % readBufferSize;
 
   if(tail == head) { // We've looped back around
     full = true;
   }
+
+  if(arrivalTimes != nullptr) {
+    arrivalTimes->record(1, micros());
+  }
+}
+
+void RS485BusBase::setArrivalTimes(ArrivalTimes& arrivalTimes) {
+  arrivalTimes.clear();
+  this->arrivalTimes = &arrivalTimes;
+}
+
+void RS485BusBase::removeArrivalTimes() {
+  this->arrivalTimes = nullptr;
+}
+
+bool RS485BusBase::getArrivalTime(size_t index, TimeMicroseconds_t& time) const {
+  if(arrivalTimes == nullptr || index >= available()) {
+    return false;
+  }
+
+  // Only the newest bytes are timed if the arrival times were set with bytes already in the buffer
+  size_t untimed = available() - arrivalTimes->size();
+  if(index < untimed) {
+    return false;
+  }
+
+  return arrivalTimes->getTime(index - untimed, time);
+}
+
+void RS485BusBase::discardArrivalTimes(size_t count) {
+  if(arrivalTimes == nullptr) {
+    return;
+  }
+
+  // Called before the bytes are gone. The untimed ones are always the oldest, so they go first.
+  size_t untimed = available() - arrivalTimes->size();
+  if(count > untimed) {
+    arrivalTimes->discard(count - untimed);
+  }
 }
 
 int16_t RS485BusBase::operator[](size_t index) const {
   if (index >= available()) {
     return -1;
   }
-  int bufferPosition = (head + index) % readBufferSize;
-  return getByte(bufferPosition);
+  size_t bufferPosition = (head + index) % readBufferSize;
+  return readBuffer[bufferPosition];
+}
+
+BufferSegments RS485BusBase::getSegments(size_t startIndex, size_t endIndex) const {
+  if(startIndex > endIndex || endIndex >= available()) {
+    return {nullptr, 0, nullptr, 0};
+  }
+
+  size_t length = endIndex - startIndex + 1;
+  size_t bufferPosition = (head + startIndex) % readBufferSize;
+  size_t bytesUntilEnd = readBufferSize - bufferPosition;
+
+  if(length <= bytesUntilEnd || mirrored) {
+    return {&readBuffer[bufferPosition], length, nullptr, 0};
+  }
+
+  return {&readBuffer[bufferPosition], bytesUntilEnd, readBuffer, length - bytesUntilEnd};
 }
 
 void RS485BusBase::setReadBackDelay(TimeMicroseconds_t delayTime) {
@@ -155,6 +408,11 @@ void RS485BusBase::setSettleTime(TimeMicroseconds_t settleTime) {
 }
 
 void RS485BusBase::enableWrite(bool writeEnabled) {
+  if(busIO.handlesWriteEnable()) {
+    writeCurrentlyEnabled = writeEnabled;  // Nothing to toggle and nothing to wait on
+    return;
+  }
+
   if(writeEnabled && ! writeCurrentlyEnabled) {
     writeCurrentlyEnabled = writeEnabled;
 
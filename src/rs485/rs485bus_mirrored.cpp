@@ -0,0 +1,83 @@
+#include "rs485/rs485bus_mirrored.h"
+
+#if defined(__linux__)
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+MirroredRS485Bus::MirroredRS485Bus(BusIO& busIO, uint8_t readEnablePin, uint8_t writeEnablePin, size_t minimumBufferSize) :
+  MirroredRS485Bus(busIO, readEnablePin, writeEnablePin, mapBuffer(minimumBufferSize))
+  {}
+
+MirroredRS485Bus::MirroredRS485Bus(BusIO& busIO, uint8_t readEnablePin, uint8_t writeEnablePin, Mapping mapping) :
+  RS485BusBase(busIO, readEnablePin, writeEnablePin, mapping.buffer, mapping.size, mapping.mirrored)
+  {}
+
+MirroredRS485Bus::~MirroredRS485Bus() {
+  if(mirrored) {
+    munmap(readBuffer, 2 * readBufferSize);
+  } else {
+    delete[] readBuffer;
+  }
+}
+
+size_t MirroredRS485Bus::bufferSize() const {
+  return readBufferSize;
+}
+
+bool MirroredRS485Bus::isMirrored() const {
+  return mirrored;
+}
+
+MirroredRS485Bus::Mapping MirroredRS485Bus::mapBuffer(size_t minimumBufferSize) {
+  size_t pageSize = sysconf(_SC_PAGESIZE);
+  size_t mappedSize = ((minimumBufferSize + pageSize - 1) / pageSize) * pageSize;
+  if(mappedSize == 0) {
+    mappedSize = pageSize;
+  }
+
+  Mapping mapping;
+  if(! mapMirroredBuffer(mappedSize, mapping)) {
+    // Same size the mapping would have been, so a bus asked for 0 bytes still gets a usable buffer
+    mapping.buffer = new uint8_t[mappedSize];
+    mapping.size = mappedSize;
+    mapping.mirrored = false;
+  }
+  return mapping;
+}
+
+bool MirroredRS485Bus::mapMirroredBuffer(size_t size, Mapping& mapping) {
+  int fd = memfd_create("rs485bus", MFD_CLOEXEC);
+  if(fd < 0) {
+    return false;
+  }
+
+  if(ftruncate(fd, size) != 0) {
+    close(fd);
+    return false;
+  }
+
+  // Reserve enough address space for both copies first, so nothing else can end up between them
+  void* reserved = mmap(nullptr, 2 * size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if(reserved == MAP_FAILED) {
+    close(fd);
+    return false;
+  }
+
+  uint8_t* region = static_cast<uint8_t*>(reserved);
+  void* lower = mmap(region, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0);
+  void* upper = mmap(region + size, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0);
+  close(fd);  // The mappings keep the memory alive on their own
+
+  if(lower != region || upper != region + size) {
+    munmap(region, 2 * size);
+    return false;
+  }
+
+  mapping.buffer = region;
+  mapping.size = size;
+  mapping.mirrored = true;
+  return true;
+}
+
+#endif
\ No newline at end of file
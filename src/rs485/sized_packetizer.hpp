@@ -0,0 +1,26 @@
+#pragma once
+
+#include "rs485/packetizer.h"
+
+/**
+ * A Packetizer that remembers rejected offsets across a whole bus buffer instead of just the first 64 bytes. BufferSize should
+ * match the RS485Bus it's reading from, so this is usually declared right next to it:
+ *
+ * RS485Bus<256> bus(busIO, readEnablePin, writeEnablePin);
+ * SizedPacketizer<256> packetizer(bus, protocol);
+ */
+template<size_t BufferSize>
+class SizedPacketizer: public Packetizer {
+public:
+  SizedPacketizer(RS485BusBase& bus, const Protocol& protocol);
+
+private:
+  uint32_t rejectionStorage[RejectionBitmap::wordsFor(BufferSize)];
+};
+
+template<size_t BufferSize>
+SizedPacketizer<BufferSize>::SizedPacketizer(RS485BusBase& bus, const Protocol& protocol) :
+  Packetizer(bus, protocol, rejectionStorage, BufferSize)
+  {
+    rejectedBitmap.clear();  // Our storage is only ours once the base class is done with its constructor
+  }
\ No newline at end of file
@@ -22,6 +22,8 @@ public:
   virtual size_t available();
   virtual int16_t read();
   virtual void write(uint8_t value);
+  virtual size_t readBytes(uint8_t* buffer, size_t length);
+  virtual void writeBytes(const uint8_t* buffer, size_t length);
 
   fakeit::Mock<AssertableBusIO> spy();
 
@@ -96,12 +98,38 @@ void AssertableBusIO::write(uint8_t value) {
   writtenTail++;
 }
 
+size_t AssertableBusIO::readBytes(uint8_t* buffer, size_t length) {
+  size_t bytesAvailable = ((tail - head) + BUFFER_SIZE) % BUFFER_SIZE;
+  if(length > bytesAvailable) {
+    length = bytesAvailable;
+  }
+
+  // Copy in at most two chunks, one up to the end of our buffer and one from the start of it
+  size_t firstChunk = BUFFER_SIZE - head;
+  if(firstChunk > length) {
+    firstChunk = length;
+  }
+  memcpy(buffer, &this->buffer[head], firstChunk);
+  memcpy(&buffer[firstChunk], this->buffer, length - firstChunk);
+  head = (head + length) % BUFFER_SIZE;
+
+  return length;
+}
+
+void AssertableBusIO::writeBytes(const uint8_t* buffer, size_t length) {
+  memcpy(&writtenBuffer[writtenTail], buffer, length);
+  writtenTail += length;
+}
+
 fakeit::Mock<AssertableBusIO> AssertableBusIO::spy() {
   fakeit::Mock<AssertableBusIO> spy(*this);
 
   fakeit::Spy(Method(spy, write));
   fakeit::Spy(Method(spy, read));
   fakeit::Spy(Method(spy, available));
+  fakeit::Spy(Method(spy, readBytes));
+  fakeit::Spy(Method(spy, writeBytes));
+  fakeit::Spy(Method(spy, waitForBytes));
 
   return spy;
 }
\ No newline at end of file
@@ -0,0 +1,521 @@
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <chrono>
+
+#include "../fixtures.h"
+#include "../assertable_bus_io.hpp"
+#include "rs485/rs485bus.hpp"
+#include "rs485/sized_packetizer.hpp"
+#include "rs485/protocols/photon.h"
+#include "rs485/protocols/modbus_rtu.h"
+#include "rs485/protocols/checksums/crc8_107.h"
+#include "rs485/protocols/checksums/modbus_rtu.h"
+
+/**
+ * These aren't pass/fail tests. They push the same byte stream through the packetizer one byte at a time, like a slow bus
+ * would, and report how many times the protocol had to be asked about it and how many bytes it was handed to look at. Run them with: pio test -e native -f bench_rs485
+ */
+
+class CountingProtocol: public Protocol, public StreamingProtocol {
+public:
+  explicit CountingProtocol(const Protocol& protocol): protocol(protocol) {}
+
+  virtual IsPacketResult isPacket(const RS485BusBase& bus, size_t startIndex, size_t endIndex) const {
+    calls++;
+    bytes += endIndex - startIndex + 1;
+    return protocol.isPacket(bus, startIndex, endIndex);
+  }
+
+  virtual const StreamingProtocol* streaming() const {
+    return (allowStreaming && protocol.streaming() != nullptr) ? this : nullptr;
+  }
+
+  virtual void begin(StreamingState& state) const {
+    protocol.streaming()->begin(state);
+  }
+
+  virtual StreamingResult feed(StreamingState& state, const uint8_t* data, size_t length, size_t maxLength) const {
+    calls++;
+    bytes += length;
+    return protocol.streaming()->feed(state, data, length, maxLength);
+  }
+
+  bool allowStreaming = false;
+  mutable size_t calls = 0;  // Calls to isPacket or feed
+  mutable size_t bytes = 0;  // How many bytes those calls were given to look at
+private:
+  const Protocol& protocol;
+};
+
+class PacketizerBenchmark : public PrepBus {
+public:
+  PacketizerBenchmark(): PrepBus(),
+    bus(busIO, readEnablePin, writeEnablePin),
+    countingProtocol(photon),
+    packetizer(bus, countingProtocol) {}
+
+  // Small xorshift so every run sees the same "noise"
+  uint8_t nextRandom() {
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed & 0xFF;
+  }
+
+  size_t addPhotonPacket(uint8_t* stream, size_t payloadLength) {
+    stream[0] = 0x01;
+    stream[1] = 0x00;
+    stream[2] = nextRandom();
+    stream[3] = payloadLength;
+    for(size_t i = 0; i < payloadLength; i++) {
+      stream[5 + i] = nextRandom();
+    }
+
+    CRC8_107 checksum;
+    for(size_t i = 0; i < 5 + payloadLength; i++) {
+      if(i != 4) {
+        checksum.add(stream[i]);
+      }
+    }
+    stream[4] = checksum.getChecksum();
+
+    return 5 + payloadLength;
+  }
+
+  size_t addNoise(uint8_t* stream, size_t length) {
+    for(size_t i = 0; i < length; i++) {
+      stream[i] = nextRandom();
+    }
+    return length;
+  }
+
+  size_t cleanBus() {
+    size_t length = 0;
+    while(length + 64 < sizeof(stream)) {
+      length += addPhotonPacket(&stream[length], 32);
+    }
+    return length;
+  }
+
+  size_t noisyBus() {
+    size_t length = 0;
+    while(length + 64 < sizeof(stream)) {
+      length += addNoise(&stream[length], 1 + nextRandom() % 16);
+      length += addPhotonPacket(&stream[length], 32);
+    }
+    return length;
+  }
+
+  size_t noisyBusSmallPackets() {
+    size_t length = 0;
+    while(length + 64 < sizeof(stream)) {
+      length += addNoise(&stream[length], 1 + nextRandom() % 4);
+      length += addPhotonPacket(&stream[length], nextRandom() % 8);
+    }
+    return length;
+  }
+
+  /**
+   * Packets at the start of the bus are taken right away. One found further in is taken once a few more bytes have come in
+   * without anything in front of it finishing, the same as a false packet verification timeout would.
+   */
+  void run(const char* name, const uint8_t* stream, size_t length) {
+    const size_t verificationBytes = 16;
+    size_t bytesSincePacket = 0;
+    size_t packets = 0;
+
+    for(size_t i = 0; i < length; i++) {
+      busIO << stream[i];
+      bus.fetch();
+
+      if(! packetizer.hasPacketNow()) {
+        bytesSincePacket = 0;
+        continue;
+      }
+
+      Packet packet = packetizer.getPacket();
+      if(packet.startIndex == 0 || ++bytesSincePacket >= verificationBytes) {
+        packetizer.clearPacket();
+        packets++;
+        bytesSincePacket = 0;
+      }
+    }
+
+    printf(
+      "[ BENCHMARK] %-35s %6zu bytes %4zu packets %8.2f protocol calls/byte %8.2f bytes looked at/byte\n",
+      name, length, packets, (double) countingProtocol.calls / length, (double) countingProtocol.bytes / length
+    );
+  }
+
+  AssertableBusIO busIO;
+  RS485Bus<256> bus;
+  PhotonProtocol photon;
+  CountingProtocol countingProtocol;
+  SizedPacketizer<256> packetizer;
+
+  uint32_t seed = 0x1234567;
+  uint8_t stream[8192];
+};
+
+TEST_F(PacketizerBenchmark, clean_bus) {
+  run("clean bus", stream, cleanBus());
+}
+
+TEST_F(PacketizerBenchmark, clean_bus_streaming) {
+  countingProtocol.allowStreaming = true;
+  run("clean bus, streaming", stream, cleanBus());
+}
+
+TEST_F(PacketizerBenchmark, noisy_bus) {
+  run("noisy bus", stream, noisyBus());
+}
+
+TEST_F(PacketizerBenchmark, noisy_bus_streaming) {
+  countingProtocol.allowStreaming = true;
+  run("noisy bus, streaming", stream, noisyBus());
+}
+
+TEST_F(PacketizerBenchmark, noisy_bus_small_packets) {
+  run("noisy bus, small packets", stream, noisyBusSmallPackets());
+}
+
+TEST_F(PacketizerBenchmark, noisy_bus_small_packets_streaming) {
+  countingProtocol.allowStreaming = true;
+  run("noisy bus, small packets, streaming", stream, noisyBusSmallPackets());
+}
+
+// How ModbusRTUProtocol used to find packets, before it knew any lengths: the first place the CRC comes out to 0
+class ModbusCRCScanProtocol: public Protocol, public StreamingProtocol {
+public:
+  virtual IsPacketResult isPacket(const RS485BusBase& bus, size_t startIndex, size_t endIndex) const {
+    StreamingState state;
+    begin(state);
+    BufferSegments segments = bus.getSegments(startIndex, endIndex);
+    StreamingResult result = feed(state, segments.first, segments.firstLength, bus.bufferSize());
+    if(result.status == PacketStatus::NOT_ENOUGH_BYTES && segments.secondLength > 0) {
+      result = feed(state, segments.second, segments.secondLength, bus.bufferSize());
+    }
+    return {result.status, result.packetLength, result.bytesNeeded > 0 ? state.consumed + result.bytesNeeded : 0};
+  }
+
+  virtual const StreamingProtocol* streaming() const { return this; }
+
+  virtual void begin(StreamingState& state) const {
+    state.consumed = 0;
+    state.checksum = 0xFFFF;
+  }
+
+  virtual StreamingResult feed(StreamingState& state, const uint8_t* data, size_t length, size_t maxLength) const {
+    size_t maxPacketLength = (maxLength < ModbusRTUProtocol::MAX_PACKET_LENGTH) ? maxLength : ModbusRTUProtocol::MAX_PACKET_LENGTH;
+    ModbusRTUChecksum checksum(state.checksum);
+    for(size_t i = 0; i < length; i++) {
+      checksum.add(data[i]);
+      state.consumed++;
+      if(state.consumed >= ModbusRTUProtocol::MIN_PACKET_LENGTH && checksum.getChecksum() == 0) {
+        return {PacketStatus::YES, state.consumed, 0};
+      }
+      if(state.consumed >= maxPacketLength) {
+        return {PacketStatus::NO, 0, 0};
+      }
+    }
+    state.checksum = checksum.getChecksum();
+    size_t bytesNeeded = (state.consumed < ModbusRTUProtocol::MIN_PACKET_LENGTH) ? ModbusRTUProtocol::MIN_PACKET_LENGTH - state.consumed : 1;
+    return {PacketStatus::NOT_ENOUGH_BYTES, 0, bytesNeeded};
+  }
+};
+
+/**
+ * A master polling a handful of slaves: reads of holding registers and their responses, single and multiple register
+ * writes, and the odd exception, with line noise mixed in. There's no captured traffic in the repo, so this is made up to
+ * look like it, the same way every time.
+ */
+class ModbusBenchmark : public PrepBus {
+public:
+  uint8_t nextRandom() {
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed & 0xFF;
+  }
+
+  size_t addFrame(uint8_t* stream, const uint8_t* frame, size_t length) {
+    ModbusRTUChecksum checksum;
+    for(size_t i = 0; i < length; i++) {
+      stream[i] = frame[i];
+      checksum.add(frame[i]);
+    }
+    uint16_t crc = checksum.getChecksum();
+    stream[length] = crc & 0xFF;
+    stream[length + 1] = crc >> 8;
+    return length + 2;
+  }
+
+  size_t addTransaction(uint8_t* stream) {
+    uint8_t frame[64];
+    uint8_t address = 1 + nextRandom() % 8;
+    uint8_t registers = 1 + nextRandom() % 16;
+    size_t length = 0;
+
+    switch(nextRandom() % 4) {
+      case 0:
+      case 1: {
+        uint8_t request[6] = {address, 0x03, 0x00, nextRandom(), 0x00, registers};
+        length += addFrame(&stream[length], request, 6);
+        frame[0] = address;
+        frame[1] = 0x03;
+        frame[2] = registers * 2;
+        for(size_t i = 0; i < frame[2]; i++) {
+          frame[3 + i] = nextRandom();
+        }
+        length += addFrame(&stream[length], frame, 3 + frame[2]);
+        break;
+      }
+      case 2: {
+        uint8_t request[6] = {address, 0x06, 0x00, nextRandom(), nextRandom(), nextRandom()};
+        length += addFrame(&stream[length], request, 6);
+        length += addFrame(&stream[length], request, 6);  // Echoed back
+        break;
+      }
+      default: {
+        frame[0] = address;
+        frame[1] = 0x10;
+        frame[2] = 0x00;
+        frame[3] = nextRandom();
+        frame[4] = 0x00;
+        frame[5] = registers;
+        frame[6] = registers * 2;
+        for(size_t i = 0; i < frame[6]; i++) {
+          frame[7 + i] = nextRandom();
+        }
+        length += addFrame(&stream[length], frame, 7 + frame[6]);
+        if(nextRandom() % 8 == 0) {
+          uint8_t exception[3] = {address, 0x90, 0x02};
+          length += addFrame(&stream[length], exception, 3);
+        } else {
+          length += addFrame(&stream[length], frame, 6);
+        }
+        break;
+      }
+    }
+
+    return length;
+  }
+
+  size_t cleanBus() {
+    size_t length = 0;
+    while(length + 128 < sizeof(stream)) {
+      length += addTransaction(&stream[length]);
+    }
+    return length;
+  }
+
+  size_t noisyBus() {
+    size_t length = 0;
+    while(length + 128 < sizeof(stream)) {
+      for(size_t noise = 1 + nextRandom() % 8; noise > 0; noise--) {
+        stream[length++] = nextRandom();
+      }
+      length += addTransaction(&stream[length]);
+    }
+    return length;
+  }
+
+  // Same as PacketizerBenchmark::run, plus how long it took
+  void run(const char* name, const Protocol& protocol, const uint8_t* stream, size_t length) {
+    AssertableBusIO busIO;
+    RS485Bus<256> bus(busIO, readEnablePin, writeEnablePin);
+    CountingProtocol countingProtocol(protocol);
+    countingProtocol.allowStreaming = true;
+    SizedPacketizer<256> packetizer(bus, countingProtocol);
+
+    const size_t verificationBytes = 16;
+    size_t bytesSincePacket = 0;
+    size_t packets = 0;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for(size_t i = 0; i < length; i++) {
+      busIO << stream[i];
+      bus.fetch();
+
+      if(! packetizer.hasPacketNow()) {
+        bytesSincePacket = 0;
+        continue;
+      }
+
+      Packet packet = packetizer.getPacket();
+      if(packet.startIndex == 0 || ++bytesSincePacket >= verificationBytes) {
+        packetizer.clearPacket();
+        packets++;
+        bytesSincePacket = 0;
+      }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf(
+      "[ BENCHMARK] %-35s %6zu bytes %4zu packets %8.2f protocol calls/byte %8.2f bytes looked at/byte %8.2f MB/s\n",
+      name, length, packets, (double) countingProtocol.calls / length, (double) countingProtocol.bytes / length,
+      length / seconds / 1e6
+    );
+  }
+
+  ModbusRTUProtocol modbus;
+  ModbusCRCScanProtocol crcScan;
+
+  uint32_t seed = 0x1234567;
+  uint8_t stream[8192];
+};
+
+TEST_F(ModbusBenchmark, clean_bus_crc_scan) {
+  run("modbus clean bus, crc scan", crcScan, stream, cleanBus());
+}
+
+TEST_F(ModbusBenchmark, clean_bus_lengths) {
+  run("modbus clean bus, lengths", modbus, stream, cleanBus());
+}
+
+TEST_F(ModbusBenchmark, noisy_bus_crc_scan) {
+  run("modbus noisy bus, crc scan", crcScan, stream, noisyBus());
+}
+
+TEST_F(ModbusBenchmark, noisy_bus_lengths) {
+  run("modbus noisy bus, lengths", modbus, stream, noisyBus());
+}
+
+/**
+ * Each way CRC8_107 can run, over the same bytes. Handed the bytes chunkSize at a time, which is about what a packet is.
+ */
+class CRC8_107Benchmark : public ::testing::Test {
+public:
+  typedef uint8_t (*AddFunction)(uint8_t crc, const uint8_t* data, size_t length);
+
+  template<CrcStrategy Strategy>
+  static uint8_t add(uint8_t start, const uint8_t* data, size_t length) {
+    Crc<8, 0x07, 0x00, false, false, 0x00, Strategy> checksum(start);
+    checksum.add(data, length);
+    return checksum.getChecksum();
+  }
+
+  void SetUp() {
+    uint32_t seed = 0x1234567;
+    for(size_t i = 0; i < sizeof(data); i++) {
+      seed ^= seed << 13;
+      seed ^= seed >> 17;
+      seed ^= seed << 5;
+      data[i] = seed & 0xFF;
+    }
+  }
+
+  void run(const char* name, AddFunction add, size_t chunkSize) {
+    const size_t passes = 256;
+    uint8_t crc = 0;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for(size_t pass = 0; pass < passes; pass++) {
+      for(size_t offset = 0; offset < sizeof(data); offset += chunkSize) {
+        crc = add(crc, &data[offset], chunkSize);
+      }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf(
+      "[ BENCHMARK] %-35s %4zu byte chunks %8.2f MB/s (checksum %02X)\n",
+      name, chunkSize, passes * sizeof(data) / seconds / 1e6, crc
+    );
+  }
+
+  uint8_t data[4096];
+};
+
+TEST_F(CRC8_107Benchmark, bitwise) {
+  run("crc8_107 bitwise", add<CrcStrategy::BITWISE>, 32);
+  run("crc8_107 bitwise", add<CrcStrategy::BITWISE>, 4096);
+}
+
+TEST_F(CRC8_107Benchmark, nibble_table) {
+  run("crc8_107 nibble table", add<CrcStrategy::NIBBLE_TABLE>, 32);
+  run("crc8_107 nibble table", add<CrcStrategy::NIBBLE_TABLE>, 4096);
+}
+
+TEST_F(CRC8_107Benchmark, table) {
+  run("crc8_107 table", add<CrcStrategy::BYTE_TABLE>, 32);
+  run("crc8_107 table", add<CrcStrategy::BYTE_TABLE>, 4096);
+}
+
+TEST_F(CRC8_107Benchmark, slice_by_4) {
+  run("crc8_107 slice by 4", add<CrcStrategy::SLICE_BY_4>, 32);
+  run("crc8_107 slice by 4", add<CrcStrategy::SLICE_BY_4>, 4096);
+}
+
+TEST_F(CRC8_107Benchmark, slice_by_8) {
+  run("crc8_107 slice by 8", add<CrcStrategy::SLICE_BY_8>, 32);
+  run("crc8_107 slice by 8", add<CrcStrategy::SLICE_BY_8>, 4096);
+}
+
+/**
+ * ModbusRTUChecksum over the same bytes a packet at a time, for a few packet sizes: the table one byte at a time, and the
+ * bulk add, which uses carry-less multiplication when the processor has it.
+ */
+class ModbusRTUChecksumBenchmark : public ::testing::Test {
+public:
+  typedef uint16_t (*AddFunction)(uint16_t checksum, const uint8_t* data, size_t length);
+
+  static uint16_t addBulk(uint16_t start, const uint8_t* data, size_t length) {
+    ModbusRTUChecksum checksum(start);
+    checksum.add(data, length);
+    return checksum.getChecksum();
+  }
+
+  void SetUp() {
+    uint32_t seed = 0x1234567;
+    for(size_t i = 0; i < sizeof(data); i++) {
+      seed ^= seed << 13;
+      seed ^= seed >> 17;
+      seed ^= seed << 5;
+      data[i] = seed & 0xFF;
+    }
+  }
+
+  void run(const char* name, AddFunction add) {
+    const size_t packetSizes[5] = {8, 32, 64, 256, 4096};
+    const size_t bytes = 1 << 22;
+
+    for(size_t size = 0; size < 5; size++) {
+      size_t packetSize = packetSizes[size];
+      uint16_t checksum = 0;
+
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      for(size_t done = 0; done < bytes; done += packetSize) {
+        checksum += add(0xFFFF, &data[done % sizeof(data)], packetSize);
+      }
+      double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+      printf(
+        "[ BENCHMARK] %-35s %4zu byte packets %8.2f MB/s %10.0f packets/s (checksum %04X)\n",
+        name, packetSize, bytes / seconds / 1e6, bytes / packetSize / seconds, checksum
+      );
+    }
+  }
+
+  uint8_t data[4096];
+};
+
+TEST_F(ModbusRTUChecksumBenchmark, table) {
+  run("modbus crc table", ModbusRTUChecksum::addTable);
+}
+
+TEST_F(ModbusRTUChecksumBenchmark, bulk) {
+#if RS485_MODBUS_RTU_PCLMUL
+  printf("[ BENCHMARK] PCLMULQDQ %s\n", ModbusRTUChecksum::hasPCLMUL() ? "available" : "not available, bulk add uses the table");
+#endif
+  run("modbus crc bulk add", addBulk);
+}
+
+int main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+
+    if (RUN_ALL_TESTS())
+    ;
+
+    return 0;
+}
\ No newline at end of file
@@ -5,13 +5,13 @@ IsPacketResult ProtocolMatchingBytes::isPacket(const RS485BusBase& bus, const si
   int16_t startingValue = bus[startIndex];
   for(size_t i = startIndex + 1; i <= endIndex; i++) {
     if(bus[i] == startingValue) {
-      return {PacketStatus::YES, (i - startIndex + 1)};
+      return {PacketStatus::YES, (i - startIndex + 1), 0};
     }
   }
 
   if(startingValue % 2 == 0) {
-    return {PacketStatus::NOT_ENOUGH_BYTES, 0};
+    return {PacketStatus::NOT_ENOUGH_BYTES, 0, 0};
   } else {
-    return {PacketStatus::NO, 0};
+    return {PacketStatus::NO, 0, 0};
   }
 }
\ No newline at end of file
@@ -0,0 +1,173 @@
+#pragma once
+
+#if defined(__linux__)
+
+#include <gtest/gtest.h>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <pty.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <thread>
+
+#include "../../fixtures.h"
+#include "rs485/rs485bus.hpp"
+#include "rs485/packetizer.h"
+#include "rs485/protocols/photon.h"
+#include "rs485/bus_adapters/posix_serial.h"
+
+/**
+ * The pseudo terminal's slave side acts as our serial port. Anything written to the master side shows up as if another
+ * device on the bus sent it.
+ */
+class PosixSerialBusIOTest : public PrepBus {
+protected:
+  void SetUp() {
+    ASSERT_EQ(0, openpty(&master, &slave, nullptr, nullptr, nullptr));
+    busIO = new PosixSerialBusIO(slave);
+    ASSERT_TRUE(busIO->configure(B115200));
+
+    // The master side should also be raw so it doesn't mangle or echo anything we send
+    struct termios options;
+    tcgetattr(master, &options);
+    cfmakeraw(&options);
+    tcsetattr(master, TCSANOW, &options);
+  }
+
+  void TearDown() {
+    delete busIO;
+    close(master);
+    close(slave);
+  }
+
+  void deviceSends(const uint8_t* buffer, size_t length) {
+    ASSERT_EQ(length, ::write(master, buffer, length));
+  }
+
+  // Bytes written to the master side show up on the slave side asynchronously, so give them a moment to get there.
+  void waitForAvailable(int fd, size_t count) {
+    for(size_t i = 0; i < 100; i++) {
+      int bytesAvailable = 0;
+      ioctl(fd, FIONREAD, &bytesAvailable);
+      if(bytesAvailable >= (int) count) {
+        return;
+      }
+      struct pollfd pollFd = {fd, POLLIN, 0};
+      poll(&pollFd, 1, 10);
+    }
+  }
+
+  int master = -1;
+  int slave = -1;
+  PosixSerialBusIO* busIO = nullptr;
+};
+
+TEST_F(PosixSerialBusIOTest, file_descriptor_is_non_blocking) {
+  EXPECT_NE(0, fcntl(slave, F_GETFL) & O_NONBLOCK);
+  EXPECT_EQ(slave, busIO->fileDescriptor());
+}
+
+TEST_F(PosixSerialBusIOTest, configure_fails_if_not_a_terminal) {
+  int pipeFds[2];
+  ASSERT_EQ(0, pipe(pipeFds));
+
+  PosixSerialBusIO pipeIO(pipeFds[0]);
+  EXPECT_FALSE(pipeIO.configure(B115200));
+
+  close(pipeFds[0]);
+  close(pipeFds[1]);
+}
+
+TEST_F(PosixSerialBusIOTest, nothing_available_does_not_block) {
+  uint8_t buffer[4];
+
+  EXPECT_EQ(0, busIO->available());
+  EXPECT_EQ(-1, busIO->read());
+  EXPECT_EQ(0, busIO->readBytes(buffer, sizeof(buffer)));
+}
+
+TEST_F(PosixSerialBusIOTest, reads_bytes_sent_by_other_device) {
+  uint8_t sent[] = {0x01, 0x02, 0x03, 0x04};
+  deviceSends(sent, sizeof(sent));
+  waitForAvailable(slave, sizeof(sent));
+
+  EXPECT_EQ(4, busIO->available());
+  EXPECT_EQ(0x01, busIO->read());
+
+  uint8_t buffer[8];
+  EXPECT_EQ(3, busIO->readBytes(buffer, sizeof(buffer)));
+  EXPECT_EQ(0x02, buffer[0]);
+  EXPECT_EQ(0x03, buffer[1]);
+  EXPECT_EQ(0x04, buffer[2]);
+  EXPECT_EQ(0, busIO->available());
+}
+
+TEST_F(PosixSerialBusIOTest, writes_reach_other_device) {
+  uint8_t sent[] = {0x10, 0x20, 0x30};
+  busIO->write(0x05);
+  busIO->writeBytes(sent, sizeof(sent));
+  waitForAvailable(master, 4);
+
+  uint8_t buffer[8];
+  ASSERT_EQ(4, ::read(master, buffer, sizeof(buffer)));
+  EXPECT_EQ(0x05, buffer[0]);
+  EXPECT_EQ(0x10, buffer[1]);
+  EXPECT_EQ(0x20, buffer[2]);
+  EXPECT_EQ(0x30, buffer[3]);
+}
+
+TEST_F(PosixSerialBusIOTest, writes_give_up_if_nothing_drains_the_transmit_buffer) {
+  // Nobody reads the master side, so the pseudo terminal's buffer fills up and stays full
+  static uint8_t sent[1 << 20];
+  busIO->setWriteTimeout(10000);
+  busIO->writeBytes(sent, sizeof(sent));
+
+  int bytesAvailable = 0;
+  ioctl(master, FIONREAD, &bytesAvailable);
+  EXPECT_GT(bytesAvailable, 0);
+  EXPECT_LT(bytesAvailable, (int) sizeof(sent));
+}
+
+TEST_F(PosixSerialBusIOTest, wait_for_bytes_times_out_if_nothing_arrives) {
+  EXPECT_FALSE(busIO->waitForBytes(1000));
+}
+
+TEST_F(PosixSerialBusIOTest, wait_for_bytes_wakes_up_when_bytes_arrive) {
+  // The other device only sends once we're already asleep, so this has to actually wake up rather than find bytes waiting
+  std::thread device([this]() {
+    usleep(20000);
+    uint8_t sent[] = {0x01};
+    deviceSends(sent, sizeof(sent));
+  });
+
+  EXPECT_TRUE(busIO->waitForBytes(5000000));
+  device.join();
+  EXPECT_EQ(1, busIO->available());
+}
+
+TEST_F(PosixSerialBusIOTest, kernel_direction_control_is_not_supported_by_pseudo_terminals) {
+  EXPECT_FALSE(busIO->enableKernelDirectionControl());
+  EXPECT_FALSE(busIO->handlesWriteEnable());
+}
+
+TEST_F(PosixSerialBusIOTest, packetizer_reads_packet_end_to_end) {
+  RS485Bus<16> bus(*busIO, readEnablePin, writeEnablePin);
+  PhotonProtocol protocol;
+  Packetizer packetizer(bus, protocol);
+
+  // Some noise, then a photon packet with a 1 byte payload
+  uint8_t sent[] = {0xFF, 0x45, 0x00, 0x01, 0x01, 0x40, 0x05};
+  deviceSends(sent, sizeof(sent));
+  waitForAvailable(slave, sizeof(sent));
+
+  EXPECT_EQ(sizeof(sent), bus.fetch());
+  ASSERT_TRUE(packetizer.hasPacketNow());
+
+  Packet packet = packetizer.getPacket();
+  EXPECT_EQ(0, packet.startIndex);
+  EXPECT_EQ(5, packet.endIndex);
+  EXPECT_EQ(0x45, bus[packet.startIndex]);
+}
+
+#endif
\ No newline at end of file
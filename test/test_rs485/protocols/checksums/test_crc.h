@@ -0,0 +1,155 @@
+#pragma once
+
+#include <gtest/gtest.h>
+
+#include "rs485/protocols/checksums/crc.hpp"
+#include "rs485/protocols/checksums/crc8_107.h"
+#include "rs485/protocols/checksums/modbus_rtu.h"
+
+// Catalog check values are the checksum of "123456789", and these have to come out right before anything even runs
+static_assert(Crc<8, 0x07, 0x00, false, false, 0x00>::checksumOf("123456789", 9) == 0xF4, "CRC-8/SMBUS");
+static_assert(Crc<16, 0x8005, 0xFFFF, true, true, 0x0000>::checksumOf("123456789", 9) == 0x4B37, "CRC-16/MODBUS");
+static_assert(Crc<32, 0x04C11DB7, 0xFFFFFFFF, true, true, 0xFFFFFFFF>::checksumOf("123456789", 9) == 0xCBF43926, "CRC-32");
+static_assert(CRC8_107::checksumOf("123456789", 9) == 0xF4, "CRC8_107 is CRC-8/SMBUS");
+
+// Slice tables only go as deep as the strategy needs, with the byte table as their first 256 entries
+typedef crc_detail::CrcMath<8, 0x07, false> CRC8Math;
+static_assert(sizeof(crc_detail::CrcEngine<CRC8Math, CrcStrategy::SLICE_BY_4>::SliceTable::values) == 4 * 256, "Slice by 4");
+static_assert(sizeof(crc_detail::CrcEngine<CRC8Math, CrcStrategy::SLICE_BY_8>::SliceTable::values) == 8 * 256, "Slice by 8");
+
+class CrcTest : public ::testing::Test {
+public:
+  void SetUp() {
+    uint32_t seed = 0x2468ACE;
+    for(size_t i = 0; i < sizeof(data); i++) {
+      seed ^= seed << 13;
+      seed ^= seed >> 17;
+      seed ^= seed << 5;
+      data[i] = seed & 0xFF;
+    }
+  }
+
+  template<typename Checksum>
+  uint64_t byteAtATime(const uint8_t* bytes, size_t length) {
+    Checksum checksum;
+    for(size_t i = 0; i < length; i++) {
+      checksum.add(bytes[i]);
+    }
+    return checksum.getChecksum();
+  }
+
+  template<typename Checksum>
+  uint64_t bulk(const uint8_t* bytes, size_t length) {
+    Checksum checksum;
+    checksum.add(bytes, length);
+    return checksum.getChecksum();
+  }
+
+  // Split in two, picking the second half back up from the checksum of the first
+  template<typename Checksum>
+  uint64_t resumed(const uint8_t* bytes, size_t length, size_t split) {
+    Checksum first;
+    first.add(bytes, split);
+    Checksum second(first.getChecksum());
+    second.add(&bytes[split], length - split);
+    return second.getChecksum();
+  }
+
+  // Every strategy has to get the catalog check value, and agree with the bitwise one over any length of anything
+  template<uint8_t Width, uint64_t Poly, uint64_t Init, bool RefIn, bool RefOut, uint64_t XorOut>
+  void expectCrc(uint64_t check) {
+    typedef Crc<Width, Poly, Init, RefIn, RefOut, XorOut, CrcStrategy::BITWISE> Bitwise;
+    typedef Crc<Width, Poly, Init, RefIn, RefOut, XorOut, CrcStrategy::NIBBLE_TABLE> Nibble;
+    typedef Crc<Width, Poly, Init, RefIn, RefOut, XorOut, CrcStrategy::BYTE_TABLE> Table;
+    typedef Crc<Width, Poly, Init, RefIn, RefOut, XorOut, CrcStrategy::SLICE_BY_4> SliceBy4;
+    typedef Crc<Width, Poly, Init, RefIn, RefOut, XorOut, CrcStrategy::SLICE_BY_8> SliceBy8;
+
+    const uint8_t* checkString = (const uint8_t*) "123456789";
+    EXPECT_EQ(check, Bitwise::checksumOf("123456789", 9));
+    EXPECT_EQ(check, byteAtATime<Bitwise>(checkString, 9));
+    EXPECT_EQ(check, byteAtATime<Nibble>(checkString, 9));
+    EXPECT_EQ(check, byteAtATime<Table>(checkString, 9));
+    EXPECT_EQ(check, bulk<SliceBy4>(checkString, 9));
+    EXPECT_EQ(check, bulk<SliceBy8>(checkString, 9));
+
+    for(size_t length = 0; length <= sizeof(data); length += 7) {
+      uint64_t expected = byteAtATime<Bitwise>(data, length);
+      EXPECT_EQ(expected, bulk<Nibble>(data, length));
+      EXPECT_EQ(expected, bulk<Table>(data, length));
+      EXPECT_EQ(expected, bulk<SliceBy4>(data, length));
+      EXPECT_EQ(expected, bulk<SliceBy8>(data, length));
+      EXPECT_EQ(expected, resumed<Bitwise>(data, length, length / 3));
+      EXPECT_EQ(expected, resumed<SliceBy8>(data, length, length / 3));
+    }
+  }
+
+  uint8_t data[100];
+};
+
+TEST_F(CrcTest, crc_3_gsm) {
+  expectCrc<3, 0x3, 0x0, false, false, 0x7>(0x4);
+}
+
+TEST_F(CrcTest, crc_5_usb) {
+  expectCrc<5, 0x05, 0x1F, true, true, 0x1F>(0x19);
+}
+
+TEST_F(CrcTest, crc_8_smbus) {
+  expectCrc<8, 0x07, 0x00, false, false, 0x00>(0xF4);
+}
+
+TEST_F(CrcTest, crc_12_umts) {
+  expectCrc<12, 0x80F, 0x000, false, true, 0x000>(0xDAF);
+}
+
+TEST_F(CrcTest, crc_15_can) {
+  expectCrc<15, 0x4599, 0x0000, false, false, 0x0000>(0x059E);
+}
+
+TEST_F(CrcTest, crc_16_modbus) {
+  expectCrc<16, 0x8005, 0xFFFF, true, true, 0x0000>(0x4B37);
+}
+
+TEST_F(CrcTest, crc_16_ibm_3740) {
+  expectCrc<16, 0x1021, 0xFFFF, false, false, 0x0000>(0x29B1);
+}
+
+TEST_F(CrcTest, crc_16_kermit) {
+  expectCrc<16, 0x1021, 0x0000, true, true, 0x0000>(0x2189);
+}
+
+TEST_F(CrcTest, crc_24_openpgp) {
+  expectCrc<24, 0x864CFB, 0xB704CE, false, false, 0x000000>(0x21CF02);
+}
+
+TEST_F(CrcTest, crc_32_iso_hdlc) {
+  expectCrc<32, 0x04C11DB7, 0xFFFFFFFF, true, true, 0xFFFFFFFF>(0xCBF43926);
+}
+
+TEST_F(CrcTest, crc_32_bzip2) {
+  expectCrc<32, 0x04C11DB7, 0xFFFFFFFF, false, false, 0xFFFFFFFF>(0xFC891918);
+}
+
+TEST_F(CrcTest, crc_40_gsm) {
+  expectCrc<40, 0x0004820009, 0x0000000000, false, false, 0xFFFFFFFFFF>(0xD4164FC646);
+}
+
+TEST_F(CrcTest, crc_64_xz) {
+  expectCrc<64, 0x42F0E1EBA9EA3693, 0xFFFFFFFFFFFFFFFF, true, true, 0xFFFFFFFFFFFFFFFF>(0x995DC9BBDF1939FA);
+}
+
+TEST_F(CrcTest, crc_64_ecma_182) {
+  expectCrc<64, 0x42F0E1EBA9EA3693, 0x0000000000000000, false, false, 0x0000000000000000>(0x6C40DF5F0B497347);
+}
+
+TEST_F(CrcTest, existing_checksums_are_instantiations) {
+  const uint8_t* checkString = (const uint8_t*) "123456789";
+
+  CRC8_107 crc8;
+  crc8.add(checkString, 9);
+  EXPECT_EQ(0xF4, crc8.getChecksum());
+
+  ModbusRTUChecksum modbus;
+  modbus.add(checkString, 9);
+  EXPECT_EQ(0x4B37, modbus.getChecksum());
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <gtest/gtest.h>
+
+#include "rs485/protocols/checksums/crc8_107.h"
+
+// CRC8_107::add the way it was first written, a bit at a time in the top of a wider register. Everything has to match it.
+static uint8_t referenceCRC8_107(uint8_t checksum, const uint8_t* data, size_t length) {
+  uint32_t crc = checksum << 8;
+  for(size_t i = 0; i < length; i++) {
+    crc ^= (data[i] << 8);
+    for (size_t bit_n = 0; bit_n < 8; bit_n++) {
+      if (crc & 0x8000)
+        crc ^= (0x1070 << 3);
+      crc <<= 1;
+    }
+  }
+  return (uint8_t)(crc >> 8);
+}
+
+// The same CRC done every way there is
+typedef Crc<8, 0x07, 0x00, false, false, 0x00, CrcStrategy::BITWISE> CRC8_107Bitwise;
+typedef Crc<8, 0x07, 0x00, false, false, 0x00, CrcStrategy::NIBBLE_TABLE> CRC8_107Nibble;
+typedef Crc<8, 0x07, 0x00, false, false, 0x00, CrcStrategy::BYTE_TABLE> CRC8_107Table;
+typedef Crc<8, 0x07, 0x00, false, false, 0x00, CrcStrategy::SLICE_BY_4> CRC8_107SliceBy4;
+typedef Crc<8, 0x07, 0x00, false, false, 0x00, CrcStrategy::SLICE_BY_8> CRC8_107SliceBy8;
+
+template<typename Checksum>
+uint8_t addCRC8_107(uint8_t start, const uint8_t* data, size_t length) {
+  Checksum checksum(start);
+  checksum.add(data, length);
+  return checksum.getChecksum();
+}
+
+class CRC8_107Test : public ::testing::Test {
+public:
+  void SetUp() {
+    uint32_t seed = 0x1234567;
+    for(size_t i = 0; i < sizeof(data); i++) {
+      seed ^= seed << 13;
+      seed ^= seed >> 17;
+      seed ^= seed << 5;
+      data[i] = seed & 0xFF;
+    }
+  }
+
+  uint8_t data[100];
+};
+
+TEST_F(CRC8_107Test, every_single_byte_matches_the_reference) {
+  for(size_t start = 0; start < 256; start++) {
+    for(size_t value = 0; value < 256; value++) {
+      uint8_t byte = value;
+      uint8_t expected = referenceCRC8_107(start, &byte, 1);
+
+      CRC8_107 checksum(start);
+      checksum.add(byte);
+      ASSERT_EQ(expected, checksum.getChecksum());
+      ASSERT_EQ(expected, addCRC8_107<CRC8_107Bitwise>(start, &byte, 1));
+      ASSERT_EQ(expected, addCRC8_107<CRC8_107Nibble>(start, &byte, 1));
+      ASSERT_EQ(expected, addCRC8_107<CRC8_107Table>(start, &byte, 1));
+    }
+  }
+}
+
+TEST_F(CRC8_107Test, every_length_matches_the_reference) {
+  // Every length up to past a few full slices, so every leftover count gets used
+  for(size_t length = 0; length <= sizeof(data); length++) {
+    uint8_t expected = referenceCRC8_107(0x5A, data, length);
+
+    CRC8_107 checksum(0x5A);
+    checksum.add(data, length);
+    EXPECT_EQ(expected, checksum.getChecksum());
+    EXPECT_EQ(expected, addCRC8_107<CRC8_107Bitwise>(0x5A, data, length));
+    EXPECT_EQ(expected, addCRC8_107<CRC8_107Nibble>(0x5A, data, length));
+    EXPECT_EQ(expected, addCRC8_107<CRC8_107Table>(0x5A, data, length));
+    EXPECT_EQ(expected, addCRC8_107<CRC8_107SliceBy4>(0x5A, data, length));
+    EXPECT_EQ(expected, addCRC8_107<CRC8_107SliceBy8>(0x5A, data, length));
+  }
+}
+
+TEST_F(CRC8_107Test, bulk_and_single_byte_adds_mix) {
+  CRC8_107 checksum;
+  checksum.add(data[0]);
+  checksum.add(&data[1], 20);
+  checksum.add(data[21]);
+  checksum.add(&data[22], 3);
+
+  EXPECT_EQ(referenceCRC8_107(0, data, 25), checksum.getChecksum());
+}
+
+TEST_F(CRC8_107Test, starting_from_an_earlier_checksum) {
+  CRC8_107 first;
+  first.add(data, 37);
+
+  CRC8_107 second(first.getChecksum());
+  second.add(&data[37], 40);
+
+  EXPECT_EQ(referenceCRC8_107(0, data, 77), second.getChecksum());
+}
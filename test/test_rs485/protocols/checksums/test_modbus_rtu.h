@@ -0,0 +1,101 @@
+#pragma once
+
+#include <gtest/gtest.h>
+#include <string.h>
+
+#include "rs485/protocols/checksums/modbus_rtu.h"
+
+class ModbusRTUChecksumTest : public ::testing::Test {
+public:
+  void SetUp() {
+    uint32_t seed = 0x7654321;
+    for(size_t i = 0; i < sizeof(data); i++) {
+      seed ^= seed << 13;
+      seed ^= seed >> 17;
+      seed ^= seed << 5;
+      data[i] = seed & 0xFF;
+    }
+  }
+
+  // CRC-16/MODBUS a bit at a time, the way the Modbus serial line spec writes it out. Everything has to match it.
+  uint16_t referenceModbusRTU(uint16_t start, const uint8_t* bytes, size_t length) {
+    uint16_t crc = start;
+    for(size_t i = 0; i < length; i++) {
+      crc ^= bytes[i];
+      for(size_t bit = 0; bit < 8; bit++) {
+        crc = (crc & 1) ? ((crc >> 1) ^ 0xA001) : (crc >> 1);
+      }
+    }
+    return crc;
+  }
+
+  uint8_t data[300];
+};
+
+TEST_F(ModbusRTUChecksumTest, check_value) {
+  const uint8_t check[9] = {'1', '2', '3', '4', '5', '6', '7', '8', '9'};
+
+  ModbusRTUChecksum checksum;
+  checksum.add(check, 9);
+  EXPECT_EQ(0x4B37, checksum.getChecksum());
+  EXPECT_EQ(0x4B37, referenceModbusRTU(0xFFFF, check, 9));
+}
+
+TEST_F(ModbusRTUChecksumTest, one_byte_at_a_time_matches_the_reference) {
+  ModbusRTUChecksum checksum;
+  for(size_t i = 0; i < sizeof(data); i++) {
+    checksum.add(data[i]);
+    ASSERT_EQ(referenceModbusRTU(0xFFFF, data, i + 1), checksum.getChecksum());
+  }
+}
+
+TEST_F(ModbusRTUChecksumTest, bulk_add_matches_the_reference_at_every_length) {
+  // Past several full blocks, so every leftover count and number of folds gets used
+  for(size_t length = 0; length <= sizeof(data); length++) {
+    uint16_t expected = referenceModbusRTU(0xFFFF, data, length);
+
+    ModbusRTUChecksum checksum;
+    checksum.add(data, length);
+    EXPECT_EQ(expected, checksum.getChecksum());
+    EXPECT_EQ(expected, ModbusRTUChecksum::addTable(0xFFFF, data, length));
+  }
+}
+
+TEST_F(ModbusRTUChecksumTest, bulk_add_picks_up_from_any_checksum) {
+  const uint16_t starts[5] = {0x0000, 0x0001, 0x8000, 0xA5C3, 0xFFFF};
+
+  for(size_t i = 0; i < 5; i++) {
+    for(size_t length = 30; length <= 70; length++) {
+      ModbusRTUChecksum checksum(starts[i]);
+      checksum.add(&data[3], length);  // Not lined up on anything in particular
+      EXPECT_EQ(referenceModbusRTU(starts[i], &data[3], length), checksum.getChecksum());
+    }
+  }
+}
+
+#if RS485_MODBUS_RTU_PCLMUL
+TEST_F(ModbusRTUChecksumTest, pclmul_matches_the_reference_at_every_length) {
+  if(! ModbusRTUChecksum::hasPCLMUL()) {
+    return;  // Nothing to test on this processor
+  }
+
+  for(size_t length = 0; length <= sizeof(data); length++) {
+    EXPECT_EQ(referenceModbusRTU(0xFFFF, data, length), ModbusRTUChecksum::addPCLMUL(0xFFFF, data, length));
+    EXPECT_EQ(referenceModbusRTU(0x1234, data, length), ModbusRTUChecksum::addPCLMUL(0x1234, data, length));
+  }
+}
+#endif
+
+TEST_F(ModbusRTUChecksumTest, whole_frame_with_its_crc_is_zero) {
+  uint8_t frame[258];
+  memcpy(frame, data, 256);
+
+  ModbusRTUChecksum checksum;
+  checksum.add(frame, 256);
+  frame[256] = checksum.getChecksum() & 0xFF;
+  frame[257] = checksum.getChecksum() >> 8;
+
+  ModbusRTUChecksum whole;
+  whole.add(frame, 258);
+  EXPECT_EQ(0, whole.getChecksum());
+}
@@ -0,0 +1,207 @@
+#pragma once
+
+#include <gtest/gtest.h>
+#include <string.h>
+
+#include "../../fixtures.h"
+#include "../../assertable_bus_io.hpp"
+#include "rs485/rs485bus.hpp"
+#include "rs485/packetizer.h"
+
+#include "rs485/protocols/modbus_ascii.h"
+#include "rs485/protocols/checksums/modbus_ascii.h"
+
+// Counts how many candidates the packetizer started looking at
+class CountingModbusASCIIProtocol : public ModbusASCIIProtocol {
+public:
+  virtual void begin(StreamingState& state) const {
+    begins++;
+    ModbusASCIIProtocol::begin(state);
+  }
+
+  mutable size_t begins = 0;
+};
+
+class ModbusASCIIProtocolTest : public PrepBus {
+public:
+  ModbusASCIIProtocolTest(): PrepBus(),
+    bus(busIO, readEnablePin, writeEnablePin),
+    packetizer(bus, countingProtocol) {}
+
+  void SetUp() {
+    ArduinoFake().ClearInvocationHistory();
+  };
+
+  void readable(const char* characters) {
+    for(size_t i = 0; i < strlen(characters); i++) {
+      busIO << characters[i];
+    }
+    bus.fetch();
+  }
+
+  AssertableBusIO busIO;
+  RS485Bus<64> bus;
+  ModbusASCIIProtocol protocol;
+  CountingModbusASCIIProtocol countingProtocol;
+  Packetizer packetizer;
+};
+
+TEST_F(ModbusASCIIProtocolTest, lrc_of_a_frame_including_itself_is_zero) {
+  ModbusASCIIChecksum checksum;
+  uint8_t frame[6] = {0x01, 0x03, 0x00, 0x00, 0x00, 0x01};
+  for(size_t i = 0; i < 6; i++) {
+    checksum.add(frame[i]);
+  }
+  EXPECT_EQ(0xFB, checksum.getChecksum());
+
+  checksum.add(0xFB);
+  EXPECT_EQ(0, checksum.getChecksum());
+}
+
+TEST_F(ModbusASCIIProtocolTest, lrc_picks_up_where_it_left_off) {
+  ModbusASCIIChecksum first;
+  first.add(0x11);
+  first.add(0x22);
+
+  ModbusASCIIChecksum second(first.getChecksum());
+  second.add(0x33);
+
+  ModbusASCIIChecksum all;
+  all.add(0x11);
+  all.add(0x22);
+  all.add(0x33);
+  EXPECT_EQ(all.getChecksum(), second.getChecksum());
+}
+
+TEST_F(ModbusASCIIProtocolTest, read_holding_registers_request) {
+  readable(":010300000001FB\r\n");
+
+  IsPacketResult result = protocol.isPacket(bus, 0, bus.available() - 1);
+  EXPECT_EQ(PacketStatus::YES, result.status);
+  EXPECT_EQ(17, result.packetLength);
+}
+
+TEST_F(ModbusASCIIProtocolTest, lower_case_hex_is_fine) {
+  readable(":010300000001fb\r\n");
+
+  IsPacketResult result = protocol.isPacket(bus, 0, bus.available() - 1);
+  EXPECT_EQ(PacketStatus::YES, result.status);
+  EXPECT_EQ(17, result.packetLength);
+}
+
+TEST_F(ModbusASCIIProtocolTest, returns_not_enough_bytes_until_line_feed) {
+  readable(":010300000001FB\r");
+
+  for(size_t i = 0; i < bus.available(); i++) {
+    IsPacketResult result = protocol.isPacket(bus, 0, i);
+    EXPECT_EQ(PacketStatus::NOT_ENOUGH_BYTES, result.status);
+    EXPECT_EQ(0, result.packetLength);
+  }
+
+  IsPacketResult result = protocol.isPacket(bus, 0, 0);
+  EXPECT_EQ(9, result.bytesNeeded);  // The shortest frame there is
+}
+
+TEST_F(ModbusASCIIProtocolTest, wrong_lrc_is_no) {
+  readable(":010300000001FC\r\n");
+
+  IsPacketResult result = protocol.isPacket(bus, 0, bus.available() - 1);
+  EXPECT_EQ(PacketStatus::NO, result.status);
+}
+
+TEST_F(ModbusASCIIProtocolTest, anything_but_hex_is_no) {
+  readable(":0103G");
+
+  IsPacketResult result = protocol.isPacket(bus, 0, bus.available() - 1);
+  EXPECT_EQ(PacketStatus::NO, result.status);
+}
+
+TEST_F(ModbusASCIIProtocolTest, new_colon_in_the_middle_is_no) {
+  readable(":0103:01");
+
+  IsPacketResult result = protocol.isPacket(bus, 0, bus.available() - 1);
+  EXPECT_EQ(PacketStatus::NO, result.status);
+}
+
+TEST_F(ModbusASCIIProtocolTest, reserved_address_is_no) {
+  readable(":F8");
+
+  IsPacketResult result = protocol.isPacket(bus, 0, bus.available() - 1);
+  EXPECT_EQ(PacketStatus::NO, result.status);
+}
+
+TEST_F(ModbusASCIIProtocolTest, odd_number_of_hex_characters_is_no) {
+  readable(":010300000001F\r\n");
+
+  IsPacketResult result = protocol.isPacket(bus, 0, bus.available() - 1);
+  EXPECT_EQ(PacketStatus::NO, result.status);
+}
+
+TEST_F(ModbusASCIIProtocolTest, next_packet_start_finds_the_colon) {
+  readable("xyz:01");
+
+  EXPECT_EQ(3, protocol.nextPacketStart(bus, 0, bus.available() - 1));
+  EXPECT_EQ(3, protocol.nextPacketStart(bus, 3, bus.available() - 1));
+  EXPECT_EQ(6, protocol.nextPacketStart(bus, 4, bus.available() - 1));  // Nothing left, so one past the end
+}
+
+TEST_F(ModbusASCIIProtocolTest, streaming_one_byte_at_a_time) {
+  const StreamingProtocol* streaming = protocol.streaming();
+  ASSERT_EQ(&protocol, streaming);
+
+  const char* packet = ":010300000001FB\r\n";
+  size_t expectedBytesNeeded[16] = {8, 7, 6, 5, 4, 3, 2, 3, 2, 3, 2, 3, 2, 3, 2, 1};
+
+  StreamingState state;
+  streaming->begin(state);
+
+  for(size_t i = 0; i < 16; i++) {
+    StreamingResult result = streaming->feed(state, (const uint8_t*) &packet[i], 1, 64);
+    EXPECT_EQ(PacketStatus::NOT_ENOUGH_BYTES, result.status);
+    EXPECT_EQ(expectedBytesNeeded[i], result.bytesNeeded);
+  }
+
+  StreamingResult result = streaming->feed(state, (const uint8_t*) &packet[16], 1, 64);
+  EXPECT_EQ(PacketStatus::YES, result.status);
+  EXPECT_EQ(17, result.packetLength);
+}
+
+TEST_F(ModbusASCIIProtocolTest, streaming_in_chunks_that_split_hex_pairs) {
+  const char* packet = ":010300000001FB\r\n";
+
+  StreamingState state;
+  protocol.begin(state);
+
+  StreamingResult result = protocol.feed(state, (const uint8_t*) &packet[0], 4, 64);  // Colon, address, half the function
+  EXPECT_EQ(PacketStatus::NOT_ENOUGH_BYTES, result.status);
+  result = protocol.feed(state, (const uint8_t*) &packet[4], 12, 64);  // The rest of the hex, then the CR
+  EXPECT_EQ(PacketStatus::NOT_ENOUGH_BYTES, result.status);
+  EXPECT_EQ(1, result.bytesNeeded);
+
+  result = protocol.feed(state, (const uint8_t*) &packet[16], 1, 64);
+  EXPECT_EQ(PacketStatus::YES, result.status);
+  EXPECT_EQ(17, result.packetLength);
+}
+
+TEST_F(ModbusASCIIProtocolTest, running_into_the_max_length_is_no) {
+  const char* packet = ":010300000001FB\r\n";
+
+  StreamingState state;
+  protocol.begin(state);
+  StreamingResult result = protocol.feed(state, (const uint8_t*) packet, 17, 17);
+  EXPECT_EQ(PacketStatus::YES, result.status);
+
+  protocol.begin(state);
+  result = protocol.feed(state, (const uint8_t*) packet, 17, 16);
+  EXPECT_EQ(PacketStatus::NO, result.status);
+}
+
+TEST_F(ModbusASCIIProtocolTest, packetizer_skips_noise_without_looking_at_each_byte) {
+  readable("noise, and more noise\x01\x02\x03:010300000001FB\r\n");
+
+  ASSERT_TRUE(packetizer.hasPacketNow());
+  Packet packet = packetizer.getPacket();
+  EXPECT_EQ(0, packet.startIndex);  // The noise was all thrown out in one go
+  EXPECT_EQ(16, packet.endIndex);
+  EXPECT_EQ(1, countingProtocol.begins);
+}
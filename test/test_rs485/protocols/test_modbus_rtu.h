@@ -0,0 +1,184 @@
+#pragma once
+
+#include <gtest/gtest.h>
+
+#include "../../fixtures.h"
+#include "../../assertable_bus_io.hpp"
+#include "rs485/rs485bus.hpp"
+
+#include "rs485/protocols/modbus_rtu.h"
+
+class ModbusRTUProtocolTest : public PrepBus {
+public:
+  ModbusRTUProtocolTest(): PrepBus(),
+    bus(busIO, readEnablePin, writeEnablePin) {}
+
+  void SetUp() {
+    ArduinoFake().ClearInvocationHistory();
+  };
+
+  AssertableBusIO busIO;
+  RS485Bus<16> bus;
+  ModbusRTUProtocol protocol;
+};
+
+TEST_F(ModbusRTUProtocolTest, read_holding_registers_request) {
+  busIO.readable<8>({0x01, 0x03, 0x00, 0x00, 0x00, 0x0A, 0xC5, 0xCD});
+  bus.fetch();
+
+  IsPacketResult result = protocol.isPacket(bus, 0, bus.available() - 1);
+  EXPECT_EQ(PacketStatus::YES, result.status);
+  EXPECT_EQ(8, result.packetLength);
+}
+
+TEST_F(ModbusRTUProtocolTest, returns_not_enough_bytes_until_crc_matches) {
+  busIO.readable<7>({0x01, 0x03, 0x00, 0x00, 0x00, 0x0A, 0xC5});
+  bus.fetch();
+
+  for(size_t i = 0; i < 7; i++) {
+    IsPacketResult result = protocol.isPacket(bus, 0, i);
+    EXPECT_EQ(PacketStatus::NOT_ENOUGH_BYTES, result.status);
+    EXPECT_EQ(0, result.packetLength);
+  }
+}
+
+TEST_F(ModbusRTUProtocolTest, packet_does_not_need_to_start_at_beginning_of_bus) {
+  busIO.readable<10>({0xFF, 0xFF, 0x11, 0x06, 0x00, 0x01, 0x00, 0x03, 0x9A, 0x9B});
+  bus.fetch();
+
+  IsPacketResult result = protocol.isPacket(bus, 2, bus.available() - 1);
+  EXPECT_EQ(PacketStatus::YES, result.status);
+  EXPECT_EQ(8, result.packetLength);
+}
+
+TEST_F(ModbusRTUProtocolTest, returns_no_once_packet_would_not_fit_on_bus) {
+  for(size_t i = 0; i < 16; i++) {
+    busIO << 0x00;
+  }
+  bus.fetch();
+
+  IsPacketResult result = protocol.isPacket(bus, 0, bus.available() - 1);
+  EXPECT_EQ(PacketStatus::NO, result.status);
+  EXPECT_EQ(0, result.packetLength);
+}
+
+TEST_F(ModbusRTUProtocolTest, streaming_one_byte_at_a_time) {
+  const StreamingProtocol* streaming = protocol.streaming();
+  ASSERT_EQ(&protocol, streaming);
+
+  uint8_t packet[8] = {0x01, 0x03, 0x00, 0x00, 0x00, 0x0A, 0xC5, 0xCD};
+  size_t expectedBytesNeeded[7] = {3, 1, 2, 1, 3, 2, 1};  // A response would be 5 bytes long, until its CRC doesn't match
+
+  StreamingState state;
+  streaming->begin(state);
+
+  for(size_t i = 0; i < 7; i++) {
+    StreamingResult result = streaming->feed(state, &packet[i], 1, 16);
+    EXPECT_EQ(PacketStatus::NOT_ENOUGH_BYTES, result.status);
+    EXPECT_EQ(expectedBytesNeeded[i], result.bytesNeeded);
+  }
+
+  StreamingResult result = streaming->feed(state, &packet[7], 1, 16);
+  EXPECT_EQ(PacketStatus::YES, result.status);
+  EXPECT_EQ(8, result.packetLength);
+}
+
+TEST_F(ModbusRTUProtocolTest, read_holding_registers_response_uses_byte_count) {
+  busIO.readable<9>({0x01, 0x03, 0x04, 0x00, 0x01, 0x00, 0x02, 0x2A, 0x32});
+  bus.fetch();
+
+  IsPacketResult result = protocol.isPacket(bus, 0, 2);
+  EXPECT_EQ(PacketStatus::NOT_ENOUGH_BYTES, result.status);
+  EXPECT_EQ(8, result.bytesNeeded);  // The request is 8 bytes, and is still the shortest it could be
+
+  result = protocol.isPacket(bus, 0, bus.available() - 1);
+  EXPECT_EQ(PacketStatus::YES, result.status);
+  EXPECT_EQ(9, result.packetLength);
+}
+
+TEST_F(ModbusRTUProtocolTest, exception_response_is_5_bytes) {
+  busIO.readable<5>({0x01, 0x83, 0x02, 0xC0, 0xF1});
+  bus.fetch();
+
+  IsPacketResult result = protocol.isPacket(bus, 0, 1);
+  EXPECT_EQ(PacketStatus::NOT_ENOUGH_BYTES, result.status);
+  EXPECT_EQ(5, result.bytesNeeded);
+
+  result = protocol.isPacket(bus, 0, bus.available() - 1);
+  EXPECT_EQ(PacketStatus::YES, result.status);
+  EXPECT_EQ(5, result.packetLength);
+}
+
+TEST_F(ModbusRTUProtocolTest, write_multiple_registers_request_uses_byte_count) {
+  busIO.readable<13>({0x01, 0x10, 0x00, 0x01, 0x00, 0x02, 0x04, 0x00, 0x0A, 0x01, 0x02, 0x92, 0x30});
+  bus.fetch();
+
+  IsPacketResult result = protocol.isPacket(bus, 0, 7);
+  EXPECT_EQ(PacketStatus::NOT_ENOUGH_BYTES, result.status);
+  EXPECT_EQ(13, result.bytesNeeded);
+
+  result = protocol.isPacket(bus, 0, bus.available() - 1);
+  EXPECT_EQ(PacketStatus::YES, result.status);
+  EXPECT_EQ(13, result.packetLength);
+}
+
+TEST_F(ModbusRTUProtocolTest, unknown_function_code_is_no_right_away) {
+  busIO.readable<2>({0x01, 0x55});
+  bus.fetch();
+
+  IsPacketResult result = protocol.isPacket(bus, 0, 1);
+  EXPECT_EQ(PacketStatus::NO, result.status);
+}
+
+TEST_F(ModbusRTUProtocolTest, reserved_address_is_no_right_away) {
+  busIO.readable<1>({0xF8});
+  bus.fetch();
+
+  IsPacketResult result = protocol.isPacket(bus, 0, 0);
+  EXPECT_EQ(PacketStatus::NO, result.status);
+}
+
+TEST_F(ModbusRTUProtocolTest, wrong_crc_at_every_possible_length_is_no) {
+  busIO.readable<8>({0x01, 0x06, 0x00, 0x01, 0x00, 0x03, 0x9A, 0x9A});
+  bus.fetch();
+
+  IsPacketResult result = protocol.isPacket(bus, 0, bus.available() - 1);
+  EXPECT_EQ(PacketStatus::NO, result.status);
+}
+
+TEST_F(ModbusRTUProtocolTest, encapsulated_interface_falls_back_to_crc_scan) {
+  busIO.readable<7>({0x01, 0x2B, 0x0E, 0x01, 0x00, 0x70, 0x77});
+  bus.fetch();
+
+  IsPacketResult result = protocol.isPacket(bus, 0, bus.available() - 1);
+  EXPECT_EQ(PacketStatus::YES, result.status);
+  EXPECT_EQ(7, result.packetLength);
+}
+
+TEST_F(ModbusRTUProtocolTest, diagnostics_return_query_data_falls_back_to_crc_scan) {
+  busIO.readable<10>({0x01, 0x08, 0x00, 0x00, 0x12, 0x34, 0x56, 0x78, 0x73, 0x33});
+  bus.fetch();
+
+  IsPacketResult result = protocol.isPacket(bus, 0, bus.available() - 1);
+  EXPECT_EQ(PacketStatus::YES, result.status);
+  EXPECT_EQ(10, result.packetLength);
+}
+
+TEST_F(ModbusRTUProtocolTest, requests_only_never_sees_exceptions) {
+  ModbusRTUProtocol requests(ModbusFrames::REQUESTS);
+  busIO.readable<5>({0x01, 0x83, 0x02, 0xC0, 0xF1});
+  bus.fetch();
+
+  IsPacketResult result = requests.isPacket(bus, 0, bus.available() - 1);
+  EXPECT_EQ(PacketStatus::NO, result.status);
+}
+
+TEST_F(ModbusRTUProtocolTest, responses_only_gives_up_on_a_request) {
+  ModbusRTUProtocol responses(ModbusFrames::RESPONSES);
+  busIO.readable<8>({0x01, 0x03, 0x00, 0x00, 0x00, 0x0A, 0xC5, 0xCD});
+  bus.fetch();
+
+  // Read holding registers with a byte count of 0 is 5 bytes, and the CRC doesn't match there
+  IsPacketResult result = responses.isPacket(bus, 0, bus.available() - 1);
+  EXPECT_EQ(PacketStatus::NO, result.status);
+}
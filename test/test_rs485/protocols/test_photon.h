@@ -76,6 +76,16 @@ TEST_F(PhotonProtocolTest, returns_not_enough_bytes_if_we_only_have_header) {
   IsPacketResult result = protocol.isPacket(bus, 0, bus.available() - 1);
   EXPECT_EQ(PacketStatus::NOT_ENOUGH_BYTES, result.status);
   EXPECT_EQ(0, result.packetLength);
+  EXPECT_EQ(6, result.bytesNeeded);  // The length field tells us exactly how long the packet will be
+}
+
+TEST_F(PhotonProtocolTest, needs_at_least_a_header_before_it_knows_the_length) {
+  busIO.readable<3>({0x45, 0x00, 0x01});
+  bus.fetch();
+
+  IsPacketResult result = protocol.isPacket(bus, 0, bus.available() - 1);
+  EXPECT_EQ(PacketStatus::NOT_ENOUGH_BYTES, result.status);
+  EXPECT_EQ(5, result.bytesNeeded);
 }
 
 TEST_F(PhotonProtocolTest, checksum_validates_payload_too) {
@@ -97,4 +107,78 @@ TEST_F(PhotonProtocolTest, returns_no_if_length_will_never_allow_for_packet_to_b
   IsPacketResult result = protocol.isPacket(bus, 0, bus.available() - 1);
   EXPECT_EQ(PacketStatus::NO, result.status);
   EXPECT_EQ(0, result.packetLength);
+}
+
+TEST_F(PhotonProtocolTest, packet_wrapping_around_bus_buffer) {
+  busIO.readable<4>({0xFF, 0xFF, 0xFF, 0xFF});
+  bus.fetch();
+  for(size_t i = 0; i < 4; i++) {
+    bus.read();
+  }
+
+  // Same packet as checksum_validates_payload_too, but starting 4 bytes into an 8 byte buffer
+  busIO.readable<6>({0x45, 0x00, 0x01, 0x01, 0x40, 0x05});
+  bus.fetch();
+
+  IsPacketResult result = protocol.isPacket(bus, 0, bus.available() - 1);
+  EXPECT_EQ(PacketStatus::YES, result.status);
+  EXPECT_EQ(6, result.packetLength);
+}
+
+class PhotonStreamingTest : public ::testing::Test {
+public:
+  void SetUp() {
+    ASSERT_EQ(&protocol, protocol.streaming());
+    streaming->begin(state);
+  };
+
+  PhotonProtocol protocol;
+  const StreamingProtocol* streaming = protocol.streaming();
+  StreamingState state;
+
+  // Same packet as checksum_validates_payload_too
+  uint8_t packet[6] = {0x45, 0x00, 0x01, 0x01, 0x40, 0x05};
+};
+
+TEST_F(PhotonStreamingTest, whole_packet_at_once) {
+  StreamingResult result = streaming->feed(state, packet, 6, 8);
+  EXPECT_EQ(PacketStatus::YES, result.status);
+  EXPECT_EQ(6, result.packetLength);
+}
+
+TEST_F(PhotonStreamingTest, one_byte_at_a_time) {
+  size_t expectedBytesNeeded[5] = {4, 3, 2, 2, 1};  // Header first, then the rest once we know the length
+
+  for(size_t i = 0; i < 5; i++) {
+    StreamingResult result = streaming->feed(state, &packet[i], 1, 8);
+    EXPECT_EQ(PacketStatus::NOT_ENOUGH_BYTES, result.status);
+    EXPECT_EQ(0, result.packetLength);
+    EXPECT_EQ(expectedBytesNeeded[i], result.bytesNeeded);
+    EXPECT_EQ(i + 1, state.consumed);
+  }
+
+  StreamingResult result = streaming->feed(state, &packet[5], 1, 8);
+  EXPECT_EQ(PacketStatus::YES, result.status);
+  EXPECT_EQ(6, result.packetLength);
+}
+
+TEST_F(PhotonStreamingTest, stops_at_the_end_of_the_packet) {
+  uint8_t bytes[8] = {0x45, 0x00, 0x01, 0x01, 0x40, 0x05, 0x45, 0x00};
+
+  StreamingResult result = streaming->feed(state, bytes, 8, 8);
+  EXPECT_EQ(PacketStatus::YES, result.status);
+  EXPECT_EQ(6, result.packetLength);
+  EXPECT_EQ(6, state.consumed);
+}
+
+TEST_F(PhotonStreamingTest, invalid_checksum) {
+  packet[5] = 0x06;
+
+  EXPECT_EQ(PacketStatus::NOT_ENOUGH_BYTES, streaming->feed(state, packet, 3, 8).status);
+  EXPECT_EQ(PacketStatus::NO, streaming->feed(state, &packet[3], 3, 8).status);
+}
+
+TEST_F(PhotonStreamingTest, length_too_large_for_bus) {
+  StreamingResult result = streaming->feed(state, packet, 4, 5);
+  EXPECT_EQ(PacketStatus::NO, result.status);
 }
\ No newline at end of file
@@ -0,0 +1,192 @@
+#pragma once
+
+#include <gtest/gtest.h>
+#include <set>
+#include <vector>
+
+#include "../../fixtures.h"
+#include "../../assertable_bus_io.hpp"
+#include "rs485/rs485bus.hpp"
+
+#include "rs485/protocols/photon.h"
+#include "rs485/protocols/photon_poll_scheduler.h"
+#include "rs485/protocols/checksums/crc8_107.h"
+
+// Echoes everything written, and answers every complete Photon packet sent to one of the present addresses
+class RespondingBusIO: public AssertableBusIO {
+public:
+  virtual void writeBytes(const uint8_t* buffer, size_t length) {
+    AssertableBusIO::writeBytes(buffer, length);
+    for(size_t i = 0; i < length; i++) {
+      readable(buffer[i]);
+      request.push_back(buffer[i]);
+
+      if(request.size() >= 4 && request.size() == 5u + request[3]) {
+        if(present.count(request[0]) > 0) {
+          respond();
+        }
+        request.clear();
+      }
+    }
+  }
+
+  std::set<uint8_t> present;
+
+private:
+  void respond() {
+    uint8_t header[] = {request[1], request[0], request[2], 0x01};
+    CRC8_107 checksum;
+    for(uint8_t value : header) {
+      checksum.add(value);
+      readable(value);
+    }
+    checksum.add(request[0]);
+    readable(checksum.getChecksum());
+    readable(request[0]);  // Payload is just who we are
+  }
+
+  std::vector<uint8_t> request;
+};
+
+class RecordingPollHandler: public PollHandler {
+public:
+  virtual uint8_t buildPoll(uint8_t /*address*/, uint8_t* payload) {
+    payload[0] = 0xAA;
+    return 1;
+  }
+
+  virtual void pollComplete(uint8_t address, TransactionResult result, const BufferSegments& /*response*/) {
+    addresses.push_back(address);
+    results.push_back(result);
+  }
+
+  std::vector<uint8_t> addresses;
+  std::vector<TransactionResult> results;
+};
+
+class PhotonPollSchedulerTest : public PrepBus {
+protected:
+  PhotonPollSchedulerTest(): PrepBus(),
+    bus(busIO, readEnablePin, writeEnablePin),
+    packetizer(bus, protocol),
+    transactions(packetizer, 0x01),
+    scheduler(transactions, handler) {}
+
+  void SetUp() {
+    When(Method(ArduinoFake(), micros)).AlwaysDo([&]()->unsigned long{ return currentTime; });
+
+    scheduler.setMinimumTimeout(50);
+    scheduler.setMaximumTimeout(500);
+  };
+
+  void runUntil(TimeMicroseconds_t endTime) {
+    for(; currentTime < endTime; currentTime += 10) {
+      scheduler.poll();
+    }
+  }
+
+  TimeMicroseconds_t currentTime = 0;
+  RespondingBusIO busIO;
+  RS485Bus<32> bus;
+  PhotonProtocol protocol;
+  Packetizer packetizer;
+  PhotonTransactions transactions;
+  RecordingPollHandler handler;
+  PhotonPollScheduler scheduler;
+};
+
+TEST_F(PhotonPollSchedulerTest, devices_can_only_be_added_once) {
+  EXPECT_TRUE(scheduler.addDevice(0x02, 1000));
+  EXPECT_FALSE(scheduler.addDevice(0x02, 500));
+  EXPECT_TRUE(scheduler.addDevice(0x03, 1000));
+  EXPECT_EQ(2, scheduler.deviceCount());
+
+  EXPECT_TRUE(scheduler.removeDevice(0x02));
+  EXPECT_FALSE(scheduler.removeDevice(0x02));
+  EXPECT_EQ(nullptr, scheduler.getDevice(0x02));
+  ASSERT_NE(nullptr, scheduler.getDevice(0x03));
+  EXPECT_EQ(1, scheduler.deviceCount());
+}
+
+TEST_F(PhotonPollSchedulerTest, higher_priority_goes_first) {
+  busIO.present = {0x02, 0x03};
+  scheduler.addDevice(0x02, 1000);
+  scheduler.addDevice(0x03, 1000, 5);
+
+  runUntil(500);
+
+  ASSERT_EQ(2, handler.addresses.size());
+  EXPECT_EQ(0x03, handler.addresses[0]);
+  EXPECT_EQ(0x02, handler.addresses[1]);
+  EXPECT_EQ(TransactionResult::RESPONDED, handler.results[0]);
+  EXPECT_EQ(TransactionResult::RESPONDED, handler.results[1]);
+}
+
+TEST_F(PhotonPollSchedulerTest, devices_wait_for_their_period) {
+  busIO.present = {0x02};
+  scheduler.addDevice(0x02, 1000);
+
+  runUntil(999);
+  EXPECT_EQ(1, handler.addresses.size());
+
+  runUntil(1100);
+  EXPECT_EQ(2, handler.addresses.size());
+  EXPECT_EQ(2, scheduler.getStatistics().polls);
+}
+
+TEST_F(PhotonPollSchedulerTest, missing_device_times_out_without_stopping_the_others) {
+  busIO.present = {0x02};
+  scheduler.addDevice(0x02, 1000);
+  scheduler.addDevice(0x04, 1000, 5);  // Goes first, and never answers
+
+  runUntil(900);
+
+  ASSERT_EQ(2, handler.addresses.size());
+  EXPECT_EQ(0x04, handler.addresses[0]);
+  EXPECT_EQ(TransactionResult::TIMED_OUT, handler.results[0]);
+  EXPECT_EQ(0x02, handler.addresses[1]);
+  EXPECT_EQ(TransactionResult::RESPONDED, handler.results[1]);
+
+  PollStatistics statistics = scheduler.getStatistics();
+  EXPECT_EQ(2, statistics.polls);
+  EXPECT_EQ(1, statistics.responses);
+  EXPECT_EQ(1, statistics.timeouts);
+}
+
+TEST_F(PhotonPollSchedulerTest, timeout_follows_the_response_time) {
+  busIO.present = {0x02};
+  scheduler.addDevice(0x02, 100);
+  scheduler.addDevice(0x04, 100);
+
+  EXPECT_EQ(500, scheduler.getTimeout(0x02));  // Nothing to go on yet
+
+  runUntil(3000);
+
+  const PolledDevice* device = scheduler.getDevice(0x02);
+  ASSERT_NE(nullptr, device);
+  EXPECT_TRUE(device->responded);
+  EXPECT_LT(device->responseTime, 50);
+  EXPECT_EQ(50, scheduler.getTimeout(0x02));  // Fast enough to be held at the minimum
+  EXPECT_EQ(500, scheduler.getTimeout(0x04));
+}
+
+TEST_F(PhotonPollSchedulerTest, statistics_report_cycle_time_and_utilization) {
+  busIO.present = {0x02, 0x03};
+  scheduler.addDevice(0x02, 0);  // Always due, so the bus never has to sit idle
+  scheduler.addDevice(0x03, 0);
+
+  runUntil(1000);
+
+  PollStatistics statistics = scheduler.getStatistics();
+  EXPECT_EQ(currentTime, statistics.elapsedTime);
+  EXPECT_GT(statistics.polls, 4);
+  EXPECT_LE(statistics.polls - statistics.responses, 1);  // The last one might still be out
+  EXPECT_GT(statistics.lastCycleTime, 0);
+  EXPECT_LT(statistics.lastCycleTime, 1000);
+  EXPECT_GT(scheduler.getUtilization(), 90);
+
+  scheduler.resetStatistics();
+  statistics = scheduler.getStatistics();
+  EXPECT_EQ(0, statistics.polls);
+  EXPECT_EQ(0, statistics.elapsedTime);
+}
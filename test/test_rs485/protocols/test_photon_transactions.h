@@ -0,0 +1,252 @@
+#pragma once
+
+#include <gtest/gtest.h>
+#include <vector>
+
+#include "../../fixtures.h"
+#include "../../assertable_bus_io.hpp"
+#include "../test_rs485bus.h"
+#include "rs485/rs485bus.hpp"
+
+#include "rs485/protocols/photon.h"
+#include "rs485/protocols/photon_transactions.h"
+#include "rs485/protocols/checksums/crc8_107.h"
+
+class RecordingTransactionHandler: public PhotonTransactionHandler {
+public:
+  struct Completed {
+    uint8_t toAddress;
+    uint8_t packetId;
+    TransactionResult result;
+    PacketWriteResult writeResult;
+    std::vector<uint8_t> response;
+  };
+
+  virtual void transactionComplete(const PhotonTransaction& transaction, TransactionResult result,
+    PacketWriteResult writeResult, const BufferSegments& response) {
+    std::vector<uint8_t> bytes(response.first, response.first + response.firstLength);
+    bytes.insert(bytes.end(), response.second, response.second + response.secondLength);
+    completed.push_back({transaction.toAddress, transaction.packetId, result, writeResult, bytes});
+  }
+
+  std::vector<Completed> completed;
+};
+
+class CountingPacketHandler: public PacketHandler {
+public:
+  virtual void handlePacket(const RS485BusBase& /*bus*/, const BufferSegments& /*packet*/) {
+    packets++;
+  }
+
+  size_t packets = 0;
+};
+
+class PhotonTransactionsTest : public PrepBus {
+protected:
+  PhotonTransactionsTest(): PrepBus(),
+    bus(busIO, readEnablePin, writeEnablePin),
+    packetizer(bus, protocol),
+    transactions(packetizer, 0x01) {}
+
+  void SetUp() {
+    When(Method(ArduinoFake(), micros)).AlwaysDo([&]()->unsigned long{ return currentTime; });
+  };
+
+  void pollUntilWritten() {
+    for(size_t i = 0; i < 100 && packetizer.queuedPackets() > 0; i++) {
+      transactions.poll();
+    }
+    while(busIO.written() != (size_t) -1);  // We've already checked the echo
+  }
+
+  // Send a response from fromAddress to us with a single byte payload
+  void respond(uint8_t fromAddress, uint8_t packetId, uint8_t payload, uint8_t toAddress = 0x01) {
+    uint8_t header[] = {toAddress, fromAddress, packetId, 0x01};
+    CRC8_107 checksum;
+    for(uint8_t value : header) {
+      checksum.add(value);
+    }
+    checksum.add(payload);
+
+    busIO << header[0] << header[1] << header[2] << header[3] << checksum.getChecksum() << payload;
+  }
+
+  TimeMicroseconds_t currentTime = 0;
+  EchoingBusIO busIO;
+  RS485Bus<16> bus;
+  PhotonProtocol protocol;
+  Packetizer packetizer;
+  PhotonTransactions transactions;
+  RecordingTransactionHandler handler;
+
+  uint8_t firstRequest[6] = {0, 0, 0, 0, 0, 0x42};
+  uint8_t secondRequest[6] = {0, 0, 0, 0, 0, 0x43};
+};
+
+TEST_F(PhotonTransactionsTest, request_fills_in_the_header) {
+  ASSERT_TRUE(transactions.request(0x05, firstRequest, 1, 1000, handler));
+  EXPECT_EQ(1, transactions.outstanding());
+  EXPECT_EQ(1, transactions.outstandingTo(0x05));
+  EXPECT_EQ(0, transactions.outstandingTo(0x06));
+
+  EXPECT_EQ(0x05, firstRequest[0]);
+  EXPECT_EQ(0x01, firstRequest[1]);
+  EXPECT_EQ(0x00, firstRequest[2]);
+  EXPECT_EQ(0x01, firstRequest[3]);
+  EXPECT_EQ(0x42, firstRequest[5]);
+
+  // The protocol agrees the checksum is right
+  busIO.readable<6>({firstRequest[0], firstRequest[1], firstRequest[2], firstRequest[3], firstRequest[4], firstRequest[5]});
+  bus.fetch();
+  EXPECT_EQ(PacketStatus::YES, protocol.isPacket(bus, 0, bus.available() - 1).status);
+}
+
+TEST_F(PhotonTransactionsTest, request_leaves_the_buffer_alone_if_the_write_queue_is_full) {
+  uint8_t other[1] = {0x00};
+  for(size_t i = 0; i < RS485_WRITE_QUEUE_SIZE; i++) {
+    ASSERT_TRUE(packetizer.enqueuePacket(other, 1, nullptr));
+  }
+
+  EXPECT_FALSE(transactions.request(0x05, firstRequest, 1, 1000, handler));
+  EXPECT_EQ(0, transactions.outstanding());
+  for(size_t i = 0; i < 5; i++) {
+    EXPECT_EQ(0x00, firstRequest[i]);
+  }
+  EXPECT_EQ(0x42, firstRequest[5]);
+}
+
+TEST_F(PhotonTransactionsTest, response_completes_the_request) {
+  transactions.request(0x05, firstRequest, 1, 1000, handler);
+  pollUntilWritten();
+  EXPECT_TRUE(handler.completed.empty());
+
+  respond(0x05, firstRequest[2], 0x99);
+  transactions.poll();
+
+  ASSERT_EQ(1, handler.completed.size());
+  EXPECT_EQ(0x05, handler.completed[0].toAddress);
+  EXPECT_EQ(TransactionResult::RESPONDED, handler.completed[0].result);
+  ASSERT_EQ(6, handler.completed[0].response.size());
+  EXPECT_EQ(0x99, handler.completed[0].response[5]);
+  EXPECT_EQ(0, transactions.outstanding());
+  EXPECT_EQ(0, bus.available());
+}
+
+TEST_F(PhotonTransactionsTest, several_requests_can_be_answered_in_any_order) {
+  transactions.request(0x05, firstRequest, 1, 1000, handler);
+  transactions.request(0x06, secondRequest, 1, 1000, handler);
+  EXPECT_NE(firstRequest[2], secondRequest[2]);
+
+  pollUntilWritten();
+  EXPECT_EQ(2, transactions.outstanding());
+
+  respond(0x06, secondRequest[2], 0x66);
+  transactions.poll();
+  respond(0x05, firstRequest[2], 0x55);
+  transactions.poll();
+
+  ASSERT_EQ(2, handler.completed.size());
+  EXPECT_EQ(0x06, handler.completed[0].toAddress);
+  EXPECT_EQ(0x66, handler.completed[0].response[5]);
+  EXPECT_EQ(0x05, handler.completed[1].toAddress);
+  EXPECT_EQ(0x55, handler.completed[1].response[5]);
+}
+
+TEST_F(PhotonTransactionsTest, packets_that_answer_nothing_go_to_the_unmatched_handler) {
+  CountingPacketHandler unmatched;
+  transactions.setUnmatchedPacketHandler(unmatched);
+
+  transactions.request(0x05, firstRequest, 1, 1000, handler);
+  pollUntilWritten();
+
+  respond(0x06, firstRequest[2], 0x00);  // Wrong feeder
+  transactions.poll();
+  respond(0x05, firstRequest[2] + 1, 0x00);  // Wrong packet ID
+  transactions.poll();
+  respond(0x05, firstRequest[2], 0x00, 0x02);  // Not to us
+  transactions.poll();
+
+  EXPECT_EQ(3, unmatched.packets);
+  EXPECT_TRUE(handler.completed.empty());
+  EXPECT_EQ(1, transactions.outstanding());
+}
+
+TEST_F(PhotonTransactionsTest, response_before_the_write_is_verified_answers_nothing) {
+  CountingPacketHandler unmatched;
+  transactions.setUnmatchedPacketHandler(unmatched);
+
+  transactions.request(0x05, firstRequest, 1, 1000, handler);
+  ASSERT_EQ(1, packetizer.queuedPackets());
+
+  // Header and all, this looks just like the answer, but the request hasn't been written yet
+  uint8_t early[6] = {0x01, 0x05, firstRequest[2], 0x01, 0x00, 0x99};
+  BufferSegments earlySegments = {early, 6, nullptr, 0};
+  transactions.handlePacket(bus, earlySegments);
+
+  EXPECT_EQ(1, unmatched.packets);
+  EXPECT_TRUE(handler.completed.empty());
+  EXPECT_EQ(1, transactions.outstanding());
+
+  pollUntilWritten();
+  EXPECT_TRUE(handler.completed.empty());
+
+  respond(0x05, firstRequest[2], 0x99);
+  transactions.poll();
+  ASSERT_EQ(1, handler.completed.size());
+  EXPECT_EQ(TransactionResult::RESPONDED, handler.completed[0].result);
+}
+
+TEST_F(PhotonTransactionsTest, request_times_out_from_the_end_of_the_write) {
+  transactions.request(0x05, firstRequest, 1, 100, handler);
+
+  currentTime = 500;
+  pollUntilWritten();  // Written at 500, so it has until 600
+
+  currentTime = 600;
+  transactions.poll();
+  EXPECT_TRUE(handler.completed.empty());
+
+  currentTime = 601;
+  transactions.poll();
+  ASSERT_EQ(1, handler.completed.size());
+  EXPECT_EQ(TransactionResult::TIMED_OUT, handler.completed[0].result);
+  EXPECT_TRUE(handler.completed[0].response.empty());
+  EXPECT_EQ(0, transactions.outstanding());
+
+  // Too late now
+  respond(0x05, firstRequest[2], 0x00);
+  transactions.poll();
+  EXPECT_EQ(1, handler.completed.size());
+}
+
+TEST_F(PhotonTransactionsTest, failed_write_completes_the_request) {
+  busIO.corruptIndex = 1;
+  transactions.request(0x05, firstRequest, 1, 1000, handler);
+  pollUntilWritten();
+
+  ASSERT_EQ(1, handler.completed.size());
+  EXPECT_EQ(TransactionResult::WRITE_FAILED, handler.completed[0].result);
+  EXPECT_NE(PacketWriteResult::OK, handler.completed[0].writeResult);
+  EXPECT_EQ(0, transactions.outstanding());
+}
+
+TEST_F(PhotonTransactionsTest, packet_ids_are_not_reused_while_outstanding) {
+  uint8_t packets[RS485_PHOTON_TRANSACTIONS][6];
+  std::vector<bool> used(256, false);
+
+  for(size_t i = 0; i < RS485_PHOTON_TRANSACTIONS; i++) {
+    ASSERT_TRUE(transactions.request(0x05, packets[i], 1, 1000, handler));
+    EXPECT_FALSE(used[packets[i][2]]);
+    used[packets[i][2]] = true;
+    pollUntilWritten();
+  }
+
+  EXPECT_FALSE(transactions.request(0x05, firstRequest, 1, 1000, handler));  // No room left
+
+  respond(0x05, packets[0][2], 0x00);
+  transactions.poll();
+
+  // That one's free again, but gets a different ID than last time
+  ASSERT_TRUE(transactions.request(0x05, firstRequest, 1, 1000, handler));
+  EXPECT_FALSE(used[firstRequest[2]]);
+}
@@ -0,0 +1,156 @@
+#pragma once
+
+#include <gtest/gtest.h>
+
+#include "../assertable_bus_io.hpp"
+#include "../fixtures.h"
+
+#include "rs485/arrival_times.h"
+#include "rs485/rs485bus.hpp"
+
+class ArrivalTimesTest : public ::testing::Test {
+public:
+  ArrivalTimesTest():
+    arrivalTimes(chunks, 3) {}
+
+  TimeMicroseconds_t timeOf(size_t index) {
+    TimeMicroseconds_t time = 0;
+    EXPECT_TRUE(arrivalTimes.getTime(index, time)) << "index " << index;
+    return time;
+  }
+
+  ArrivalChunk chunks[3];
+  ArrivalTimes arrivalTimes;
+};
+
+TEST_F(ArrivalTimesTest, nothing_recorded_has_no_time) {
+  TimeMicroseconds_t time;
+  EXPECT_FALSE(arrivalTimes.getTime(0, time));
+  EXPECT_EQ(0, arrivalTimes.size());
+  EXPECT_EQ(0, arrivalTimes.chunks());
+}
+
+TEST_F(ArrivalTimesTest, each_byte_gets_the_time_of_its_chunk) {
+  arrivalTimes.record(2, 100);
+  arrivalTimes.record(3, 200);
+
+  EXPECT_EQ(5, arrivalTimes.size());
+  EXPECT_EQ(2, arrivalTimes.chunks());
+  EXPECT_EQ(100, timeOf(0));
+  EXPECT_EQ(100, timeOf(1));
+  EXPECT_EQ(200, timeOf(2));
+  EXPECT_EQ(200, timeOf(4));
+
+  TimeMicroseconds_t time;
+  EXPECT_FALSE(arrivalTimes.getTime(5, time));
+}
+
+TEST_F(ArrivalTimesTest, same_time_extends_the_last_chunk) {
+  arrivalTimes.record(2, 100);
+  arrivalTimes.record(1, 100);
+
+  EXPECT_EQ(3, arrivalTimes.size());
+  EXPECT_EQ(1, arrivalTimes.chunks());
+}
+
+TEST_F(ArrivalTimesTest, discard_drops_the_oldest_bytes) {
+  arrivalTimes.record(2, 100);
+  arrivalTimes.record(3, 200);
+
+  arrivalTimes.discard(1);
+  EXPECT_EQ(4, arrivalTimes.size());
+  EXPECT_EQ(100, timeOf(0));
+  EXPECT_EQ(200, timeOf(1));
+
+  arrivalTimes.discard(2);
+  EXPECT_EQ(2, arrivalTimes.size());
+  EXPECT_EQ(1, arrivalTimes.chunks());
+  EXPECT_EQ(200, timeOf(0));
+
+  arrivalTimes.discard(10);
+  EXPECT_EQ(0, arrivalTimes.size());
+  EXPECT_EQ(0, arrivalTimes.chunks());
+}
+
+TEST_F(ArrivalTimesTest, oldest_chunks_merge_when_full) {
+  arrivalTimes.record(1, 100);
+  arrivalTimes.record(1, 200);
+  arrivalTimes.record(1, 300);
+  arrivalTimes.record(1, 400);
+
+  EXPECT_EQ(4, arrivalTimes.size());
+  EXPECT_EQ(3, arrivalTimes.chunks());
+  EXPECT_EQ(100, timeOf(0));
+  EXPECT_EQ(100, timeOf(1));  // Looks older than it is
+  EXPECT_EQ(300, timeOf(2));
+  EXPECT_EQ(400, timeOf(3));  // The newest are still exact
+}
+
+class RS485BusArrivalTimesTest : public PrepBus {
+public:
+  RS485BusArrivalTimesTest(): PrepBus(),
+    bus(busIO, readEnablePin, writeEnablePin) {}
+
+  void SetUp() {
+    When(Method(ArduinoFake(), micros)).AlwaysDo([&]()->unsigned long{ return currentTime; });
+  }
+
+  TimeMicroseconds_t currentTime = 0;
+  AssertableBusIO busIO;
+  RS485Bus<8> bus;
+  SizedArrivalTimes<4> arrivalTimes;
+};
+
+TEST_F(RS485BusArrivalTimesTest, no_times_without_arrival_times) {
+  busIO << 0x01;
+  bus.fetch();
+
+  TimeMicroseconds_t time;
+  EXPECT_FALSE(bus.getArrivalTime(0, time));
+}
+
+TEST_F(RS485BusArrivalTimesTest, fetched_bytes_are_timed_per_fetch) {
+  bus.setArrivalTimes(arrivalTimes);
+
+  currentTime = 100;
+  busIO << 0x01 << 0x02;
+  bus.fetch();
+  currentTime = 250;
+  busIO << 0x03;
+  bus.fetch();
+
+  EXPECT_EQ(2, arrivalTimes.chunks());
+
+  TimeMicroseconds_t time;
+  ASSERT_TRUE(bus.getArrivalTime(1, time));
+  EXPECT_EQ(100, time);
+  ASSERT_TRUE(bus.getArrivalTime(2, time));
+  EXPECT_EQ(250, time);
+  EXPECT_FALSE(bus.getArrivalTime(3, time));
+
+  bus.read();
+  bus.discard(1);
+  ASSERT_TRUE(bus.getArrivalTime(0, time));
+  EXPECT_EQ(250, time);
+  EXPECT_EQ(1, arrivalTimes.size());
+}
+
+TEST_F(RS485BusArrivalTimesTest, bytes_from_before_are_not_timed) {
+  busIO << 0x01;
+  bus.fetch();
+
+  bus.setArrivalTimes(arrivalTimes);
+  currentTime = 100;
+  busIO << 0x02;
+  bus.fetch();
+
+  TimeMicroseconds_t time;
+  EXPECT_FALSE(bus.getArrivalTime(0, time));
+  ASSERT_TRUE(bus.getArrivalTime(1, time));
+  EXPECT_EQ(100, time);
+
+  bus.discard(1);  // Only the untimed byte goes
+  EXPECT_EQ(1, arrivalTimes.size());
+  ASSERT_TRUE(bus.getArrivalTime(0, time));
+  EXPECT_EQ(100, time);
+}
@@ -44,6 +44,30 @@ TEST_F(AssertableBusIOTest, asserting_written_bytes) {
 
   EXPECT_EQ(0, busIO.available());
 
+  EXPECT_EQ(1, busIO.written());
+  EXPECT_EQ(2, busIO.written());
+  EXPECT_EQ(3, busIO.written());
+  EXPECT_EQ(-1, busIO.written());
+}
+
+TEST_F(AssertableBusIOTest, reading_multiple_bytes_at_once) {
+  busIO << 1 << 2 << 3;
+
+  uint8_t buffer[4] = {0, 0, 0, 0};
+  EXPECT_EQ(2, busIO.readBytes(buffer, 2));
+  EXPECT_EQ(1, buffer[0]);
+  EXPECT_EQ(2, buffer[1]);
+  EXPECT_EQ(1, busIO.available());
+
+  EXPECT_EQ(1, busIO.readBytes(buffer, 4));  // Only 1 byte left
+  EXPECT_EQ(3, buffer[0]);
+  EXPECT_EQ(0, busIO.available());
+}
+
+TEST_F(AssertableBusIOTest, writing_multiple_bytes_at_once) {
+  uint8_t buffer[3] = {1, 2, 3};
+  busIO.writeBytes(buffer, 3);
+
   EXPECT_EQ(1, busIO.written());
   EXPECT_EQ(2, busIO.written());
   EXPECT_EQ(3, busIO.written());
@@ -0,0 +1,259 @@
+#pragma once
+
+#include "rs485/coroutines.h"
+
+#if defined(__cpp_impl_coroutine)
+
+#include "../assertable_bus_io.hpp"
+#include "../matching_bytes.h"
+#include "../fixtures.h"
+
+#include <gtest/gtest.h>
+#include <vector>
+#include "fakeit/fakeit.hpp"
+
+#include "rs485/rs485bus.hpp"
+#include "rs485/packetizer.h"
+#include "rs485/filters/filter_by_value.h"
+
+using namespace fakeit;
+
+// Every byte written shows right back up to be read, like a real transceiver with its receiver left on
+class EchoBusIO: public AssertableBusIO {
+public:
+  virtual void write(uint8_t value) {
+    AssertableBusIO::write(value);
+    readable(value);
+  }
+
+  virtual void writeBytes(const uint8_t* buffer, size_t length) {
+    AssertableBusIO::writeBytes(buffer, length);
+    for(size_t i = 0; i < length; i++) {
+      readable(buffer[i]);
+    }
+  }
+};
+
+static std::vector<uint8_t> bytesOf(const BufferSegments& packet) {
+  std::vector<uint8_t> bytes(packet.first, packet.first + packet.firstLength);
+  bytes.insert(bytes.end(), packet.second, packet.second + packet.secondLength);
+  return bytes;
+}
+
+class CoroutineTest : public PrepBus {
+protected:
+  CoroutineTest(): PrepBus(),
+    bus(busIO, readEnablePin, writeEnablePin),
+    packetizer(bus, protocol),
+    scheduler(packetizer) {}
+
+  void SetUp() {
+    When(Method(ArduinoFake(), micros)).AlwaysDo([&]()->unsigned long{ return currentTime; });
+  }
+
+  // Writes go out a byte per poll and are verified on the next one
+  void pollTimes(size_t count) {
+    for(size_t i = 0; i < count; i++) {
+      scheduler.poll();
+    }
+  }
+
+  TimeMicroseconds_t currentTime = 0;
+  EchoBusIO busIO;
+  ProtocolMatchingBytes protocol;
+  RS485Bus<8> bus;
+  Packetizer packetizer;
+  PacketScheduler scheduler;
+};
+
+PacketTask waitForPacket(PacketScheduler& scheduler, const Filter* filter, TimeMicroseconds_t timeout,
+  std::vector<uint8_t>& received, bool& done) {
+  BufferSegments packet = co_await scheduler.nextPacket(filter, timeout);
+  received = bytesOf(packet);
+  done = true;
+}
+
+PacketTask sendPacket(PacketScheduler& scheduler, const uint8_t* buffer, size_t bufferSize, PacketWriteResult& result,
+  bool& done) {
+  result = co_await scheduler.writePacket(buffer, bufferSize);
+  done = true;
+}
+
+PacketTask throwAfterPacket(PacketScheduler& scheduler) {
+  co_await scheduler.nextPacket();
+  throw 1;
+}
+
+PacketTask sendRequest(PacketScheduler& scheduler, const uint8_t* buffer, size_t bufferSize, RequestResult& result,
+  std::vector<uint8_t>& received, bool& done) {
+  result = co_await scheduler.request(buffer, bufferSize, nullptr, 100);
+  received = bytesOf(result.packet);
+  done = true;
+}
+
+TEST_F(CoroutineTest, next_packet_resumes_with_the_packet) {
+  std::vector<uint8_t> received;
+  bool done = false;
+  ASSERT_TRUE(waitForPacket(scheduler, nullptr, -1, received, done).isValid());
+
+  scheduler.poll();
+  EXPECT_FALSE(done);
+
+  busIO << 0x02 << 0x02;
+  scheduler.poll();
+
+  ASSERT_TRUE(done);
+  EXPECT_EQ(std::vector<uint8_t>({0x02, 0x02}), received);
+  EXPECT_EQ(0, bus.available());
+}
+
+TEST_F(CoroutineTest, next_packet_resumes_empty_after_timeout) {
+  std::vector<uint8_t> received;
+  bool done = false;
+  waitForPacket(scheduler, nullptr, 100, received, done);
+
+  currentTime = 100;
+  scheduler.poll();
+  EXPECT_FALSE(done);
+
+  currentTime = 101;
+  scheduler.poll();
+
+  ASSERT_TRUE(done);
+  EXPECT_TRUE(received.empty());
+}
+
+TEST_F(CoroutineTest, packets_go_to_the_waiter_whose_filter_accepts_them) {
+  FilterByValue onlyFours;
+  onlyFours.postValues.allow(0x04);
+
+  std::vector<uint8_t> firstReceived;
+  bool firstDone = false;
+  waitForPacket(scheduler, &onlyFours, -1, firstReceived, firstDone);
+
+  std::vector<uint8_t> secondReceived;
+  bool secondDone = false;
+  waitForPacket(scheduler, nullptr, -1, secondReceived, secondDone);
+
+  busIO << 0x02 << 0x02;
+  scheduler.poll();
+
+  EXPECT_FALSE(firstDone);
+  ASSERT_TRUE(secondDone);
+  EXPECT_EQ(std::vector<uint8_t>({0x02, 0x02}), secondReceived);
+
+  busIO << 0x04 << 0x04;
+  scheduler.poll();
+
+  ASSERT_TRUE(firstDone);
+  EXPECT_EQ(std::vector<uint8_t>({0x04, 0x04}), firstReceived);
+}
+
+TEST_F(CoroutineTest, request_writes_and_then_waits_for_the_response) {
+  uint8_t request[] = {0x07, 0x09};
+  RequestResult result;
+  std::vector<uint8_t> received;
+  bool done = false;
+  sendRequest(scheduler, request, sizeof(request), result, received, done);
+
+  EXPECT_EQ(-1, busIO.written());  // Nothing is written until the scheduler is polled
+
+  pollTimes(3);
+  EXPECT_FALSE(done);
+  EXPECT_EQ(0x07, busIO.written());
+  EXPECT_EQ(0x09, busIO.written());
+
+  busIO << 0x04 << 0x04;
+  scheduler.poll();
+
+  ASSERT_TRUE(done);
+  EXPECT_EQ(PacketWriteResult::OK, result.writeResult);
+  EXPECT_EQ(std::vector<uint8_t>({0x04, 0x04}), received);
+}
+
+TEST_F(CoroutineTest, request_times_out_from_the_end_of_the_write) {
+  uint8_t request[] = {0x07};
+  RequestResult result;
+  std::vector<uint8_t> received;
+  bool done = false;
+  sendRequest(scheduler, request, sizeof(request), result, received, done);
+
+  currentTime = 500;
+  pollTimes(2);  // Written at 500, so it has until 600
+  EXPECT_FALSE(done);
+
+  currentTime = 601;
+  scheduler.poll();
+
+  ASSERT_TRUE(done);
+  EXPECT_EQ(PacketWriteResult::OK, result.writeResult);
+  EXPECT_TRUE(received.empty());
+}
+
+TEST_F(CoroutineTest, writes_never_block_the_poll) {
+  uint8_t packet[] = {0x01, 0x03, 0x05};
+  PacketWriteResult result = PacketWriteResult::FAILED_TIMEOUT;
+  bool done = false;
+  sendPacket(scheduler, packet, sizeof(packet), result, done);
+
+  scheduler.poll();
+  EXPECT_EQ(0x01, busIO.written());
+  EXPECT_EQ(-1, busIO.written());  // The next byte waits for this one to be read back
+  EXPECT_FALSE(done);
+
+  pollTimes(2);
+  EXPECT_EQ(0x03, busIO.written());
+  EXPECT_EQ(0x05, busIO.written());
+  EXPECT_FALSE(done);
+
+  scheduler.poll();
+  ASSERT_TRUE(done);
+  EXPECT_EQ(PacketWriteResult::OK, result);
+  EXPECT_EQ(0, packetizer.queuedPackets());
+}
+
+TEST_F(CoroutineTest, writes_past_the_packetizer_queue_wait_their_turn) {
+  uint8_t packet[] = {0x01};
+  PacketWriteResult results[RS485_WRITE_QUEUE_SIZE + 1];
+  bool done[RS485_WRITE_QUEUE_SIZE + 1] = {};
+  for(size_t i = 0; i <= RS485_WRITE_QUEUE_SIZE; i++) {
+    sendPacket(scheduler, packet, sizeof(packet), results[i], done[i]);
+  }
+
+  pollTimes(2 * (RS485_WRITE_QUEUE_SIZE + 1));
+
+  for(size_t i = 0; i <= RS485_WRITE_QUEUE_SIZE; i++) {
+    ASSERT_TRUE(done[i]);
+    EXPECT_EQ(PacketWriteResult::OK, results[i]);
+  }
+}
+
+TEST_F(CoroutineTest, escaped_exceptions_terminate) {
+  EXPECT_DEATH({
+    throwAfterPacket(scheduler);
+    busIO << 0x02 << 0x02;
+    scheduler.poll();
+  }, "");
+}
+
+TEST_F(CoroutineTest, frames_come_from_the_frame_allocator) {
+  FramePool<1024, 1> pool;
+  PacketScheduler pooledScheduler(packetizer, &pool);
+
+  std::vector<uint8_t> firstReceived;
+  bool firstDone = false;
+  EXPECT_TRUE(waitForPacket(pooledScheduler, nullptr, -1, firstReceived, firstDone).isValid());
+
+  std::vector<uint8_t> secondReceived;
+  bool secondDone = false;
+  EXPECT_FALSE(waitForPacket(pooledScheduler, nullptr, -1, secondReceived, secondDone).isValid());  // No room left
+
+  busIO << 0x02 << 0x02;
+  pooledScheduler.poll();
+  ASSERT_TRUE(firstDone);
+
+  // The first one finished, so its frame can be used again
+  EXPECT_TRUE(waitForPacket(pooledScheduler, nullptr, -1, secondReceived, secondDone).isValid());
+}
+
+#endif
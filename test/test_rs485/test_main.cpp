@@ -6,10 +6,14 @@
 
 // Core code
 #include "test_rs485bus.h"
+#include "test_rs485bus_mirrored.h"
+#include "test_rejection_bitmap.h"
+#include "test_arrival_times.h"
 #include "test_packetizer_read.h"
 #include "test_packetizer_read_with_fetch.h"
 #include "test_packetizer_write.h"
 #include "test_packetizer_filter.h"
+#include "test_coroutines.h"
 
 // Filters
 #include "filters/test_filter_by_value.h"
@@ -17,6 +21,16 @@
 
 // Protocols
 #include "protocols/test_photon.h"
+#include "protocols/test_photon_transactions.h"
+#include "protocols/test_photon_poll_scheduler.h"
+#include "protocols/test_modbus_rtu.h"
+#include "protocols/test_modbus_ascii.h"
+#include "protocols/checksums/test_crc.h"
+#include "protocols/checksums/test_crc8_107.h"
+#include "protocols/checksums/test_modbus_rtu.h"
+
+// Bus Adapters
+#include "bus_adapters/test_posix_serial.h"
 
 int main(int argc, char **argv)
 {
@@ -5,10 +5,14 @@
 #include "../fixtures.h"
 
 #include <gtest/gtest.h>
+#include <vector>
 #include "fakeit/fakeit.hpp"
 
 #include "rs485/rs485bus.hpp"
 #include "rs485/packetizer.h"
+#include "rs485/sized_packetizer.hpp"
+#include "rs485/protocols/photon.h"
+#include "rs485/protocols/checksums/crc8_107.h"
 
 using namespace fakeit;
 
@@ -72,17 +76,32 @@ class PacketizerReadBusBigTest : public PacketizerReadTest {
 protected:
   PacketizerReadBusBigTest(): PacketizerReadTest(),
     bus(busIO, readEnablePin, writeEnablePin),
-    packetizer(bus, protocol) {
+    packetizer(static_cast<RS485BusBase&>(bus), protocol) {  // Only remembering 64 bytes is the point here
     }
 
   virtual Packetizer* getPacketizer() { return &packetizer; }
 
-  constexpr static size_t u64Size = sizeof(uint64_t) * 8;  // Needs to match the date type used for recheckBitmap in Packetizer
+  constexpr static size_t u64Size = sizeof(uint64_t) * 8;  // Needs to match how many rejected bytes a plain Packetizer remembers
   constexpr static size_t bufferSize = u64Size + 20;  // uint64_t size + 20 should be good enough for all the tests
   RS485Bus<bufferSize> bus;
   Packetizer packetizer;
 };
 
+class PacketizerReadSizedBusBigTest : public PacketizerReadTest {
+protected:
+  PacketizerReadSizedBusBigTest(): PacketizerReadTest(),
+    bus(busIO, readEnablePin, writeEnablePin),
+    packetizer(bus, protocol) {
+    }
+
+  virtual Packetizer* getPacketizer() { return &packetizer; }
+
+  constexpr static size_t u64Size = sizeof(uint64_t) * 8;  // Same bus as PacketizerReadBusBigTest
+  constexpr static size_t bufferSize = u64Size + 20;
+  RS485Bus<bufferSize> bus;
+  SizedPacketizer<bufferSize> packetizer;
+};
+
 TEST_F(PacketizerReadBusTest, by_default_no_packets_are_available) {
   EXPECT_FALSE(packetizer.hasPacketNow());
   expectNoPacket();
@@ -282,6 +301,77 @@ TEST_F(PacketizerReadBusBigTest, no_bytes_past_our_limit_get_rechecked) {
   VerifyNoOtherInvocations(Method(protocolSpy, isPacket));
 }
 
+TEST_F(PacketizerReadSizedBusBigTest, no_bytes_past_64_do_not_get_rechecked) {
+  constexpr size_t u64Size = PacketizerReadSizedBusBigTest::u64Size;
+
+  // Same bus as no_bytes_past_our_limit_get_rechecked, but this packetizer can remember the whole buffer
+  busIO << 0;
+  for(size_t i = 0; i < u64Size; i++) {
+    busIO << 2 * i + 1;
+  }
+
+  bus.fetch();
+
+  ASSERT_FALSE(packetizer.hasPacketNow());
+  EXPECT_EQ(u64Size + 1, bus.available());
+  expectNoPacket();
+
+  for(size_t i = 0; i <= u64Size; i++) {
+    Verify(Method(protocolSpy, isPacket).Using(_, i, u64Size)).Once();
+  }
+  VerifyNoOtherInvocations(Method(protocolSpy, isPacket));
+
+  busIO << 255;
+  bus.fetch();
+
+  ASSERT_FALSE(packetizer.hasPacketNow());
+  EXPECT_EQ(u64Size + 2, bus.available());
+  expectNoPacket();
+
+  // Only our "not enough bytes" at (0) and the new byte at (u64Size + 1) get checked this time
+  Verify(
+    Method(protocolSpy, isPacket).Using(_, 0, u64Size + 1),
+    Method(protocolSpy, isPacket).Using(_, u64Size + 1, u64Size + 1)
+  ).Once();
+  VerifyNoOtherInvocations(Method(protocolSpy, isPacket));
+}
+
+TEST_F(PacketizerReadSizedBusBigTest, rejected_bytes_are_remembered_after_bytes_are_discarded) {
+  constexpr size_t bufferSize = PacketizerReadSizedBusBigTest::bufferSize;
+  constexpr size_t firstOddBytes = bufferSize - 14;
+
+  // Two "not enough bytes" up front, then enough "no" bytes to run past the first 64
+  busIO << 0x04 << 0x06;
+  for(size_t i = 0; i < firstOddBytes; i++) {
+    busIO << 2 * i + 1;
+  }
+  bus.fetch();
+
+  ASSERT_FALSE(packetizer.hasPacketNow());
+  ASSERT_EQ(firstOddBytes + 2, bus.available());
+
+  // Fill the bus up so 0x04 gets thrown out and everything we know about moves down by one
+  for(size_t i = firstOddBytes; i < bufferSize - 2; i++) {
+    busIO << 2 * i + 1;
+  }
+  bus.fetch();
+  ASSERT_TRUE(bus.isBufferFull());
+
+  ASSERT_FALSE(packetizer.hasPacketNow());
+  ASSERT_EQ(bufferSize - 1, bus.available());
+
+  // After 0x04 is gone, 0x06 is checked again along with the new bytes. None of the old "no" bytes are.
+  Verify(Method(protocolSpy, isPacket).Using(_, 0, bufferSize - 1)).Once();
+  Verify(Method(protocolSpy, isPacket).Using(_, 0, bufferSize - 2)).Once();
+  for(size_t i = 1; i < bufferSize - 1; i++) {
+    if(i <= firstOddBytes) {
+      Verify(Method(protocolSpy, isPacket).Using(_, i, bufferSize - 2)).Never();
+    } else {
+      Verify(Method(protocolSpy, isPacket).Using(_, i, bufferSize - 2)).Once();
+    }
+  }
+}
+
 TEST_F(PacketizerReadBus3Test, can_get_packet_even_if_it_is_past_bus_size_if_bytes_are_shifted) {
   // This format and bus size is specifically so already checked "no" bytes do get removed if they're at the beginning
   busIO << 0x01 << 0x02 << 0x03 << 0x04 << 0x06 << 0x06;
@@ -369,6 +459,56 @@ TEST_F(PacketizerReadBus3Test, can_get_packet_even_if_it_is_past_bus_size_if_byt
   EXPECT_EQ(-1, bus[0]);
 }
 
+TEST_F(PacketizerReadBusTest, clearing_a_packet_discards_it_in_one_step) {
+  Mock<RS485Bus<8>> busSpy(bus);
+  Spy(Method(busSpy, discard));
+
+  busIO << 0x02 << 0x03 << 0x02 << 0x04;
+  bus.fetch();
+
+  ASSERT_TRUE(packetizer.hasPacketNow());
+  expectPacket(0, 2);
+
+  packetizer.clearPacket();
+
+  Verify(Method(busSpy, discard).Using(3)).Once();
+  VerifyNoOtherInvocations(Method(busSpy, discard));
+
+  ASSERT_EQ(1, bus.available());
+  EXPECT_EQ(0x04, bus[0]);
+}
+
+TEST_F(PacketizerReadBusTest, already_rejected_bytes_are_discarded_with_rejected_first_byte) {
+  Mock<RS485Bus<8>> busSpy(bus);
+  Spy(Method(busSpy, discard));
+
+  // 0x04 is "not enough bytes", so it stays. The "no" bytes after it are remembered.
+  busIO << 0x04 << 0x01 << 0x03 << 0x05;
+  bus.fetch();
+
+  ASSERT_FALSE(packetizer.hasPacketNow());
+  ASSERT_EQ(4, bus.available());
+  VerifyNoOtherInvocations(Method(busSpy, discard));
+
+  // Filling the buffer means 0x04 gets thrown out. The 3 bytes we already know are "no" go with it.
+  busIO << 0x07 << 0x09 << 0x0B << 0x0D;
+  bus.fetch();
+
+  ASSERT_FALSE(packetizer.hasPacketNow());
+  expectNoPacket();
+
+  Verify(
+    Method(busSpy, discard).Using(4),  // 0x04 0x01 0x03 0x05
+    Method(busSpy, discard).Using(1),  // 0x07
+    Method(busSpy, discard).Using(1),  // 0x09
+    Method(busSpy, discard).Using(1),  // 0x0B
+    Method(busSpy, discard).Using(1)   // 0x0D
+  ).Once();
+  VerifyNoOtherInvocations(Method(busSpy, discard));
+
+  EXPECT_EQ(0, bus.available());
+}
+
 TEST_F(PacketizerReadBusTest, has_packet_now_returns_outer_packet_if_new_bytes_are_available) {
   busIO << 0x08 << 0x02 << 0x02;
 
@@ -398,6 +538,457 @@ TEST_F(PacketizerReadBusTest, has_packet_now_returns_outer_packet_if_new_bytes_a
   EXPECT_EQ(-1, bus[1]);
 }
 
+TEST_F(PacketizerReadBusTest, packet_past_start_of_bus_is_not_tested_again_when_new_bytes_come_in) {
+  busIO << 0x08 << 0x02 << 0x02;
+  bus.fetch();
+
+  ASSERT_TRUE(packetizer.hasPacketNow());
+  expectPacket(1, 2);
+
+  Verify(
+    Method(protocolSpy, isPacket).Using(_, 0, 2),  // 0x08 -> NOT_ENOUGH_BYTES
+    Method(protocolSpy, isPacket).Using(_, 1, 2)   // 0x02 0x02 -> YES
+  ).Once();
+  VerifyNoOtherInvocations(Method(protocolSpy, isPacket));
+
+  busIO << 0x05;  // Doesn't finish the 0x08 packet
+  bus.fetch();
+
+  ASSERT_TRUE(packetizer.hasPacketNow());
+  expectPacket(1, 2);
+
+  // Only the "not enough bytes" in front of our packet needs another look
+  Verify(Method(protocolSpy, isPacket).Using(_, 0, 3)).Once();
+  Verify(Method(protocolSpy, isPacket).Using(_, 1, 3)).Never();
+  VerifyNoOtherInvocations(Method(protocolSpy, isPacket));
+
+  busIO << 0x08;  // Now the outer packet is done, and it wins
+  bus.fetch();
+
+  ASSERT_TRUE(packetizer.hasPacketNow());
+  expectPacket(0, 4);
+
+  packetizer.clearPacket();
+
+  ASSERT_FALSE(packetizer.hasPacketNow());
+  expectNoPacket();
+  ASSERT_EQ(0, bus.available());
+}
+
+TEST_F(PacketizerReadBusTest, find_packets_collects_back_to_back_packets) {
+  Mock<RS485Bus<8>> busSpy(bus);
+  Spy(Method(busSpy, discard));
+
+  busIO << 0x02 << 0x02 << 0x04 << 0x04 << 0x06 << 0x06;
+  bus.fetch();
+
+  Packet storage[4];
+  PacketBatch batch = packetizer.findPackets(storage, 4);
+
+  ASSERT_EQ(3, batch.size());
+  EXPECT_EQ(0, batch[0].startIndex);
+  EXPECT_EQ(1, batch[0].endIndex);
+  EXPECT_EQ(2, batch[1].startIndex);
+  EXPECT_EQ(3, batch[1].endIndex);
+  EXPECT_EQ(4, batch[2].startIndex);
+  EXPECT_EQ(5, batch[2].endIndex);
+
+  size_t packetsSeen = 0;
+  for(const Packet& packet : batch) {
+    EXPECT_EQ(bus[packet.startIndex], bus[packet.endIndex]);
+    packetsSeen++;
+  }
+  EXPECT_EQ(3, packetsSeen);
+
+  packetizer.clearPackets(batch);
+
+  Verify(Method(busSpy, discard).Using(6)).Once();
+  VerifyNoOtherInvocations(Method(busSpy, discard));
+  EXPECT_EQ(0, bus.available());
+
+  ASSERT_FALSE(packetizer.hasPacketNow());
+}
+
+TEST_F(PacketizerReadBusTest, find_packets_skips_rejected_bytes_between_packets) {
+  busIO << 0x02 << 0x02 << 0x01 << 0x03 << 0x04 << 0x04;
+  bus.fetch();
+
+  Packet storage[4];
+  PacketBatch batch = packetizer.findPackets(storage, 4);
+
+  ASSERT_EQ(2, batch.size());
+  EXPECT_EQ(0, batch[0].startIndex);
+  EXPECT_EQ(1, batch[0].endIndex);
+  EXPECT_EQ(4, batch[1].startIndex);
+  EXPECT_EQ(5, batch[1].endIndex);
+}
+
+TEST_F(PacketizerReadBusTest, find_packets_stops_at_a_candidate_that_needs_more_bytes) {
+  busIO << 0x02 << 0x02 << 0x08 << 0x04 << 0x04;
+  bus.fetch();
+
+  Packet storage[4];
+  PacketBatch batch = packetizer.findPackets(storage, 4);
+
+  // 0x04 0x04 could be the inside of a packet that starts with 0x08
+  ASSERT_EQ(1, batch.size());
+  EXPECT_EQ(0, batch[0].startIndex);
+  EXPECT_EQ(1, batch[0].endIndex);
+
+  packetizer.clearPackets(batch);
+
+  ASSERT_EQ(3, bus.available());
+  EXPECT_EQ(0x08, bus[0]);
+}
+
+TEST_F(PacketizerReadBusTest, find_packets_starts_with_the_same_packet_as_get_packet) {
+  busIO << 0x08 << 0x02 << 0x02 << 0x04 << 0x04;
+  bus.fetch();
+
+  Packet storage[4];
+  PacketBatch batch = packetizer.findPackets(storage, 4);
+
+  ASSERT_EQ(2, batch.size());
+  EXPECT_EQ(1, batch[0].startIndex);
+  EXPECT_EQ(2, batch[0].endIndex);
+  EXPECT_EQ(3, batch[1].startIndex);
+  EXPECT_EQ(4, batch[1].endIndex);
+  expectPacket(1, 2);
+
+  packetizer.clearPackets(batch);
+
+  EXPECT_EQ(0, bus.available());
+}
+
+TEST_F(PacketizerReadBusTest, find_packets_stops_when_storage_is_full) {
+  busIO << 0x02 << 0x02 << 0x04 << 0x04 << 0x06 << 0x06;
+  bus.fetch();
+
+  Packet storage[2];
+  PacketBatch batch = packetizer.findPackets(storage, 2);
+
+  ASSERT_EQ(2, batch.size());
+  EXPECT_EQ(3, batch[1].endIndex);
+
+  packetizer.clearPackets(batch);
+
+  ASSERT_EQ(2, bus.available());
+  EXPECT_EQ(0x06, bus[0]);
+}
+
+TEST_F(PacketizerReadBusTest, find_packets_with_no_packet) {
+  busIO << 0x08 << 0x01;
+  bus.fetch();
+
+  Packet storage[2];
+  PacketBatch batch = packetizer.findPackets(storage, 2);
+
+  EXPECT_TRUE(batch.empty());
+  EXPECT_EQ(batch.begin(), batch.end());
+
+  packetizer.clearPackets(batch);
+  EXPECT_EQ(2, bus.available());
+}
+
+// Copies out every packet it's handed so the test can look at them after poll returns
+class RecordingPacketHandler: public PacketHandler {
+public:
+  virtual void handlePacket(const RS485BusBase& /*bus*/, const BufferSegments& packet) {
+    std::vector<uint8_t> bytes(packet.first, packet.first + packet.firstLength);
+    bytes.insert(bytes.end(), packet.second, packet.second + packet.secondLength);
+    packets.push_back(bytes);
+  }
+
+  std::vector<std::vector<uint8_t>> packets;
+};
+
+TEST_F(PacketizerReadBusTest, poll_hands_every_packet_to_the_handler) {
+  When(Method(ArduinoFake(), micros)).AlwaysReturn(0);
+  RecordingPacketHandler handler;
+  packetizer.setPacketHandler(handler);
+
+  busIO << 0x02 << 0x02 << 0x01 << 0x04 << 0x04;
+
+  ASSERT_EQ(2, packetizer.poll());
+
+  ASSERT_EQ(2, handler.packets.size());
+  EXPECT_EQ(std::vector<uint8_t>({0x02, 0x02}), handler.packets[0]);
+  EXPECT_EQ(std::vector<uint8_t>({0x04, 0x04}), handler.packets[1]);
+  EXPECT_EQ(0, bus.available());
+
+  ASSERT_EQ(0, packetizer.poll());
+}
+
+TEST_F(PacketizerReadBusTest, poll_without_a_handler_leaves_the_packet_for_get_packet) {
+  When(Method(ArduinoFake(), micros)).AlwaysReturn(0);
+
+  busIO << 0x02 << 0x02;
+
+  ASSERT_EQ(0, packetizer.poll());
+
+  expectPacket(0, 1);
+  EXPECT_EQ(2, bus.available());
+}
+
+TEST_F(PacketizerReadBusTest, poll_picks_up_where_it_left_off_when_work_budget_runs_out) {
+  When(Method(ArduinoFake(), micros)).AlwaysReturn(0);
+  RecordingPacketHandler handler;
+  packetizer.setPacketHandler(handler);
+
+  busIO << 0x01 << 0x03 << 0x05 << 0x02 << 0x02;
+
+  ASSERT_EQ(0, packetizer.poll(2));
+  Verify(Method(protocolSpy, isPacket)).Exactly(2);
+  EXPECT_EQ(3, bus.available());
+
+  ASSERT_EQ(1, packetizer.poll(2));
+  Verify(Method(protocolSpy, isPacket)).Exactly(4);
+
+  ASSERT_EQ(1, handler.packets.size());
+  EXPECT_EQ(std::vector<uint8_t>({0x02, 0x02}), handler.packets[0]);
+  EXPECT_EQ(0, bus.available());
+}
+
+TEST_F(PacketizerReadBusTest, poll_starts_over_when_new_bytes_show_up_after_work_budget_runs_out) {
+  When(Method(ArduinoFake(), micros)).AlwaysReturn(0);
+  RecordingPacketHandler handler;
+  packetizer.setPacketHandler(handler);
+
+  busIO << 0x04 << 0x01 << 0x03 << 0x06 << 0x06;
+  ASSERT_EQ(0, packetizer.poll(2));  // Stops before 0x06 0x06, with 0x04 still waiting on more bytes
+
+  // This finishes the 0x04 packet, which has to win over the 0x06 packet inside of it
+  busIO << 0x04;
+  ASSERT_EQ(1, packetizer.poll());
+
+  ASSERT_EQ(1, handler.packets.size());
+  EXPECT_EQ(std::vector<uint8_t>({0x04, 0x01, 0x03, 0x06, 0x06, 0x04}), handler.packets[0]);
+  EXPECT_EQ(0, bus.available());
+}
+
+TEST_F(PacketizerReadBusTest, poll_waits_for_a_quiet_bus_before_handing_over_a_packet_past_the_start) {
+  TimeMicroseconds_t currentTime = 0;
+  When(Method(ArduinoFake(), micros)).AlwaysDo([&]()->unsigned long{ return currentTime; });
+  RecordingPacketHandler handler;
+  packetizer.setPacketHandler(handler);
+  packetizer.setFalsePacketVerificationTimeout(100);
+
+  busIO << 0x08 << 0x02 << 0x02;
+
+  ASSERT_EQ(0, packetizer.poll());  // 0x08 might still end after this packet
+  expectPacket(1, 2);
+
+  currentTime = 50;
+  ASSERT_EQ(0, packetizer.poll());
+
+  currentTime = 200;
+  ASSERT_EQ(1, packetizer.poll());
+
+  ASSERT_EQ(1, handler.packets.size());
+  EXPECT_EQ(std::vector<uint8_t>({0x02, 0x02}), handler.packets[0]);
+  EXPECT_EQ(0, bus.available());
+}
+
+TEST_F(PacketizerReadBusTest, frame_gap_only_checks_the_start_of_each_frame) {
+  TimeMicroseconds_t currentTime = 0;
+  When(Method(ArduinoFake(), micros)).AlwaysDo([&]()->unsigned long{ return currentTime; });
+  RecordingPacketHandler handler;
+  packetizer.setPacketHandler(handler);
+  packetizer.setFrameGap(100);
+
+  busIO << 0x01 << 0x02 << 0x02;  // One frame. Searching every offset would find 0x02 0x02 in here.
+
+  ASSERT_EQ(0, packetizer.poll());
+  currentTime = 100;
+  ASSERT_EQ(0, packetizer.poll());  // Not over yet
+  Verify(Method(protocolSpy, isPacket)).Never();
+
+  currentTime = 101;
+  ASSERT_EQ(0, packetizer.poll());
+  Verify(Method(protocolSpy, isPacket).Using(_, 0, 2)).Once();
+  EXPECT_EQ(0, bus.available());  // Not a packet, so the whole frame is gone
+  EXPECT_TRUE(handler.packets.empty());
+}
+
+TEST_F(PacketizerReadBusTest, frame_gap_splits_frames_at_silence) {
+  TimeMicroseconds_t currentTime = 0;
+  When(Method(ArduinoFake(), micros)).AlwaysDo([&]()->unsigned long{ return currentTime; });
+  RecordingPacketHandler handler;
+  packetizer.setPacketHandler(handler);
+  packetizer.setFrameGap(100);
+
+  busIO << 0x03;
+  packetizer.poll();
+  currentTime = 50;
+  busIO << 0x03;  // Same frame
+  packetizer.poll();
+  currentTime = 200;
+  busIO << 0x04 << 0x04;  // New frame
+  packetizer.poll();
+
+  ASSERT_EQ(1, handler.packets.size());  // The first frame is over now that the next one started
+  EXPECT_EQ(std::vector<uint8_t>({0x03, 0x03}), handler.packets[0]);
+
+  currentTime = 301;
+  packetizer.poll();
+
+  ASSERT_EQ(2, handler.packets.size());
+  EXPECT_EQ(std::vector<uint8_t>({0x04, 0x04}), handler.packets[1]);
+  EXPECT_EQ(0, bus.available());
+}
+
+TEST_F(PacketizerReadBusTest, frame_gap_find_packets_collects_every_finished_frame) {
+  TimeMicroseconds_t currentTime = 0;
+  When(Method(ArduinoFake(), micros)).AlwaysDo([&]()->unsigned long{ return currentTime; });
+  packetizer.setFrameGap(100);
+
+  busIO << 0x02 << 0x02;
+  packetizer.poll();
+  currentTime = 200;
+  busIO << 0x05 << 0x06;  // Not a packet
+  packetizer.poll();
+  currentTime = 400;
+  busIO << 0x04 << 0x04;
+  packetizer.poll();
+  currentTime = 600;
+
+  Packet storage[4];
+  PacketBatch batch = packetizer.findPackets(storage, 4);
+
+  ASSERT_EQ(2, batch.size());
+  EXPECT_EQ(0, batch[0].startIndex);
+  EXPECT_EQ(1, batch[0].endIndex);
+  EXPECT_EQ(4, batch[1].startIndex);
+  EXPECT_EQ(5, batch[1].endIndex);
+
+  packetizer.clearPackets(batch);
+  EXPECT_EQ(0, bus.available());
+}
+
+// Keeps track of what the packetizer hands the protocol so we can check that streaming candidates only see each byte once
+class CountingPhotonProtocol: public PhotonProtocol {
+public:
+  virtual IsPacketResult isPacket(const RS485BusBase& bus, size_t startIndex, size_t endIndex) const {
+    isPacketCalls++;
+    return PhotonProtocol::isPacket(bus, startIndex, endIndex);
+  }
+
+  virtual StreamingResult feed(StreamingState& state, const uint8_t* data, size_t length, size_t maxLength) const {
+    bytesFed += length;
+    return PhotonProtocol::feed(state, data, length, maxLength);
+  }
+
+  mutable size_t isPacketCalls = 0;
+  mutable size_t bytesFed = 0;
+};
+
+class PacketizerStreamingTest : public PrepBus {
+protected:
+  PacketizerStreamingTest(): PrepBus(),
+    bus(busIO, readEnablePin, writeEnablePin),
+    packetizer(bus, protocol) {}
+
+  AssertableBusIO busIO;
+  RS485Bus<64> bus;
+  CountingPhotonProtocol protocol;
+  Packetizer packetizer;
+};
+
+TEST_F(PacketizerStreamingTest, streaming_protocol_only_sees_new_bytes) {
+  uint8_t packet[6] = {0x45, 0x00, 0x01, 0x01, 0x40, 0x05};
+
+  for(size_t i = 0; i < 6; i++) {
+    busIO << packet[i];
+    bus.fetch();
+
+    EXPECT_EQ(i == 5, packetizer.hasPacketNow());
+  }
+
+  Packet found = packetizer.getPacket();
+  EXPECT_EQ(0, found.startIndex);
+  EXPECT_EQ(5, found.endIndex);
+
+  // Each candidate is handed at most every byte from its start to the end of the bus once, never the same byte again
+  EXPECT_LE(protocol.bytesFed, 6 + 5 + 4 + 3 + 2 + 1);
+  EXPECT_EQ(0, protocol.isPacketCalls);
+}
+
+TEST_F(PacketizerStreamingTest, candidates_past_what_we_can_track_use_is_packet) {
+  // Every byte looks like a header asking for more bytes than we'll give it, so every offset is still a candidate
+  const size_t candidates = RS485_PENDING_CANDIDATES + 2;
+  for(size_t i = 0; i < candidates; i++) {
+    busIO << candidates;
+  }
+  bus.fetch();
+
+  ASSERT_FALSE(packetizer.hasPacketNow());
+
+  size_t expectedBytesFed = 0;
+  for(size_t i = 0; i < RS485_PENDING_CANDIDATES; i++) {
+    expectedBytesFed += candidates - i;
+  }
+  EXPECT_EQ(expectedBytesFed, protocol.bytesFed);
+  EXPECT_EQ(2, protocol.isPacketCalls);
+
+  busIO << candidates;
+  bus.fetch();
+
+  ASSERT_FALSE(packetizer.hasPacketNow());
+
+  // Tracked candidates know they need more than one more byte, so they aren't fed anything. The rest, plus the new one,
+  // go through isPacket.
+  EXPECT_EQ(expectedBytesFed, protocol.bytesFed);
+  EXPECT_EQ(2 + 3, protocol.isPacketCalls);
+}
+
+// Same as CountingPhotonProtocol, but without the streaming interface
+class CountingStatelessPhotonProtocol: public CountingPhotonProtocol {
+public:
+  virtual const StreamingProtocol* streaming() const { return nullptr; }
+
+  virtual IsPacketResult isPacket(const RS485BusBase& bus, size_t startIndex, size_t endIndex) const {
+    if(startIndex == 0) {
+      firstByteEndIndexes[firstByteCalls++] = endIndex;
+    }
+    return CountingPhotonProtocol::isPacket(bus, startIndex, endIndex);
+  }
+
+  mutable size_t firstByteCalls = 0;
+  mutable size_t firstByteEndIndexes[16];
+};
+
+TEST_F(PacketizerStreamingTest, candidate_is_not_checked_again_until_it_has_the_bytes_it_needs) {
+  CountingStatelessPhotonProtocol statelessProtocol;
+  Packetizer statelessPacketizer(bus, statelessProtocol);
+
+  // Payload length of 3 means 8 bytes total
+  uint8_t packet[8] = {0x45, 0x00, 0x01, 0x03, 0x00, 0x05, 0x06, 0x07};
+  CRC8_107 checksum;
+  for(size_t i = 0; i < 8; i++) {
+    if(i != 4) {
+      checksum.add(packet[i]);
+    }
+  }
+  packet[4] = checksum.getChecksum();
+
+  for(size_t i = 0; i < 8; i++) {
+    busIO << packet[i];
+    bus.fetch();
+
+    EXPECT_EQ(i == 7, statelessPacketizer.hasPacketNow());
+  }
+
+  // Once to learn it needs a header, once to learn it needs 8 bytes, and once when it has them
+  ASSERT_EQ(3, statelessProtocol.firstByteCalls);
+  EXPECT_EQ(0, statelessProtocol.firstByteEndIndexes[0]);
+  EXPECT_EQ(4, statelessProtocol.firstByteEndIndexes[1]);
+  EXPECT_EQ(7, statelessProtocol.firstByteEndIndexes[2]);
+
+  Packet found = statelessPacketizer.getPacket();
+  EXPECT_EQ(0, found.startIndex);
+  EXPECT_EQ(7, found.endIndex);
+}
+
 //  --- DEMARC
 
 // TEST_F(PacketizerReadBusTest, can_get_simple_packet_with_fetch) {  // TODO wait: Update to use wait
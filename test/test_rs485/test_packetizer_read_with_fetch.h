@@ -153,6 +153,40 @@ TEST_F(PacketizerReadWithFetchTest, max_read_timeout_is_still_respected_even_if_
     Verify(Method(packetizerSpy, hasPacketNow)).Once();
 }
 
+TEST_F(PacketizerReadWithFetchTest, has_packet_waits_on_the_bus_instead_of_spinning) {
+    Mock<AssertableBusIO> busIOSpy = busIO.spy();
+    packetizer.setMaxReadTimeout(3);
+
+    ASSERT_FALSE(packetizer.hasPacket());
+
+    // Each fetch moves time forward by 1, so we only ever wait for whatever is left of the max read timeout
+    Verify(
+      Method(busIOSpy, waitForBytes).Using(2),
+      Method(busIOSpy, waitForBytes).Using(1),
+      Method(busIOSpy, waitForBytes).Using(0)
+    ).Once();
+    VerifyNoOtherInvocations(Method(busIOSpy, waitForBytes));
+}
+
+TEST_F(PacketizerReadWithFetchTest, false_verification_wait_is_limited_to_verification_time_left) {
+    Mock<AssertableBusIO> busIOSpy = busIO.spy();
+    packetizer.setMaxReadTimeout(100);
+    packetizer.setFalsePacketVerificationTimeout(3);
+
+    busIO << 0x02 << 0x04 << 0x04;
+    bus.fetch();
+
+    ASSERT_TRUE(packetizer.hasPacket());
+    expectPacket(1, 2);
+
+    Verify(
+      Method(busIOSpy, waitForBytes).Using(2),
+      Method(busIOSpy, waitForBytes).Using(1),
+      Method(busIOSpy, waitForBytes).Using(0)
+    ).Once();
+    VerifyNoOtherInvocations(Method(busIOSpy, waitForBytes));
+}
+
 TEST_F(PacketizerReadWithFetchTest, max_read_timeout_is_hit_if_new_bytes_keep_coming_in) {
     packetizer.setMaxReadTimeout(10);
 
@@ -1,11 +1,14 @@
 #pragma once
 
 #include "../matching_bytes.h"
+#include "test_rs485bus.h"
 
 #include <gtest/gtest.h>
+#include <vector>
 #include "fakeit/fakeit.hpp"
 
 #include "rs485/rs485bus_base.h"
+#include "rs485/rs485bus.hpp"
 #include "rs485/packetizer.h"
 
 
@@ -277,6 +280,76 @@ TEST_F(PacketizerWriteTest, no_write_new_bytes_in_middle_of_message) {
   VerifyNoOtherInvocations(Method(fakeBus, write));
 }
 
+TEST_F(PacketizerWriteTest, failure_offset_is_first_byte_not_written) {
+  When(Method(fakeBus, write)).AlwaysReturn(WriteResult::OK);
+  When(Method(fakeBus, write)(0x78)).AlwaysReturn(WriteResult::FAILED_READ_BACK);
+
+  EXPECT_EQ(PacketWriteResult::FAILED_INTERRUPTED, this->writePacket());
+  EXPECT_EQ(3, packetizer.getWriteFailureOffset());
+}
+
+TEST_F(PacketizerWriteTest, failure_offset_is_packet_size_on_success) {
+  When(Method(fakeBus, write)).AlwaysReturn(WriteResult::OK);
+
+  EXPECT_EQ(PacketWriteResult::OK, this->writePacket());
+  EXPECT_EQ(7, packetizer.getWriteFailureOffset());
+}
+
+TEST_F(PacketizerWriteTest, write_window_writes_whole_packet_at_once) {
+  packetizer.setWriteWindow(4);
+  When(Method(fakeBus, writeBytes)).AlwaysDo(
+    [](const uint8_t* /*buffer*/, size_t length, size_t /*windowSize*/, size_t& bytesVerified) -> WriteResult {
+      bytesVerified = length;
+      return WriteResult::OK;
+    });
+
+  EXPECT_EQ(PacketWriteResult::OK, this->writePacket());
+  EXPECT_EQ(7, packetizer.getWriteFailureOffset());
+
+  Verify(
+    Method(fakeBus, enableWrite).Using(true),
+    Method(fakeBus, writeBytes).Using(buffer, 7, 4, _),
+    Method(fakeBus, enableWrite).Using(false)
+  ).Once();
+
+  Verify(Method(fakeBus, write)).Never();
+}
+
+TEST_F(PacketizerWriteTest, write_window_with_unexpected_extra_bytes_at_beginning_of_message) {
+  packetizer.setWriteWindow(4);
+  When(Method(fakeBus, writeBytes)).AlwaysDo(
+    [](const uint8_t* /*buffer*/, size_t length, size_t /*windowSize*/, size_t& bytesVerified) -> WriteResult {
+      bytesVerified = length;
+      return WriteResult::UNEXPECTED_EXTRA_BYTES;
+    });
+
+  EXPECT_EQ(PacketWriteResult::OK, this->writePacket());
+}
+
+TEST_F(PacketizerWriteTest, write_window_reports_where_packet_was_interrupted) {
+  packetizer.setWriteWindow(4);
+  When(Method(fakeBus, writeBytes)).AlwaysDo(
+    [](const uint8_t* /*buffer*/, size_t /*length*/, size_t /*windowSize*/, size_t& bytesVerified) -> WriteResult {
+      bytesVerified = 5;
+      return WriteResult::FAILED_READ_BACK;
+    });
+
+  EXPECT_EQ(PacketWriteResult::FAILED_INTERRUPTED, this->writePacket());
+  EXPECT_EQ(5, packetizer.getWriteFailureOffset());
+}
+
+TEST_F(PacketizerWriteTest, write_window_with_full_buffer) {
+  packetizer.setWriteWindow(4);
+  When(Method(fakeBus, writeBytes)).AlwaysDo(
+    [](const uint8_t* /*buffer*/, size_t /*length*/, size_t /*windowSize*/, size_t& bytesVerified) -> WriteResult {
+      bytesVerified = 2;
+      return WriteResult::READ_BUFFER_FULL;
+    });
+
+  EXPECT_EQ(PacketWriteResult::FAILED_BUFFER_FULL, this->writePacket());
+  EXPECT_EQ(2, packetizer.getWriteFailureOffset());
+}
+
 TEST_F(PacketizerWriteTest, write_packet_delays_to_ensure_quiet_time) {
   packetizer.setMaxWriteTimeout(101);
   packetizer.setBusQuietTime(100);
@@ -418,4 +491,238 @@ TEST_F(PacketizerWriteTest, write_packet_delays_until_timeout) {
 //   ).Once();
 
 //   VerifyNoOtherInvocations(Method(fakeBus, write));
-// }
\ No newline at end of file
+// }
+
+TEST_F(PacketizerWriteTest, interrupted_write_is_retried) {
+  packetizer.setMaxWriteAttempts(3);
+  When(Method(fakeBus, write)).AlwaysReturn(WriteResult::OK);
+  When(Method(fakeBus, write)(0x34)).Return(WriteResult::FAILED_READ_BACK).AlwaysReturn(WriteResult::OK);
+
+  EXPECT_EQ(PacketWriteResult::OK, this->writePacket());
+  EXPECT_EQ(2, packetizer.getLastWriteAttempts());
+
+  const WriteStatistics& statistics = packetizer.getWriteStatistics();
+  EXPECT_EQ(1, statistics.packets);
+  EXPECT_EQ(2, statistics.attempts);
+  EXPECT_EQ(1, statistics.interrupted);
+  EXPECT_EQ(0, statistics.timedOut);
+  EXPECT_EQ(0, statistics.gaveUp);
+
+  Verify(
+    Method(fakeBus, write).Using(0x12),
+    Method(fakeBus, write).Using(0x34),
+    Method(fakeBus, write).Using(0x12),
+    Method(fakeBus, write).Using(0x34),
+    Method(fakeBus, write).Using(0x56)
+  ).Once();
+}
+
+TEST_F(PacketizerWriteTest, write_gives_up_after_max_attempts) {
+  packetizer.setMaxWriteAttempts(3);
+  When(Method(fakeBus, write)).AlwaysReturn(WriteResult::FAILED_READ_BACK);
+
+  EXPECT_EQ(PacketWriteResult::FAILED_INTERRUPTED, this->writePacket());
+  EXPECT_EQ(3, packetizer.getLastWriteAttempts());
+  Verify(Method(fakeBus, write).Using(0x12)).Exactly(3);
+
+  const WriteStatistics& statistics = packetizer.getWriteStatistics();
+  EXPECT_EQ(1, statistics.packets);
+  EXPECT_EQ(3, statistics.attempts);
+  EXPECT_EQ(3, statistics.interrupted);
+  EXPECT_EQ(1, statistics.gaveUp);
+
+  packetizer.resetWriteStatistics();
+  EXPECT_EQ(0, packetizer.getWriteStatistics().attempts);
+}
+
+TEST_F(PacketizerWriteTest, full_buffer_is_not_retried) {
+  packetizer.setMaxWriteAttempts(3);
+  When(Method(fakeBus, write)).AlwaysReturn(WriteResult::READ_BUFFER_FULL);
+
+  EXPECT_EQ(PacketWriteResult::FAILED_BUFFER_FULL, this->writePacket());
+  EXPECT_EQ(1, packetizer.getLastWriteAttempts());
+  Verify(Method(fakeBus, write)).Once();
+}
+
+TEST_F(PacketizerWriteTest, backoff_range_doubles_with_each_attempt) {
+  std::vector<unsigned int> delays;
+  When(Method(ArduinoFake(), delayMicroseconds)).AlwaysDo([&](unsigned int delay) { delays.push_back(delay); });
+  When(Method(fakeBus, write)).AlwaysReturn(WriteResult::FAILED_READ_BACK);
+
+  packetizer.setMaxWriteAttempts(6);
+  packetizer.setBackoffSlotTime(100);
+  packetizer.setBackoffSeed(0x1234);
+
+  EXPECT_EQ(PacketWriteResult::FAILED_INTERRUPTED, this->writePacket());
+
+  ASSERT_EQ(5, delays.size());  // One between each attempt
+  TimeMicroseconds_t totalDelay = 0;
+  for(size_t i = 0; i < delays.size(); i++) {
+    EXPECT_EQ(0, delays[i] % 100);
+    EXPECT_LT(delays[i], (1UL << (i + 1)) * 100);
+    totalDelay += delays[i];
+  }
+  EXPECT_EQ(totalDelay, packetizer.getWriteStatistics().backoffTime);
+}
+
+class RecordingWriteHandler: public WriteHandler {
+public:
+  virtual void writeComplete(const uint8_t* /*buffer*/, size_t /*bufferSize*/, PacketWriteResult result) {
+    completed++;
+    lastResult = result;
+  }
+
+  size_t completed = 0;
+  PacketWriteResult lastResult = PacketWriteResult::OK;
+};
+
+class PacketizerQueuedWriteTest : public PrepBus {
+protected:
+  PacketizerQueuedWriteTest(): PrepBus(),
+    bus(busIO, readEnablePin, writeEnablePin),
+    packetizer(bus, protocol) {}
+
+  void SetUp() {
+    When(Method(ArduinoFake(), micros)).AlwaysDo([&]()->unsigned long{ return currentTime; });
+
+    ArduinoFake().ClearInvocationHistory();
+  };
+
+  TimeMicroseconds_t currentTime = 0;
+  EchoingBusIO busIO;
+  RS485Bus<8> bus;
+  ProtocolMatchingBytes protocol;
+  Packetizer packetizer;
+  RecordingWriteHandler handler;
+
+  uint8_t buffer[3] = {0x12, 0x34, 0x56};
+};
+
+TEST_F(PacketizerQueuedWriteTest, enqueue_does_not_write_anything) {
+  ASSERT_TRUE(packetizer.enqueuePacket(buffer, 3, &handler));
+
+  EXPECT_EQ(1, packetizer.queuedPackets());
+  EXPECT_EQ(-1, busIO.written());
+}
+
+TEST_F(PacketizerQueuedWriteTest, queued_packet_is_written_a_window_at_a_time) {
+  packetizer.setWriteWindow(2);
+  packetizer.enqueuePacket(buffer, 3, &handler);
+
+  packetizer.poll();
+  EXPECT_EQ(0x12, busIO.written());
+  EXPECT_EQ(0x34, busIO.written());
+  EXPECT_EQ(-1, busIO.written());
+
+  packetizer.poll();  // Both come back, so the last byte goes out
+  EXPECT_EQ(0x56, busIO.written());
+  EXPECT_EQ(0, handler.completed);
+
+  packetizer.poll();
+  ASSERT_EQ(1, handler.completed);
+  EXPECT_EQ(PacketWriteResult::OK, handler.lastResult);
+  EXPECT_EQ(3, packetizer.getWriteFailureOffset());
+  EXPECT_EQ(0, packetizer.queuedPackets());
+  EXPECT_EQ(0, bus.available());  // Our own echo never ends up on the bus
+
+  Verify(
+    Method(ArduinoFake(), digitalWrite).Using(writeEnablePin, HIGH),
+    Method(ArduinoFake(), digitalWrite).Using(writeEnablePin, LOW)
+  ).Once();
+}
+
+TEST_F(PacketizerQueuedWriteTest, queued_packet_waits_for_quiet_bus) {
+  packetizer.setBusQuietTime(100);
+
+  busIO << 0x01;
+  currentTime = 10;
+  packetizer.enqueuePacket(buffer, 3, &handler);
+  packetizer.poll();
+  EXPECT_EQ(-1, busIO.written());
+
+  currentTime = 109;
+  packetizer.poll();
+  EXPECT_EQ(-1, busIO.written());
+
+  currentTime = 110;
+  packetizer.poll();
+  EXPECT_EQ(0x12, busIO.written());
+}
+
+TEST_F(PacketizerQueuedWriteTest, queued_packet_times_out_on_a_noisy_bus) {
+  packetizer.setBusQuietTime(100);
+  packetizer.setMaxWriteTimeout(50);
+  packetizer.enqueuePacket(buffer, 3, &handler);
+
+  for(currentTime = 0; currentTime <= 50; currentTime += 10) {
+    busIO << 0x01;  // Somebody else is always talking
+    packetizer.poll();
+  }
+
+  ASSERT_EQ(1, handler.completed);
+  EXPECT_EQ(PacketWriteResult::FAILED_TIMEOUT, handler.lastResult);
+  EXPECT_EQ(-1, busIO.written());
+  EXPECT_EQ(0, packetizer.queuedPackets());
+}
+
+TEST_F(PacketizerQueuedWriteTest, queued_packet_reports_where_it_was_interrupted) {
+  busIO.corruptIndex = 1;
+  packetizer.enqueuePacket(buffer, 3, &handler);
+
+  for(size_t i = 0; i < 5 && handler.completed == 0; i++) {
+    packetizer.poll();
+  }
+
+  ASSERT_EQ(1, handler.completed);
+  EXPECT_EQ(PacketWriteResult::FAILED_INTERRUPTED, handler.lastResult);
+  EXPECT_EQ(1, packetizer.getWriteFailureOffset());
+}
+
+TEST_F(PacketizerQueuedWriteTest, queued_packets_are_written_in_order) {
+  uint8_t second[1] = {0x78};
+  packetizer.setWriteWindow(3);
+  packetizer.enqueuePacket(buffer, 3, &handler);
+  packetizer.enqueuePacket(second, 1, &handler);
+
+  for(size_t i = 0; i < 5 && handler.completed < 2; i++) {
+    packetizer.poll();
+  }
+
+  EXPECT_EQ(2, handler.completed);
+  EXPECT_EQ(0x12, busIO.written());
+  EXPECT_EQ(0x34, busIO.written());
+  EXPECT_EQ(0x56, busIO.written());
+  EXPECT_EQ(0x78, busIO.written());
+}
+
+TEST_F(PacketizerQueuedWriteTest, queue_has_a_fixed_size) {
+  for(size_t i = 0; i < RS485_WRITE_QUEUE_SIZE; i++) {
+    ASSERT_TRUE(packetizer.enqueuePacket(buffer, 3));
+  }
+
+  EXPECT_FALSE(packetizer.enqueuePacket(buffer, 3));
+  EXPECT_EQ(RS485_WRITE_QUEUE_SIZE, packetizer.queuedPackets());
+}
+
+TEST_F(PacketizerQueuedWriteTest, interrupted_queued_packet_backs_off_and_tries_again) {
+  busIO.corruptIndex = 1;
+  packetizer.setMaxWriteAttempts(2);
+  packetizer.setBackoffSlotTime(100);
+  packetizer.enqueuePacket(buffer, 3, &handler);
+
+  for(size_t i = 0; i < 3; i++) {
+    packetizer.poll();
+  }
+  EXPECT_EQ(0, handler.completed);
+  EXPECT_EQ(1, packetizer.getWriteStatistics().interrupted);
+
+  // At most one slot of backoff after the first failure, then a few polls to write it again
+  for(currentTime = 0; currentTime <= 200 && handler.completed == 0; currentTime += 10) {
+    packetizer.poll();
+  }
+
+  ASSERT_EQ(1, handler.completed);
+  EXPECT_EQ(PacketWriteResult::OK, handler.lastResult);
+  EXPECT_EQ(2, packetizer.getLastWriteAttempts());
+  EXPECT_EQ(2, packetizer.getWriteStatistics().attempts);
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <gtest/gtest.h>
+
+#include "rs485/rejection_bitmap.h"
+
+class RejectionBitmapTest : public ::testing::Test {
+public:
+  RejectionBitmapTest():
+    bitmap(words, 100) {}
+
+  void SetUp() {
+    bitmap.clear();
+  };
+
+  // One extra word past what the bitmap owns so we can tell if it writes past its storage
+  uint32_t words[RejectionBitmap::wordsFor(100) + 1] = {0, 0, 0, 0, 0xFFFFFFFF};
+  RejectionBitmap bitmap;
+};
+
+TEST_F(RejectionBitmapTest, words_needed_rounds_up) {
+  EXPECT_EQ(0, RejectionBitmap::wordsFor(0));
+  EXPECT_EQ(1, RejectionBitmap::wordsFor(1));
+  EXPECT_EQ(1, RejectionBitmap::wordsFor(32));
+  EXPECT_EQ(2, RejectionBitmap::wordsFor(33));
+  EXPECT_EQ(4, RejectionBitmap::wordsFor(100));
+}
+
+TEST_F(RejectionBitmapTest, clear_only_touches_its_own_words) {
+  EXPECT_EQ(100, bitmap.size());
+  for(size_t i = 0; i < 4; i++) {
+    EXPECT_EQ(0, words[i]);
+  }
+  EXPECT_EQ(0xFFFFFFFF, words[4]);
+}
+
+TEST_F(RejectionBitmapTest, set_bits_in_every_word) {
+  bitmap.set(0);
+  bitmap.set(31);
+  bitmap.set(32);
+  bitmap.set(99);
+
+  for(size_t i = 0; i < 100; i++) {
+    EXPECT_EQ(i == 0 || i == 31 || i == 32 || i == 99, bitmap.isSet(i)) << "bit " << i;
+  }
+}
+
+TEST_F(RejectionBitmapTest, bits_past_the_end_are_never_set) {
+  bitmap.set(100);
+  bitmap.set(127);
+
+  EXPECT_FALSE(bitmap.isSet(100));
+  EXPECT_FALSE(bitmap.isSet(127));
+  EXPECT_EQ(0, words[3]);
+}
+
+TEST_F(RejectionBitmapTest, shift_down_within_words) {
+  bitmap.set(3);
+  bitmap.set(33);
+  bitmap.set(40);
+
+  bitmap.shiftDown(3);
+
+  for(size_t i = 0; i < 100; i++) {
+    EXPECT_EQ(i == 0 || i == 30 || i == 37, bitmap.isSet(i)) << "bit " << i;
+  }
+}
+
+TEST_F(RejectionBitmapTest, shift_down_by_whole_words) {
+  bitmap.set(64);
+  bitmap.set(70);
+  bitmap.set(99);
+
+  bitmap.shiftDown(64);
+
+  for(size_t i = 0; i < 100; i++) {
+    EXPECT_EQ(i == 0 || i == 6 || i == 35, bitmap.isSet(i)) << "bit " << i;
+  }
+  EXPECT_EQ(0xFFFFFFFF, words[4]);
+}
+
+TEST_F(RejectionBitmapTest, shift_down_past_the_end_clears_everything) {
+  bitmap.set(10);
+  bitmap.set(99);
+
+  bitmap.shiftDown(200);
+
+  for(size_t i = 0; i < 100; i++) {
+    EXPECT_FALSE(bitmap.isSet(i)) << "bit " << i;
+  }
+}
\ No newline at end of file
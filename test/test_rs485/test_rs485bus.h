@@ -9,6 +9,20 @@
 
 using namespace fakeit;
 
+// Every byte written with writeBytes shows up to be read back, like it would on a real bus.
+class EchoingBusIO: public AssertableBusIO {
+public:
+  virtual void writeBytes(const uint8_t* buffer, size_t length) {
+    AssertableBusIO::writeBytes(buffer, length);
+    for(size_t i = 0; i < length; i++) {
+      readable(i == corruptIndex ? ~buffer[i] : buffer[i]);
+    }
+    corruptIndex = (corruptIndex >= length) ? corruptIndex - length : -1;
+  }
+
+  size_t corruptIndex = -1;  // Which byte to flip the bits of on the way back, counting from the next write
+};
+
 class RS485BusTest : public PrepBus {
 public:
   RS485BusTest(): PrepBus(),
@@ -95,6 +109,70 @@ TEST_F(RS485BusTest, will_not_fetch_bytes_if_internal_buffer_is_full) {
   EXPECT_EQ(-1, busIO[1]);
 }
 
+TEST_F(RS485BusTest, fetch_reads_bytes_in_chunks) {
+  busIO << 1 << 2 << 3 << 4 << 5;
+
+  EXPECT_EQ(5, bus8.fetch());
+
+  Verify(
+    Method(spy, available),
+    Method(spy, readBytes).Using(_, 5),
+    Method(spy, available)
+  ).Once();
+  VerifyNoOtherInvocations(Method(spy, read));
+}
+
+TEST_F(RS485BusTest, fetch_wraps_around_the_end_of_the_buffer) {
+  busIO << 1 << 2 << 3 << 4 << 5 << 6;
+  bus8.fetch();
+
+  for(size_t i = 0; i < 5; i++) {
+    bus8.read();  // Move the head forward so the next fetch has to wrap
+  }
+
+  busIO << 7 << 8 << 9 << 10 << 11 << 12 << 13 << 14;
+  spy.ClearInvocationHistory();
+
+  EXPECT_EQ(7, bus8.fetch());  // 6 was still in the buffer, so only 7 more fit
+
+  Verify(
+    Method(spy, available),
+    Method(spy, readBytes).Using(_, 2),  // Up to the end of our buffer
+    Method(spy, available),
+    Method(spy, readBytes).Using(_, 5)   // From the start of our buffer up to the head
+  ).Once();
+
+  EXPECT_TRUE(bus8.isBufferFull());
+  for(size_t i = 0; i < 8; i++) {
+    EXPECT_EQ(6 + i, bus8[i]);
+  }
+  EXPECT_EQ(-1, bus8[8]);
+  EXPECT_EQ(1, busIO.available());
+}
+
+TEST_F(RS485BusTest, waiting_for_bytes_is_passed_to_bus_io) {
+  When(Method(spy, waitForBytes)).Return(false, true);
+
+  EXPECT_FALSE(bus8.waitForBytes(25));
+  EXPECT_TRUE(bus8.waitForBytes(30));
+
+  Verify(
+    Method(spy, waitForBytes).Using(25),
+    Method(spy, waitForBytes).Using(30)
+  ).Once();
+}
+
+TEST_F(RS485BusTest, waiting_for_bytes_with_a_full_buffer_does_not_ask_bus_io) {
+  for(uint8_t i = 0; i < 9; i++) {
+    busIO << i;
+  }
+  bus8.fetch();
+  ASSERT_TRUE(bus8.isBufferFull());
+
+  EXPECT_FALSE(bus8.waitForBytes(25));
+  VerifyNoOtherInvocations(Method(spy, waitForBytes));
+}
+
 TEST_F(RS485BusTest, by_default_read_pin_is_enabled_and_write_is_disabled) {
   RS485Bus<8> bus(busIO, readEnablePin, writeEnablePin);
 
@@ -360,13 +438,13 @@ TEST_F(RS485BusTest, fetching_bytes_before_write_returns_no_write_new_bytes) {
 
   Verify(
     Method(spy, available), // Returns 1, fetch #1
-    Method(spy, read),      // 0x21
+    Method(spy, readBytes), // 0x21
     Method(spy, available), // Returns 0, fetch #1
     Method(ArduinoFake(), delayMicroseconds).Using(7),
     Method(spy, available), // Returns 0, fetch #2
     Method(ArduinoFake(), delayMicroseconds).Using(7),
     Method(spy, available), // Returns 1, fetch #3
-    Method(spy, read),      // 0x34
+    Method(spy, readBytes), // 0x34
     Method(spy, available), // Returns 0, fetch #3
     Method(ArduinoFake(), delayMicroseconds).Using(7),
     Method(spy, available), // Returns 0, fetch #4
@@ -392,10 +470,8 @@ TEST_F(RS485BusTest, write_when_buffer_should_already_be_full) {
   EXPECT_EQ(WriteResult::NO_WRITE_BUFFER_FULL, bus2.write(0x37));
 
   Verify(
-    Method(spy, available),
-    Method(spy, read),
-    Method(spy, available),
-    Method(spy, read)
+    Method(spy, available),  // Returns 3
+    Method(spy, readBytes)   // Only 2 bytes fit in our buffer
   ).Once();
 
   Verify(Method(spy, write)).Never();
@@ -519,3 +595,165 @@ TEST_F(RS485BusTest, read_clears_full_flag) {
   EXPECT_EQ(0, bus2.available());
   EXPECT_FALSE(bus2.isBufferFull());
 }
+
+TEST_F(RS485BusTest, segments_view_bytes_in_buffer) {
+  busIO << 1 << 2 << 3 << 4;
+  bus8.fetch();
+
+  BufferSegments segments = bus8.getSegments(1, 3);
+  ASSERT_EQ(3, segments.firstLength);
+  EXPECT_EQ(2, segments.first[0]);
+  EXPECT_EQ(3, segments.first[1]);
+  EXPECT_EQ(4, segments.first[2]);
+  EXPECT_EQ(nullptr, segments.second);
+  EXPECT_EQ(0, segments.secondLength);
+}
+
+TEST_F(RS485BusTest, segments_are_split_when_wrapping_around_buffer) {
+  busIO << 1 << 2 << 3 << 4 << 5 << 6;
+  bus8.fetch();
+  for(size_t i = 0; i < 6; i++) {
+    bus8.read();
+  }
+
+  busIO << 7 << 8 << 9 << 10;
+  bus8.fetch();
+
+  BufferSegments segments = bus8.getSegments(0, 3);
+  ASSERT_EQ(2, segments.firstLength);
+  EXPECT_EQ(7, segments.first[0]);
+  EXPECT_EQ(8, segments.first[1]);
+  ASSERT_EQ(2, segments.secondLength);
+  EXPECT_EQ(9, segments.second[0]);
+  EXPECT_EQ(10, segments.second[1]);
+
+  // Starting after the wrap is a single segment again
+  segments = bus8.getSegments(2, 3);
+  ASSERT_EQ(2, segments.firstLength);
+  EXPECT_EQ(9, segments.first[0]);
+  EXPECT_EQ(0, segments.secondLength);
+}
+
+TEST_F(RS485BusTest, segments_past_available_bytes_are_empty) {
+  busIO << 1 << 2;
+  bus8.fetch();
+
+  BufferSegments segments = bus8.getSegments(0, 2);
+  EXPECT_EQ(0, segments.firstLength);
+  EXPECT_EQ(0, segments.secondLength);
+
+  segments = bus8.getSegments(1, 0);
+  EXPECT_EQ(0, segments.firstLength);
+  EXPECT_EQ(0, segments.secondLength);
+}
+
+TEST_F(RS485BusTest, discard_removes_bytes_from_front_of_buffer) {
+  busIO << 1 << 2 << 3 << 4;
+  bus8.fetch();
+
+  EXPECT_EQ(3, bus8.discard(3));
+  EXPECT_EQ(1, bus8.available());
+  EXPECT_EQ(4, bus8[0]);
+  EXPECT_EQ(-1, bus8[1]);
+}
+
+TEST_F(RS485BusTest, discard_stops_at_available_bytes_and_clears_full_flag) {
+  busIO << 1 << 2;
+  bus2.fetch();
+  EXPECT_TRUE(bus2.isBufferFull());
+
+  EXPECT_EQ(2, bus2.discard(5));
+  EXPECT_EQ(0, bus2.available());
+  EXPECT_FALSE(bus2.isBufferFull());
+
+  EXPECT_EQ(0, bus2.discard(1));
+  EXPECT_EQ(0, bus2.available());
+}
+
+class RS485BusWriteBytesTest : public PrepBus {
+public:
+  RS485BusWriteBytesTest(): PrepBus(),
+    bus(busIO, readEnablePin, writeEnablePin) {}
+
+  void SetUp() {
+    ArduinoFake().ClearInvocationHistory();
+  };
+
+  EchoingBusIO busIO;
+  RS485Bus<8> bus;
+
+  uint8_t buffer[10] = {0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A};
+  size_t bytesVerified = 0;
+};
+
+TEST_F(RS485BusWriteBytesTest, bytes_are_written_in_windows) {
+  Mock<EchoingBusIO> spy(busIO);
+  Spy(Method(spy, writeBytes));
+
+  EXPECT_EQ(WriteResult::OK, bus.writeBytes(buffer, 10, 4, bytesVerified));
+  EXPECT_EQ(10, bytesVerified);
+
+  Verify(
+    Method(spy, writeBytes).Using(&buffer[0], 4),
+    Method(spy, writeBytes).Using(&buffer[4], 4),
+    Method(spy, writeBytes).Using(&buffer[8], 2)
+  ).Once();
+
+  for(size_t i = 0; i < 10; i++) {
+    EXPECT_EQ(buffer[i], busIO.written());
+  }
+  EXPECT_EQ(0, bus.available());
+}
+
+TEST_F(RS485BusWriteBytesTest, write_enable_is_toggled_once_for_all_bytes) {
+  EXPECT_EQ(WriteResult::OK, bus.writeBytes(buffer, 10, 4, bytesVerified));
+
+  Verify(
+    Method(ArduinoFake(), digitalWrite).Using(writeEnablePin, HIGH),
+    Method(ArduinoFake(), digitalWrite).Using(writeEnablePin, LOW)
+  ).Once();
+}
+
+TEST_F(RS485BusWriteBytesTest, mismatched_byte_reports_offset) {
+  busIO.corruptIndex = 6;
+
+  EXPECT_EQ(WriteResult::FAILED_READ_BACK, bus.writeBytes(buffer, 10, 4, bytesVerified));
+  EXPECT_EQ(6, bytesVerified);
+
+  // The byte we didn't expect is kept for the caller to look at, along with anything read in after it
+  ASSERT_GE(bus.available(), 1);
+  EXPECT_EQ((uint8_t) ~0x07, bus[0]);
+}
+
+TEST_F(RS485BusWriteBytesTest, extra_bytes_before_first_byte) {
+  Mock<EchoingBusIO> spy(busIO);
+  When(Method(spy, writeBytes)).Do([this](const uint8_t* buffer, size_t length) {
+    busIO.readable(0x77);  // Someone else's byte beats ours back
+    busIO.EchoingBusIO::writeBytes(buffer, length);
+  }).AlwaysDo([this](const uint8_t* buffer, size_t length) {
+    busIO.EchoingBusIO::writeBytes(buffer, length);
+  });
+
+  EXPECT_EQ(WriteResult::UNEXPECTED_EXTRA_BYTES, bus.writeBytes(buffer, 10, 4, bytesVerified));
+  EXPECT_EQ(10, bytesVerified);
+
+  ASSERT_EQ(1, bus.available());
+  EXPECT_EQ(0x77, bus[0]);
+}
+
+TEST_F(RS485BusWriteBytesTest, nothing_read_back) {
+  Mock<EchoingBusIO> spy(busIO);
+  When(Method(spy, writeBytes)).AlwaysDo([](const uint8_t* /*buffer*/, size_t /*length*/) {});  // Lost on the way out
+  bus.setReadBackRetries(2);
+
+  EXPECT_EQ(WriteResult::NO_READ_TIMEOUT, bus.writeBytes(buffer, 10, 4, bytesVerified));
+  EXPECT_EQ(0, bytesVerified);
+}
+
+TEST_F(RS485BusWriteBytesTest, does_not_write_if_new_bytes_are_fetched) {
+  busIO << 0x55;
+
+  EXPECT_EQ(WriteResult::NO_WRITE_NEW_BYTES, bus.writeBytes(buffer, 10, 4, bytesVerified));
+  EXPECT_EQ(0, bytesVerified);
+  EXPECT_EQ(-1, busIO.written());
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#if defined(__linux__)
+
+#include "../assertable_bus_io.hpp"
+#include "../fixtures.h"
+
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include "rs485/rs485bus_mirrored.h"
+#include "rs485/protocols/photon.h"
+
+using namespace fakeit;
+
+class MirroredRS485BusTest : public PrepBus {
+public:
+  MirroredRS485BusTest(): PrepBus(),
+    bus(busIO, readEnablePin, writeEnablePin, 100) {}
+
+  // Read and throw away bytes so the head of the bus ends up at the given offset from the start of its buffer
+  void moveHeadTo(size_t offset) {
+    while(offset > 0) {
+      size_t chunk = offset > 100 ? 100 : offset;
+      for(size_t i = 0; i < chunk; i++) {
+        busIO << 0xFF;
+      }
+      bus.fetch();
+      for(size_t i = 0; i < chunk; i++) {
+        bus.read();
+      }
+      offset -= chunk;
+    }
+  }
+
+  AssertableBusIO busIO;
+  MirroredRS485Bus bus;
+};
+
+TEST_F(MirroredRS485BusTest, buffer_size_is_rounded_up_to_page_size) {
+  ASSERT_TRUE(bus.isMirrored());
+  EXPECT_EQ(sysconf(_SC_PAGESIZE), bus.bufferSize());
+}
+
+TEST_F(MirroredRS485BusTest, segments_do_not_split_when_wrapping_around_buffer) {
+  moveHeadTo(bus.bufferSize() - 2);
+
+  busIO << 1 << 2 << 3 << 4;
+  EXPECT_EQ(4, bus.fetch());
+
+  BufferSegments segments = bus.getSegments(0, 3);
+  ASSERT_EQ(4, segments.firstLength);
+  EXPECT_EQ(1, segments.first[0]);
+  EXPECT_EQ(2, segments.first[1]);
+  EXPECT_EQ(3, segments.first[2]);
+  EXPECT_EQ(4, segments.first[3]);
+  EXPECT_EQ(nullptr, segments.second);
+  EXPECT_EQ(0, segments.secondLength);
+
+  EXPECT_EQ(1, bus[0]);
+  EXPECT_EQ(4, bus[3]);
+  EXPECT_EQ(-1, bus[4]);
+}
+
+TEST_F(MirroredRS485BusTest, fetch_reads_past_end_of_buffer_in_one_chunk) {
+  moveHeadTo(bus.bufferSize() - 2);
+
+  Mock<AssertableBusIO> spy = busIO.spy();
+  busIO << 1 << 2 << 3 << 4;
+  EXPECT_EQ(4, bus.fetch());
+
+  Verify(
+    Method(spy, available),
+    Method(spy, readBytes).Using(_, 4),
+    Method(spy, available)
+  ).Once();
+}
+
+TEST_F(MirroredRS485BusTest, read_wraps_around_buffer) {
+  moveHeadTo(bus.bufferSize() - 1);
+
+  busIO << 1 << 2;
+  bus.fetch();
+
+  EXPECT_EQ(1, bus.read());
+  EXPECT_EQ(2, bus.read());
+  EXPECT_EQ(-1, bus.read());
+}
+
+TEST_F(MirroredRS485BusTest, protocols_work_across_the_wrap) {
+  PhotonProtocol protocol;
+  moveHeadTo(bus.bufferSize() - 3);
+
+  busIO.readable<6>({0x45, 0x00, 0x01, 0x01, 0x40, 0x05});
+  bus.fetch();
+
+  IsPacketResult result = protocol.isPacket(bus, 0, bus.available() - 1);
+  EXPECT_EQ(PacketStatus::YES, result.status);
+  EXPECT_EQ(6, result.packetLength);
+}
+
+#endif
\ No newline at end of file